@@ -0,0 +1,453 @@
+#define _FILE_OFFSET_BITS 64
+#include "libslice.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>  // for SIZE_MAX
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+struct slice_file {
+    int fd;
+    int owns_fd;
+    off_t size;
+    const char *map;  // Whole-file read-only mapping, NULL if unavailable
+    int borrowed;     // map is the caller's memory (slice_open_mem)
+};
+
+static const char empty_view[1] = "";
+
+int slice_open_fd(int fd, slice_file **out) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return SLICE_ERR_OPEN;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return SLICE_ERR_NOT_REGULAR;
+    }
+
+    slice_file *f = calloc(1, sizeof(slice_file));
+    if (!f) {
+        return SLICE_ERR_NOMEM;
+    }
+    f->fd = fd;
+    f->size = st.st_size;
+
+    // Map the whole file once; every range is then a pointer into it. If
+    // the mapping fails (empty file, exhausted address space) ranges fall
+    // back to pread into a buffer owned by the view.
+    if (st.st_size > 0 && (uintmax_t)st.st_size <= SIZE_MAX) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            f->map = map;
+        }
+    }
+
+    *out = f;
+    return SLICE_OK;
+}
+
+int slice_open(const char *path, slice_file **out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return SLICE_ERR_OPEN;
+    }
+    int rc = slice_open_fd(fd, out);
+    if (rc != SLICE_OK) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return rc;
+    }
+    (*out)->owns_fd = 1;
+    return SLICE_OK;
+}
+
+int slice_open_mem(const char *data, size_t len, slice_file **out) {
+    if (!data && len > 0) {
+        return SLICE_ERR_INVALID;
+    }
+    slice_file *f = calloc(1, sizeof(slice_file));
+    if (!f) {
+        return SLICE_ERR_NOMEM;
+    }
+    f->fd = -1;
+    f->size = (off_t)len;
+    f->map = len > 0 ? data : NULL;
+    f->borrowed = 1;
+    *out = f;
+    return SLICE_OK;
+}
+
+void slice_close(slice_file *f) {
+    if (!f) {
+        return;
+    }
+    if (f->map && !f->borrowed) {
+        munmap((void *)f->map, (size_t)f->size);
+    }
+    if (f->owns_fd) {
+        close(f->fd);
+    }
+    free(f);
+}
+
+void slice_unmap_range(slice_file *f, off_t start, off_t len) {
+    if (!f->map || f->borrowed || start >= f->size || len <= 0) {
+        return;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    off_t from = start - start % (page > 0 ? page : 4096);
+    off_t end = (len > f->size - start) ? f->size : start + len;
+    madvise((char *)f->map + from, (size_t)(end - from), MADV_DONTNEED);
+}
+
+off_t slice_size(const slice_file *f) {
+    return f->size;
+}
+
+// View of [first, end), which the caller has clipped to the file
+static int make_view(slice_file *f, off_t first, off_t end, slice_view *view) {
+    view->offset = first;
+    view->len = (size_t)(end - first);
+    view->owned = NULL;
+
+    if (view->len == 0) {
+        view->data = empty_view;
+        return SLICE_OK;
+    }
+    if (f->map) {
+        view->data = f->map + first;
+        return SLICE_OK;
+    }
+
+    char *buf = malloc(view->len);
+    if (!buf) {
+        return SLICE_ERR_NOMEM;
+    }
+    size_t got = 0;
+    while (got < view->len) {
+        ssize_t n = pread(f->fd, buf + got, view->len - got, first + (off_t)got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            int saved = errno;
+            free(buf);
+            errno = n == 0 ? EIO : saved;  // File shrank under us
+            return SLICE_ERR_IO;
+        }
+        got += (size_t)n;
+    }
+    view->data = buf;
+    view->owned = buf;
+    return SLICE_OK;
+}
+
+static off_t clip_end(const slice_file *f, off_t start, size_t size) {
+    return ((uintmax_t)size > (uintmax_t)(f->size - start)) ? f->size : start + (off_t)size;
+}
+
+int slice_range(slice_file *f, off_t start, size_t size, slice_view *view) {
+    if (start < 0) {
+        return SLICE_ERR_INVALID;
+    }
+    if (start >= f->size) {
+        return make_view(f, 0, 0, view);
+    }
+    return make_view(f, start, clip_end(f, start, size), view);
+}
+
+// First newline in [from, limit) or last one, for mapped or unmapped files
+static off_t find_newline(slice_file *f, off_t from, off_t limit, int forward) {
+    if (f->map) {
+        const char *base = f->map + from;
+        size_t len = (size_t)(limit - from);
+        const char *nl = forward ? memchr(base, '\n', len) : slice_memrchr(base, '\n', len);
+        return nl ? from + (off_t)(nl - base) + 1 : -1;
+    }
+
+    size_t buf_size = 64 * 1024;
+    char *buf = malloc(buf_size);
+    if (!buf) {
+        return -3;
+    }
+    off_t found = slice_find_newline(f->fd, from, limit, forward, buf, buf_size);
+    free(buf);
+    return found;
+}
+
+int slice_range_lines(slice_file *f, off_t start, size_t size, slice_view *view) {
+    if (start < 0) {
+        return SLICE_ERR_INVALID;
+    }
+    if (start >= f->size) {
+        return make_view(f, 0, 0, view);
+    }
+
+    off_t first = start;
+    off_t end = clip_end(f, start, size);
+
+    // Trim partial first line
+    if (start > 0) {
+        first = find_newline(f, start, end, 1);
+    }
+    // Trim partial last line
+    if (first >= 0) {
+        end = find_newline(f, first, end, 0);
+    }
+
+    if (first == -3 || end == -3) {
+        return SLICE_ERR_NOMEM;
+    }
+    if (first == -2 || end == -2) {
+        return SLICE_ERR_IO;
+    }
+    if (first < 0 || end < 0) {
+        return make_view(f, 0, 0, view);  // All content trimmed
+    }
+    return make_view(f, first, end, view);
+}
+
+void slice_release(slice_view *view) {
+    free(view->owned);
+    view->owned = NULL;
+    view->data = empty_view;
+    view->len = 0;
+}
+
+off_t slice_line_start(slice_file *f, off_t offset) {
+    if (offset <= 0) {
+        return 0;
+    }
+    if (offset >= f->size) {
+        return f->size;
+    }
+    off_t found = find_newline(f, offset - 1, f->size, 1);
+    if (found == -1) {
+        return f->size;
+    }
+    if (found == -3) {
+        return SLICE_ERR_NOMEM;
+    }
+    return found < 0 ? SLICE_ERR_IO : found;
+}
+
+off_t slice_line_start_before(slice_file *f, off_t offset) {
+    if (offset > f->size) {
+        offset = f->size;
+    }
+    if (offset <= 0) {
+        return 0;
+    }
+    off_t found = find_newline(f, 0, offset, 0);
+    if (found == -1) {
+        return 0;
+    }
+    if (found == -3) {
+        return SLICE_ERR_NOMEM;
+    }
+    return found < 0 ? SLICE_ERR_IO : found;
+}
+
+// Up to SLICE_PEEK_SIZE bytes at `at`: a pointer into the mapping, or read
+// into buf
+static int peek(slice_file *f, off_t at, char *buf, const char **text, size_t *len) {
+    size_t n = (f->size - at < SLICE_PEEK_SIZE) ? (size_t)(f->size - at) : SLICE_PEEK_SIZE;
+    if (f->map) {
+        *text = f->map + at;
+        *len = n;
+        return SLICE_OK;
+    }
+    ssize_t got;
+    do {
+        got = pread(f->fd, buf, n, at);
+    } while (got < 0 && errno == EINTR);
+    if (got < 0) {
+        return SLICE_ERR_IO;
+    }
+    *text = buf;
+    *len = (size_t)got;
+    return SLICE_OK;
+}
+
+int slice_bisect(slice_file *f, slice_line_test before, void *arg, off_t *out) {
+    char *buf = NULL;
+    if (!f->map && !(buf = malloc(SLICE_PEEK_SIZE))) {
+        return SLICE_ERR_NOMEM;
+    }
+
+    // Smallest byte offset whose next line start is not before the target.
+    // line_start() is monotonic, so this is an ordinary binary search; the
+    // answer is that offset's line start.
+    off_t lo = 0, hi = f->size;
+    int rc = SLICE_OK;
+    while (lo < hi) {
+        off_t mid = lo + (hi - lo) / 2;
+        off_t start = slice_line_start(f, mid);
+        if (start < 0) {
+            rc = (int)start;
+            break;
+        }
+
+        int is_before = 0;
+        if (start < f->size) {
+            const char *text;
+            size_t len;
+            if ((rc = peek(f, start, buf, &text, &len)) != SLICE_OK) {
+                break;
+            }
+            is_before = before(text, len, arg);
+        }
+        if (is_before) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (rc == SLICE_OK) {
+        off_t start = slice_line_start(f, lo);
+        if (start < 0) {
+            rc = (int)start;
+        } else {
+            *out = start;
+        }
+    }
+    free(buf);
+    return rc;
+}
+
+const char *slice_strerror(int code) {
+    switch (code) {
+    case SLICE_OK:              return "success";
+    case SLICE_ERR_INVALID:     return "invalid argument";
+    case SLICE_ERR_RANGE:       return "value out of range";
+    case SLICE_ERR_OPEN:        return "cannot open file";
+    case SLICE_ERR_NOT_REGULAR: return "not a regular file";
+    case SLICE_ERR_IO:          return "read error";
+    case SLICE_ERR_NOMEM:       return "out of memory";
+    default:                    return "unknown error";
+    }
+}
+
+int slice_parse_size(const char *arg, size_t *out) {
+    if (arg[0] == '-') {
+        return SLICE_ERR_INVALID;  // Negative numbers are not allowed
+    }
+
+    char *end;
+    errno = 0;
+    unsigned long long val = strtoull(arg, &end, 10);
+    if (errno == ERANGE) {
+        return SLICE_ERR_RANGE;
+    }
+    if (errno || end == arg || *end != '\0') {
+        return SLICE_ERR_INVALID;
+    }
+    if (val > SIZE_MAX) {
+        return SLICE_ERR_RANGE;
+    }
+
+    *out = (size_t)val;
+    return SLICE_OK;
+}
+
+size_t slice_chunk_size(size_t file_size, int trim_lines, FILE *log) {
+    // First, check if SLICE_CHUNK_SIZE environment variable is set
+    const char *env_chunk_size = getenv("SLICE_CHUNK_SIZE");
+    if (env_chunk_size != NULL) {
+        char *endptr;
+        errno = 0;
+        unsigned long val = strtoul(env_chunk_size, &endptr, 10);
+        if (errno == 0 && *endptr == '\0' && val > 0 && val <= SLICE_MAX_CHUNK_SIZE) {
+            if (log) {
+                fprintf(log, "[DEBUG] Using environment variable SLICE_CHUNK_SIZE: %lu bytes\n", val);
+            }
+            return (size_t)val;
+        }
+        // If invalid, log the error and fall back to default calculation
+        if (log) {
+            fprintf(log, "[DEBUG] Invalid SLICE_CHUNK_SIZE value: %s, using calculated size\n", env_chunk_size);
+        }
+    }
+
+    // Start with base chunk size
+    size_t chunk_size = SLICE_BASE_CHUNK_SIZE;
+
+    // For each power of 10 increase in file size, double the chunk size
+    // This gives a geometric progression
+    for (size_t threshold = 100 * 1024; // 100 KB threshold
+         threshold < file_size && chunk_size < SLICE_MAX_CHUNK_SIZE;
+         threshold *= 10) {
+        chunk_size *= 2;
+    }
+
+    // If --full-lines-only is specified, use a more conservative chunk size
+    // to better handle potentially long lines
+    if (trim_lines) {
+        // Double the chunk size as a safety margin for long lines
+        chunk_size *= 2;
+
+        if (log) {
+            fprintf(log, "[DEBUG] Applied safety factor for --full-lines-only\n");
+        }
+    }
+
+    // Ensure we don't exceed the maximum chunk size
+    if (chunk_size > SLICE_MAX_CHUNK_SIZE) {
+        chunk_size = SLICE_MAX_CHUNK_SIZE;
+    }
+
+    return chunk_size;
+}
+
+void *slice_memrchr(const void *s, int c, size_t n) {
+    const unsigned char *p = (const unsigned char *)s + n;
+    while (n--) {
+        if (*(--p) == (unsigned char)c)
+            return (void *)p;
+    }
+    return NULL;
+}
+
+off_t slice_find_newline(int fd, off_t from, off_t limit, int forward,
+                         char *buf, size_t buf_size) {
+    size_t window = SLICE_PROBE_SIZE < buf_size ? SLICE_PROBE_SIZE : buf_size;
+
+    while (from < limit) {
+        size_t len = (limit - from > (off_t)window) ? window : (size_t)(limit - from);
+        off_t lo = forward ? from : limit - (off_t)len;
+        ssize_t n = pread(fd, buf, len, lo);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -2;
+        }
+        if ((size_t)n < len && !forward) {
+            return -2;  // File shrank below the window
+        }
+        if (n == 0) {
+            return -1;  // File shrank
+        }
+        len = (size_t)n;
+
+        const char *nl = forward ? memchr(buf, '\n', len) : slice_memrchr(buf, '\n', len);
+        if (nl) {
+            return lo + (off_t)(nl - buf) + 1;
+        }
+        if (forward) {
+            from = lo + (off_t)len;
+        } else {
+            limit = lo;
+        }
+        if (window < buf_size) {
+            window = (window * 2 < buf_size) ? window * 2 : buf_size;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,119 @@
+#ifndef LIBSLICE_H
+#define LIBSLICE_H
+
+// libslice: the core of slice4 as an embeddable, reentrant C library.
+//
+// A slice_file is immutable once opened, so any number of threads may take
+// ranges from it concurrently. Ranges are returned as borrowed views into a
+// read-only mapping of the file (or into a buffer owned by the view when the
+// file cannot be mapped); nothing is written to stdout and no function
+// exits the process. Errors are reported as negative SLICE_ERR_* codes, with
+// errno preserved for SLICE_ERR_OPEN and SLICE_ERR_IO.
+//
+// A mapped view becomes invalid if the underlying file is truncated while
+// the view is in use.
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SLICE_BASE_CHUNK_SIZE 8192                 // Starting chunk size (8 KB)
+#define SLICE_MAX_CHUNK_SIZE (100 * 1024 * 1024)   // Max chunk size (100 MB)
+#define SLICE_PROBE_SIZE 4096                      // First boundary probe window
+#define SLICE_PEEK_SIZE 65536                      // Bytes shown to a slice_line_test
+
+// Return codes
+#define SLICE_OK 0
+#define SLICE_ERR_INVALID -1      // Malformed argument
+#define SLICE_ERR_RANGE -2        // Value out of range
+#define SLICE_ERR_OPEN -3         // open/stat failed (see errno)
+#define SLICE_ERR_NOT_REGULAR -4  // Not a regular file
+#define SLICE_ERR_IO -5           // read failed (see errno)
+#define SLICE_ERR_NOMEM -6        // Allocation failed
+
+typedef struct slice_file slice_file;
+
+// A borrowed range of a file. `data` stays valid until slice_release() is
+// called on the view or slice_close() on its file, whichever comes first.
+typedef struct {
+    const char *data;
+    size_t len;
+    off_t offset;   // File offset of data[0]
+    void *owned;    // Private: buffer freed by slice_release, NULL if mapped
+} slice_view;
+
+// Open a regular file for slicing
+int slice_open(const char *path, slice_file **out);
+
+// Wrap an already open regular file. The descriptor is not closed by
+// slice_close and must outlive the slice_file.
+int slice_open_fd(int fd, slice_file **out);
+
+// Wrap `len` bytes of memory: ranges are views into it. The memory is
+// neither copied nor freed and must outlive the slice_file.
+int slice_open_mem(const char *data, size_t len, slice_file **out);
+
+void slice_close(slice_file *f);
+
+off_t slice_size(const slice_file *f);
+
+// View of `size` bytes at `start`, clipped to the end of the file. A start
+// at or beyond the end gives an empty view.
+int slice_range(slice_file *f, off_t start, size_t size, slice_view *view);
+
+// Like slice_range, with the partial line at the start (when start > 0) and
+// the partial line at the end removed, as slice --full-lines-only does
+int slice_range_lines(slice_file *f, off_t start, size_t size, slice_view *view);
+
+void slice_release(slice_view *view);
+
+// Unmap the pages of [start, start + len) from this process. Views of them
+// stay valid (the pages fault back in when touched); until then the page
+// cache is free to evict them, which POSIX_FADV_DONTNEED cannot do to pages
+// that are still mapped.
+void slice_unmap_range(slice_file *f, off_t start, off_t len);
+
+// Offset of the first line that starts at or after `offset`: offset itself
+// when it is 0 or follows a newline, otherwise just past the next newline,
+// or the file size if there is none. Returns a negative SLICE_ERR_* code on
+// failure.
+off_t slice_line_start(slice_file *f, off_t offset);
+
+// Offset of the line start at or before `offset` (the start of the line
+// containing it). Returns a negative SLICE_ERR_* code on failure.
+off_t slice_line_start_before(slice_file *f, off_t offset);
+
+// Called with up to SLICE_PEEK_SIZE bytes of the file starting at a line
+// start (possibly several lines). Returns nonzero if that line sorts before
+// the target.
+typedef int (*slice_line_test)(const char *text, size_t len, void *arg);
+
+// Binary search over byte offsets for a file whose lines are sorted with
+// respect to `before`: stores in *out the first line start for which
+// before() returns 0, or the file size if it holds for every line. Each
+// probe resynchronises to the next line start, so about log2(size) small
+// reads are needed.
+int slice_bisect(slice_file *f, slice_line_test before, void *arg, off_t *out);
+
+const char *slice_strerror(int code);
+
+// Parse a non-negative decimal byte count
+int slice_parse_size(const char *arg, size_t *out);
+
+// Read chunk size for a file of file_size bytes: 8 KB, doubled for every
+// power of ten above 100 KB, doubled again when trimming lines, capped at
+// 100 MB. SLICE_CHUNK_SIZE in the environment overrides it. Decisions are
+// logged to `log` when it is not NULL.
+size_t slice_chunk_size(size_t file_size, int trim_lines, FILE *log);
+
+// Portable replacement for GNU memrchr
+void *slice_memrchr(const void *s, int c, size_t n);
+
+// Find the first newline in [from, limit) of fd (forward) or the last one
+// (backward) with pread probes that start at SLICE_PROBE_SIZE and double up
+// to buf_size. Returns the offset just past the newline, -1 if there is
+// none, or -2 on a read error.
+off_t slice_find_newline(int fd, off_t from, off_t limit, int forward,
+                         char *buf, size_t buf_size);
+
+#endif /* LIBSLICE_H */
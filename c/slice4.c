@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // splice(2), SEEK_DATA/SEEK_HOLE, memfd_create(2)
 #define _FILE_OFFSET_BITS 64
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,68 +9,149 @@
 #include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <strings.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/mman.h>  // memfd_create
+#endif
+
+#include "libslice.h"
+#include "slice_output.h"
+#include "slice_compress.h"
+#include "slice_query.h"
+#include "slice_match.h"
+#include "slice_fields.h"
+#include "slice_json.h"
+#include "slice_throttle.h"
+#include "slice_cache.h"
 
-#define BASE_CHUNK_SIZE 8192  // Starting chunk size (8 KB)
-#define MAX_CHUNK_SIZE (100 * 1024 * 1024)  // Max chunk size (100 MB)
 #define MAX_ALLOC_SIZE (1UL << 30)  // 1 GiB maximum allocation
 
+#define HTTP_HEAD_MAX 16384              // Largest response head accepted
+#define HTTP_PROBE_MAX (1024 * 1024)     // Probe windows stop growing here
+#define HTTP_PART_SIZE (8 * 1024 * 1024) // Size of one parallel ranged GET
+#define HTTP_DEFAULT_CONNECTIONS 4
+#define HTTP_TIMEOUT_SEC 30
+
+// One file of the logical input. With --files-from several segments are laid
+// end to end, and `base` is the offset of the segment's first byte in that
+// concatenated address space.
+typedef struct {
+    char *path;
+    off_t size;
+    off_t base;
+    int sparse;  // fewer blocks allocated than the size implies: has holes
+} Segment;
+
+// Shared source of zeros for holes that have to be written out as data
+static const char zero_page[64 * 1024];
+
+// A file is worth probing for holes only if it has fewer blocks allocated
+// than its size needs
+int is_sparse(const struct stat *st) {
+#ifdef SEEK_DATA
+    return (off_t)st->st_blocks * 512 < st->st_size;
+#else
+    (void)st;
+    return 0;
+#endif
+}
+
 // Calculate optimal chunk size based on file size
 size_t calculate_chunk_size(size_t file_size, int trim_lines, int debug) {
-    // First, check if SLICE_CHUNK_SIZE environment variable is set
-    const char *env_chunk_size = getenv("SLICE_CHUNK_SIZE");
-    if (env_chunk_size != NULL) {
-        char *endptr;
-        errno = 0;
-        unsigned long val = strtoul(env_chunk_size, &endptr, 10);
-        if (errno == 0 && *endptr == '\0' && val > 0 && val <= MAX_CHUNK_SIZE) {
-            if (debug) {
-                fprintf(stderr, "[DEBUG] Using environment variable SLICE_CHUNK_SIZE: %lu bytes\n", val);
-            }
-            return (size_t)val;
-        }
-        // If invalid, log the error and fall back to default calculation
-        if (debug) {
-            fprintf(stderr, "[DEBUG] Invalid SLICE_CHUNK_SIZE value: %s, using calculated size\n", env_chunk_size);
-        }
-    }
-    
-    // Start with base chunk size
-    size_t chunk_size = BASE_CHUNK_SIZE;
-    
-    // For each power of 10 increase in file size, double the chunk size
-    // This gives a geometric progression
-    for (size_t threshold = 100 * 1024; // 100 KB threshold
-         threshold < file_size && chunk_size < MAX_CHUNK_SIZE; 
-         threshold *= 10) {
-        chunk_size *= 2;
-    }
-    
-    // If --full-lines-only is specified, use a more conservative chunk size
-    // to better handle potentially long lines
-    if (trim_lines) {
-        // Double the chunk size as a safety margin for long lines
-        chunk_size *= 2;
-        
-        if (debug) {
-            fprintf(stderr, "[DEBUG] Applied safety factor for --full-lines-only\n");
-        }
-    }
-    
-    // Ensure we don't exceed the maximum chunk size
-    if (chunk_size > MAX_CHUNK_SIZE) {
-        chunk_size = MAX_CHUNK_SIZE;
-    }
-    
-    return chunk_size;
+    return slice_chunk_size(file_size, trim_lines, debug ? stderr : NULL);
 }
 
 void show_help() {
-    printf("Usage: slice4 --start <offset> --size <bytes> --file <filename> [--full-lines-only] [--debug]\n\n");
+    printf("Usage: slice4 --start <offset> --size <bytes> (--file <filename> | --files-from <list> | --url <url>)\n");
+    printf("              [--full-lines-only] [--break-at-files] [--output-memfd <socket>] [--debug]\n");
+    printf("       slice4 --file <filename> --chunk-size <bytes> [--overlap <bytes>] [--out-format <format>]\n");
+    printf("       slice4 --serve <socket> [--debug]\n\n");
     printf("Extract a slice of bytes from a file.\n\n");
     printf("Options:\n");
     printf("  --start <offset>        Byte offset to start reading (0-based)\n");
     printf("  --size <bytes>          Number of bytes to read\n");
-    printf("  --file <filename>       File to read from\n");
+    printf("  --file <filename>       File to read from; '-' reads standard input.\n");
+    printf("                          Pipes, FIFOs and character devices are streamed\n");
+    printf("  --files-from <list>     Read file names (one per line) from <list> and treat\n");
+    printf("                          the files as one concatenated input\n");
+    printf("  --url <url>             Read from an http:// object with Range requests\n");
+    printf("  --connections <n>       Parallel ranged GETs for large --url slices (default %d)\n",
+           HTTP_DEFAULT_CONNECTIONS);
+    printf("  --chunk-size <bytes>    Cut the slice (default: the whole file) into chunks\n");
+    printf("  --overlap <bytes>       Bytes each chunk shares with the previous one\n");
+    printf("  --out-format <format>   Chunk output: raw (default), tar (one entry per\n");
+    printf("                          chunk, source offsets in pax headers), pack,\n");
+    printf("                          arrow (Arrow IPC stream) or jsonl (one JSON object\n");
+    printf("                          per chunk)\n");
+    printf("  --pack-prefix <prefix>  With --out-format pack, append chunks to <prefix>.data\n");
+    printf("                          and their index to <prefix>.idx\n");
+    printf("  --since <time>          Instead of --start/--size, take the lines of a file\n");
+    printf("  --until <time>          sorted by leading timestamp from --since up to\n");
+    printf("                          (not including) --until, found by bisection\n");
+    printf("  --ts-format <format>    strptime(3) format of the timestamps\n");
+    printf("                          (default %s)\n", QUERY_DEFAULT_TS_FORMAT);
+    printf("  --key-prefix <str>      Instead of --start/--size, take the lines of a file\n");
+    printf("                          sorted by key (LC_ALL=C) whose key starts with <str>\n");
+    printf("  --key-field <n>         Field holding the key, from 1 (default 0: whole line)\n");
+    printf("  --record-format <fmt>   lines (default), csv or jsonl: with csv, newlines inside\n");
+    printf("                          quoted fields do not end a line for --full-lines-only,\n");
+    printf("                          --match, --fields and chunks; --field-sep defaults to ,\n");
+    printf("                          With jsonl, records are whole JSON values, which may\n");
+    printf("                          span lines\n");
+    printf("  --validate              With --record-format jsonl, report the byte ranges of\n");
+    printf("                          structurally broken records on stderr\n");
+    printf("  --record-start <regex>  Lines matching <regex> (POSIX extended, anchored at the\n");
+    printf("                          start of the line) begin a record, other lines\n");
+    printf("                          continue it: --full-lines-only, --match and chunks\n");
+    printf("                          never split a record. Quote metacharacters: [ERROR]\n");
+    printf("                          is a bracket expression, use --record-start-prefix\n");
+    printf("  --record-start-prefix <text>\n");
+    printf("                          Like --record-start, for lines starting with <text>\n");
+    printf("                          taken literally, e.g. '[ERROR]'\n");
+    printf("  --fields <list>         Print only these fields of each line, e.g. 1,4,7 or\n");
+    printf("                          2-5; quoted fields (RFC 4180) may hold separators\n");
+    printf("  --field-sep <c>         Field separator for --key-field and --fields\n");
+    printf("                          (default \\t)\n");
+    printf("  --sample-lines <k>      Print k random distinct lines (of the whole file or\n");
+    printf("                          --start/--size range) in file order, reading only those\n");
+    printf("  --seed <n>              Seed for --sample-lines (default: time and pid)\n");
+    printf("  --sample-uniform        Correct --sample-lines' bias towards long lines\n");
+    printf("  --split <n>             Write the file (or --start/--size range) to n files\n");
+    printf("                          of about equal size cut at line ends, in parallel\n");
+    printf("  --out-prefix <prefix>   Names of the --split parts: <prefix>00, <prefix>01, ...\n");
+    printf("  --shard <i>/<n>         Take only the i-th (from 0) of n line-aligned parts of\n");
+    printf("                          the file or range query; every line is in one shard\n");
+    printf("  --match <string>        Print only the lines of the slice containing <string>\n");
+    printf("  --match-any <file>      Print only the lines containing any of the strings in\n");
+    printf("                          <file> (one per line)\n");
+    printf("  --framing binary        Precede each chunk with a fixed binary header (id,\n");
+    printf("                          source offset, length, flags) instead of nothing\n");
+    printf("  --compress <method>     Compress the output with gzip or zstd in parallel\n");
+    printf("                          blocks (zstd output is seekable)\n");
+    printf("  --compress-threads <n>  Compression threads (default: one per CPU)\n");
+    printf("  --max-bandwidth <MB/s>  Read at most this many MB (2^20 bytes) per second\n");
+    printf("  --max-iops <n>          Issue at most n reads per second\n");
+    printf("  --idle-io               Use the idle I/O scheduling class (Linux only)\n");
+    printf("  --cache-policy <policy> Page cache use: default, sequential (read ahead),\n");
+    printf("                          noreuse (evict what the slice brought in) or\n");
+    printf("                          drop-after (evict the whole range when done)\n");
+    printf("  --cache-report          Print how much of the range was in the page cache\n");
+    printf("                          before reading (on stderr)\n");
+    printf("  --output-memfd <socket> Write the slice into a sealed memfd and pass it to\n");
+    printf("                          the process listening on <socket> (Linux only)\n");
+    printf("  --serve <socket>        Run as a daemon answering slice requests on a\n");
+    printf("                          Unix domain socket (see README)\n");
+    printf("  --break-at-files        With --files-from, end the slice at the end of the\n");
+    printf("                          file containing --start; when chunking, end a chunk\n");
+    printf("                          at every file boundary\n");
     printf("  --full-lines-only       Remove truncated lines at start/end of slice\n");
     printf("  --debug                 Print internal debug info\n");
     printf("  --help                  Show this help message\n");
@@ -78,231 +160,3331 @@ void show_help() {
     printf("                          (can be set by 'linex' tool based on corpus analysis)\n");
 }
 
-// Portable replacement for GNU memrchr
-void *memrchr_portable(const void *s, int c, size_t n) {
-    const unsigned char *p = (const unsigned char *)s + n;
-    while (n--) {
-        if (*(--p) == (unsigned char)c)
-            return (void *)p;
+size_t parse_size(const char *arg, const char *name) {
+    size_t val;
+    int rc = slice_parse_size(arg, &val);
+    if (rc == SLICE_OK) {
+        return val;
     }
-    return NULL;
-}
 
-size_t parse_size(const char *arg, const char *name) {
     if (arg[0] == '-') {
         fprintf(stderr, "Invalid value for %s: negative number not allowed: %s\n", name, arg);
-        exit(1);
-    }
-
-    char *end;
-    errno = 0;
-    unsigned long val = strtoul(arg, &end, 10);
-    if (errno || *end != '\0') {
+    } else if (rc == SLICE_ERR_RANGE) {
+        fprintf(stderr, "Invalid value for %s: exceeds system size limit\n", name);
+    } else {
         fprintf(stderr, "Invalid value for %s: %s\n", name, arg);
-        exit(1);
     }
+    exit(1);
+}
 
-    if (val > SIZE_MAX) {
-        fprintf(stderr, "Invalid value for %s: exceeds system size limit\n", name);
-        exit(1);
+// Write all of buf to fd, retrying after short writes to pipes and sockets
+int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
     }
+    return 0;
+}
+
+// Streaming line trimmer behind every write to stdout. Without
+// --full-lines-only it is a plain pass-through. With it, data is released as
+// soon as a newline proves it complete and only the bytes after the most
+// recent newline are held back, so memory is bounded by the longest line
+// rather than by the size of the slice. With --match or --fields the same
+// line buffering applies, and complete lines are filtered and projected
+// before they are released.
+typedef enum {
+    RECORDS_LINES,
+    RECORDS_CSV,   // newlines inside quoted fields do not end a record
+    RECORDS_JSONL, // a record is a whole JSON value, see slice_json.h
+    RECORDS_MULTILINE // --record-start: a record is a start line and its continuations
+} RecordFormat;
 
-    return (size_t)val;
+// How chunking mode finds the records it trims to
+typedef struct {
+    RecordFormat format;
+    char csv_sep;               // csv: field separator
+    const RecordStart *starts;  // multiline: the lines that begin a record
+    int validate;               // jsonl: report broken records (--validate)
+} RecordSpec;
+
+// Page cache handling for chunking mode (--cache-policy, --cache-report)
+typedef struct {
+    CachePolicy policy;
+    int report;
+} CacheSpec;
+
+// --cache-report: residency of the range before it was read, which tells a
+// slow cold read (few pages resident) from slow processing (most resident)
+static void print_cache_report(size_t resident, size_t pages, size_t bytes) {
+    fprintf(stderr, "Cache: %zu of %zu pages (%.1f%%) resident before reading %.1f MB\n",
+            resident, pages, pages ? 100.0 * (double)resident / (double)pages : 0.0,
+            (double)bytes / (1024.0 * 1024.0));
 }
 
-int main(int argc, char *argv[]) {
-    size_t start = (size_t)-1, size = 0;
-    const char *filename = NULL;
-    int debug = 0, trim_lines = 0;
-    int fd = -1;
-    char *buffer = NULL;
-    char *line_buffer = NULL;  // For line trimming
-    int exit_code = 0;
+typedef struct {
+    int trim_lines;
+    int skip_first;      // still discarding the partial first line
+    char *pending;       // bytes after the last newline seen so far
+    size_t pending_len;
+    size_t pending_cap;
+    size_t pending_zeros; // hole bytes that follow `pending`, not yet materialised
+    size_t written;      // bytes emitted to stdout
+    int sparse_output;   // -1 unknown, 1 if holes can be seeked over in stdout
+    int hole_at_end;     // output ends in a seeked-over hole, see trimmer_finish
+    int zero_copy;       // -1 unknown, 0 off, 1 copy_file_range, 2 sendfile
+    const LineMatcher *match; // --match: drop lines without a pattern
+    const FieldList *fields;  // --fields: keep only these columns
+    char *projected;          // projected lines, before they are written
+    size_t projected_cap;
+    int csv;                  // --record-format csv: lines are CSV records
+    char csv_sep;
+    int quoted;               // csv: inside a quoted field after the data fed so far
+    int resync;               // csv: quote state at the start still unknown
+    int jsonl;                // --record-format jsonl: records are JSON values
+    JsonlScan json;           // jsonl: structural state after the data fed so far
+    const RecordStart *starts;// --record-start: lines that begin a record
+    size_t scanned;           // starts: held bytes already searched for record ends
+    size_t *ends;             // starts: record ends in the held bytes, for --match
+    size_t ends_len;
+    size_t ends_cap;
+} LineTrimmer;
 
-    for (int i = 1; i < argc; i++) {
-        if (!strcmp(argv[i], "--start") && i + 1 < argc) {
-            start = parse_size(argv[++i], "--start");
-        } else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
-            size = parse_size(argv[++i], "--size");
-        } else if (!strcmp(argv[i], "--file") && i + 1 < argc) {
-            filename = argv[++i];
-        } else if (!strcmp(argv[i], "--debug")) {
-            debug = 1;
-        } else if (!strcmp(argv[i], "--full-lines-only")) {
-            trim_lines = 1;
-        } else if (!strcmp(argv[i], "--help")) {
-            show_help();
-            return 0;
-        } else {
-            fprintf(stderr, "Unknown or incomplete option: %s\n", argv[i]);
-            show_help();
-            return 1;
+// Whole lines are needed to filter or project, and to validate records
+#define trimmer_by_line(t) ((t)->trim_lines || (t)->match || (t)->fields || (t)->json.report || \
+                            (t)->starts)
+
+void trimmer_init(LineTrimmer *t, int trim_lines, int skip_first) {
+    memset(t, 0, sizeof(*t));
+    t->trim_lines = trim_lines;
+    t->skip_first = trim_lines && skip_first;
+    t->sparse_output = -1;
+    t->zero_copy = -1;
+}
+
+int trimmer_emit(LineTrimmer *t, const char *data, size_t len) {
+    if (len > 0 && write_all(STDOUT_FILENO, data, len) != 0) {
+        perror("write");
+        return -1;
+    }
+    t->written += len;
+    if (len > 0) {
+        t->hole_at_end = 0;
+    }
+    return 0;
+}
+
+// Write a run of zeros. When stdout is a regular file positioned at its end
+// the run becomes a hole in the output (lseek past it now, ftruncate at the
+// end); otherwise it is written from the shared zero page.
+int trimmer_emit_zeros(LineTrimmer *t, size_t len) {
+    if (t->sparse_output < 0) {
+        struct stat st;
+        int flags = fcntl(STDOUT_FILENO, F_GETFL);
+        off_t pos = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+        t->sparse_output = fstat(STDOUT_FILENO, &st) == 0 && S_ISREG(st.st_mode) &&
+                           flags >= 0 && !(flags & O_APPEND) && pos >= st.st_size;
+    }
+
+    if (t->sparse_output) {
+        if (lseek(STDOUT_FILENO, (off_t)len, SEEK_CUR) < 0) {
+            perror("lseek on output");
+            return -1;
         }
+        t->written += len;
+        t->hole_at_end = len > 0;
+        return 0;
     }
 
-    if (start == (size_t)-1 || size == 0 || filename == NULL) {
-        fprintf(stderr, "Error: --start, --size, and --file are required.\n");
-        show_help();
-        return 1;
+    while (len > 0) {
+        size_t n = len < sizeof(zero_page) ? len : sizeof(zero_page);
+        if (trimmer_emit(t, zero_page, n) != 0) {
+            return -1;
+        }
+        len -= n;
     }
+    return 0;
+}
 
-    if (SIZE_MAX - start < size) {
-        fprintf(stderr, "Error: start + size causes overflow\n");
-        return 1;
+// Copy up to len bytes from the current position of in_fd to stdout without
+// passing them through user space: copy_file_range(2) when the kernel can do
+// it for this pair of files (reflinks on btrfs/XFS), sendfile(2) otherwise.
+// Only used for untrimmed data going to a regular file or memfd. Returns the
+// number of bytes copied, 0 when the caller should fall back to read/write,
+// or -1 on error.
+ssize_t trimmer_emit_fd(LineTrimmer *t, int in_fd, size_t len) {
+#ifdef __linux__
+    if (t->zero_copy < 0) {
+        struct stat st;
+        int flags = fcntl(STDOUT_FILENO, F_GETFL);
+        t->zero_copy = !trimmer_by_line(t) && fstat(STDOUT_FILENO, &st) == 0 &&
+                       S_ISREG(st.st_mode) && flags >= 0 && !(flags & O_APPEND);
     }
 
-    // Open file using low-level I/O for better performance
-    fd = open(filename, O_RDONLY);
-    if (fd < 0) {
-        fprintf(stderr, "Error: cannot open file '%s': %s\n", filename, strerror(errno));
-        return 1;
+    while (t->zero_copy > 0) {
+        ssize_t n = t->zero_copy == 1
+                  ? copy_file_range(in_fd, NULL, STDOUT_FILENO, NULL, len, 0)
+                  : sendfile(STDOUT_FILENO, in_fd, NULL, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                      errno == EOPNOTSUPP || errno == EBADF)) {
+            t->zero_copy = t->zero_copy == 1 ? 2 : 0;  // Not for this pair of files
+            continue;
+        }
+        if (n < 0) {
+            perror("copy to output");
+            return -1;
+        }
+        t->written += (size_t)n;
+        if (n > 0) {
+            t->hole_at_end = 0;
+        }
+        return n;
     }
+#else
+    (void)t; (void)in_fd; (void)len;
+#endif
+    return 0;
+}
 
-    struct stat st;
-    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
-        fprintf(stderr, "Error: not a regular file: %s\n", filename);
-        exit_code = 1;
-        goto cleanup;
+int trimmer_hold(LineTrimmer *t, const char *data, size_t len) {
+    if (len == 0 && t->pending_zeros == 0) {
+        return 0;
     }
 
-    off_t file_size = st.st_size;
-    
-    if (start >= (size_t)file_size) {
-        if (debug) {
-            fprintf(stderr, "[DEBUG] Start position %zu is beyond file size %lld\n", 
-                    start, (long long)file_size);
+    // Data following a hole on the same line: the hole has to become real
+    // bytes in the pending line
+    size_t zeros = t->pending_zeros;
+    if (t->pending_len + zeros + len > t->pending_cap) {
+        size_t new_cap = t->pending_cap ? t->pending_cap : SLICE_BASE_CHUNK_SIZE;
+        while (new_cap < t->pending_len + zeros + len) {
+            new_cap *= 2;
+        }
+        if (new_cap > MAX_ALLOC_SIZE) {
+            fprintf(stderr, "Error: line longer than %lu bytes, cannot trim\n", MAX_ALLOC_SIZE);
+            return -1;
+        }
+        char *grown = realloc(t->pending, new_cap);
+        if (!grown) {
+            perror("realloc for line buffer");
+            return -1;
         }
-        goto cleanup;  // Nothing to read
+        t->pending = grown;
+        t->pending_cap = new_cap;
     }
+    memset(t->pending + t->pending_len, 0, zeros);
+    memcpy(t->pending + t->pending_len + zeros, data, len);
+    t->pending_len += zeros + len;
+    t->pending_zeros = 0;
+    return 0;
+}
 
-    size_t to_read = (start + size > (size_t)file_size) ? (size_t)file_size - start : size;
+// Emit whole lines, keeping only the --fields columns
+int trimmer_emit_projected(LineTrimmer *t, const char *data, size_t len) {
+    if (!t->fields || len == 0) {
+        return trimmer_emit(t, data, len);
+    }
+    if (len > t->projected_cap) {
+        char *grown = realloc(t->projected, len);
+        if (!grown) {
+            perror("realloc for projected lines");
+            return -1;
+        }
+        t->projected = grown;
+        t->projected_cap = len;
+    }
+    return trimmer_emit(t, t->projected, fields_project(t->fields, data, len, t->projected));
+}
 
-    if (to_read == 0) {
-        fprintf(stderr, "Error: nothing to read\n");
-        goto cleanup;
+// Emit the lines of data[0..len), which ends at a line end or at the end of
+// the input, that contain a --match pattern. Matches are searched for
+// across the whole buffer rather than line by line, and adjacent matching
+// lines go out in one write.
+int trimmer_emit_lines(LineTrimmer *t, const char *data, size_t len) {
+    if (!t->match) {
+        return trimmer_emit_projected(t, data, len);
+    }
+    const char *end = data + len, *p = data;
+    const char *run = data, *run_end = data;
+    const char *hit;
+    while (p < end && (hit = matcher_find(t->match, p, (size_t)(end - p))) != NULL) {
+        const char *line, *line_end;
+        if (t->csv) {
+            // p starts a record; the quote state at the hit follows from it
+            int quoted = 0;
+            size_t first, last;
+            csv_scan(p, (size_t)(hit - p), &quoted, &first, &last);
+            line = last == SIZE_MAX ? p : p + last;
+            csv_scan(hit, (size_t)(end - hit), &quoted, &first, NULL);
+            line_end = first == SIZE_MAX ? end : hit + first;
+        } else {
+            line = slice_memrchr(p, '\n', (size_t)(hit - p));
+            line_end = memchr(hit, '\n', (size_t)(end - hit));
+            line = line ? line + 1 : p;
+            line_end = line_end ? line_end + 1 : end;
+        }
+        if (line != run_end) {
+            if (trimmer_emit_projected(t, run, (size_t)(run_end - run)) != 0) {
+                return -1;
+            }
+            run = line;
+        }
+        run_end = line_end;
+        p = line_end;
     }
+    return trimmer_emit_projected(t, run, (size_t)(run_end - run));
+}
 
-    // Calculate optimal chunk size based on file size
-    size_t chunk_size = calculate_chunk_size((size_t)file_size, trim_lines, debug);
-    
-    if (debug) {
-        fprintf(stderr, "[DEBUG] File size: %lld bytes\n", (long long)file_size);
-        fprintf(stderr, "[DEBUG] Calculated chunk size: %zu bytes\n", chunk_size);
-        fprintf(stderr, "[DEBUG] Requested start: %zu\n", start);
-        fprintf(stderr, "[DEBUG] Requested size: %zu\n", size);
-        fprintf(stderr, "[DEBUG] Actual bytes to read: %zu\n", to_read);
+// --record-format jsonl counterpart of trimmer_emit_lines. The record ends
+// in data[0..len) are the `count` offsets in ends that fall inside it, each
+// `base` bytes too large (they were found in the data before it was cut).
+int trimmer_emit_records(LineTrimmer *t, const char *data, size_t len,
+                         const size_t *ends, size_t count, size_t base) {
+    if (!t->match) {
+        return trimmer_emit(t, data, len);
+    }
+    const char *end = data + len, *p = data;
+    const char *run = data, *run_end = data;
+    const char *hit;
+    size_t k = 0;
+    while (p < end && (hit = matcher_find(t->match, p, (size_t)(end - p))) != NULL) {
+        size_t at = (size_t)(hit - data) + base;
+        while (k < count && ends[k] <= at) {
+            k++;
+        }
+        const char *record = k > 0 && ends[k - 1] > base ? data + (ends[k - 1] - base) : data;
+        const char *record_end = k < count && ends[k] - base < len ? data + (ends[k] - base) : end;
+        if (record != run_end) {
+            if (trimmer_emit(t, run, (size_t)(run_end - run)) != 0) {
+                return -1;
+            }
+            run = record;
+        }
+        run_end = record_end;
+        p = record_end;
     }
+    return trimmer_emit(t, run, (size_t)(run_end - run));
+}
 
-    // Seek to the start position
-    if (lseek(fd, (off_t)start, SEEK_SET) != (off_t)start) {
-        perror("lseek");
-        exit_code = 1;
-        goto cleanup;
+// --record-start: whether a newline ends a record depends on the line after
+// it, which may only arrive with a later read. Data is therefore appended to
+// the held bytes, and the records known to be complete are released from
+// there. Only bytes before `limit` are released; with `final` set the rest
+// were read past the end of the slice, to decide its last record.
+int trimmer_release_records(LineTrimmer *t, size_t limit, int final) {
+    const char *buf = t->pending;
+    size_t n = t->pending_len, from = t->scanned, done = 0, last = 0, end;
+    t->ends_len = 0;
+    while ((end = record_start_next(t->starts, buf, n, from, final, &from)) != SIZE_MAX &&
+           end <= limit) {
+        if (t->skip_first) {
+            done = last = end;  // Trim the partial first record
+            t->skip_first = 0;
+            continue;
+        }
+        if (t->match) {
+            if (t->ends_len == t->ends_cap) {
+                size_t cap = t->ends_cap ? t->ends_cap * 2 : 1024;
+                size_t *grown = realloc(t->ends, cap * sizeof(size_t));
+                if (!grown) {
+                    perror("realloc for record ends");
+                    return -1;
+                }
+                t->ends = grown;
+                t->ends_cap = cap;
+            }
+            t->ends[t->ends_len++] = end;
+        }
+        last = end;
+    }
+    if (final && !t->trim_lines && limit > last) {
+        last = limit;  // The partial last record goes out too
     }
 
-    // Allocate buffer for chunks
-    buffer = malloc(chunk_size);
-    if (!buffer) {
-        perror("malloc for buffer");
-        exit_code = 1;
-        goto cleanup;
+    if (last > done &&
+        trimmer_emit_records(t, buf + done, last - done, t->ends, t->ends_len, done) != 0) {
+        return -1;
     }
+    memmove(t->pending, buf + last, n - last);
+    t->pending_len = n - last;
+    t->scanned = from > last ? from - last : 0;
+    return 0;
+}
 
-    if (trim_lines) {
-        // For line trimming, we need to keep track of all data
-        line_buffer = malloc(to_read);
-        if (!line_buffer) {
-            perror("malloc for line buffer");
-            exit_code = 1;
-            goto cleanup;
+int trimmer_feed(LineTrimmer *t, const char *data, size_t len) {
+    if (!trimmer_by_line(t)) {
+        return trimmer_emit(t, data, len);
+    }
+    if (t->starts) {
+        if (trimmer_hold(t, data, len) != 0) {
+            return -1;
         }
+        return trimmer_release_records(t, SIZE_MAX, 0);
     }
 
-    // Read data in chunks
-    size_t total_read = 0;
-    while (total_read < to_read) {
-        size_t current_chunk = (to_read - total_read < chunk_size) ? (to_read - total_read) : chunk_size;
-        
-        ssize_t bytes_read = read(fd, buffer, current_chunk);
-        if (bytes_read <= 0) {
-            if (bytes_read < 0) {
-                perror("read");
-                exit_code = 1;
-            }
-            break;  // EOF or error
+    // Offsets just past the first and the last line end in data
+    size_t first, last, shift = 0;
+    if (t->jsonl) {
+        // Record ends are the newlines between complete values
+        t->json.collect = t->match != NULL;
+        if (jsonl_scan(&t->json, data, len, &first, &last) != 0) {
+            perror("realloc for record ends");
+            return -1;
         }
+    } else if (t->csv) {
+        // Record ends are the newlines outside quoted fields
+        if (t->resync) {
+            t->quoted = csv_resync(data, len, t->csv_sep);
+            t->resync = 0;
+        }
+        csv_scan(data, len, &t->quoted, &first, &last);
+    } else {
+        const char *first_nl = memchr(data, '\n', len);
+        const char *last_nl = first_nl ? slice_memrchr(data, '\n', len) : NULL;
+        first = first_nl ? (size_t)(first_nl + 1 - data) : SIZE_MAX;
+        last = last_nl ? (size_t)(last_nl + 1 - data) : SIZE_MAX;
+    }
 
-        if (trim_lines) {
-            // Store data for line trimming later
-            memcpy(line_buffer + total_read, buffer, bytes_read);
-        } else {
-            // Direct output when no line trimming needed
-            if (write(STDOUT_FILENO, buffer, bytes_read) != bytes_read) {
-                perror("write");
-                exit_code = 1;
-                goto cleanup;
+    // Trim partial first line
+    if (t->skip_first) {
+        if (first == SIZE_MAX) {
+            return 0;
+        }
+        data += first;
+        len -= first;
+        shift = first;
+        last = last == first ? SIZE_MAX : last - first;
+        t->skip_first = 0;
+    }
+
+    // Everything up to the last newline is complete; the rest may still be
+    // a partial last line
+    if (last == SIZE_MAX) {
+        return trimmer_hold(t, data, len);
+    }
+
+    size_t complete = last;
+    if (t->match || t->fields) {
+        // Complete the held line, then filter it and the lines after it.
+        // Data is only held once the first line has been skipped, so
+        // `first` is still the end of data's first line here.
+        if (t->pending_len > 0 || t->pending_zeros > 0) {
+            size_t head = first;
+            if (trimmer_hold(t, data, head) != 0) {
+                return -1;
             }
+            if (t->jsonl ? trimmer_emit_records(t, t->pending, t->pending_len, NULL, 0, 0)
+                         : trimmer_emit_lines(t, t->pending, t->pending_len)) {
+                return -1;
+            }
+            data += head;
+            len -= head;
+            complete -= head;
+            shift += head;
+        }
+        if (t->jsonl ? trimmer_emit_records(t, data, complete, t->json.ends, t->json.ends_len, shift)
+                     : trimmer_emit_lines(t, data, complete)) {
+            return -1;
         }
+    } else if (trimmer_emit(t, t->pending, t->pending_len) != 0 ||
+               trimmer_emit_zeros(t, t->pending_zeros) != 0 ||
+               trimmer_emit(t, data, complete) != 0) {
+        return -1;
+    }
+    t->pending_len = 0;
+    t->pending_zeros = 0;
+    return trimmer_hold(t, data + complete, len - complete);
+}
 
-        total_read += bytes_read;
+// Feed a hole of `len` zero bytes without materialising it. A hole holds no
+// newline, so while trimming it only ever extends the current line.
+int trimmer_feed_zeros(LineTrimmer *t, size_t len) {
+    if (!trimmer_by_line(t)) {
+        return trimmer_emit_zeros(t, len);
+    }
+    t->json.offset += len;
+    if (!t->skip_first || t->starts) {
+        t->pending_zeros += len;
     }
+    return 0;
+}
 
-    if (debug) {
-        fprintf(stderr, "[DEBUG] Total bytes read: %zu\n", total_read);
+// --record-start: release the last records of the slice, deciding where it
+// ends with up to RECORD_START_PEEK bytes read past it (`after`, fewer at
+// the end of the input)
+int trimmer_finish_records(LineTrimmer *t, const char *after, size_t after_len) {
+    if (!t->starts) {
+        return 0;
+    }
+    size_t limit = t->pending_len + t->pending_zeros;
+    if (trimmer_hold(t, after, after_len) != 0 || trimmer_release_records(t, limit, 1) != 0) {
+        return -1;
     }
+    t->pending_len = 0;
+    return 0;
+}
 
-    // Process line trimming if requested
-    if (trim_lines && total_read > 0) {
-        char *out_buf = line_buffer;
-        size_t out_len = total_read;
+// Filter and project the last line when it has no newline (without
+// --full-lines-only), then give a trailing hole in a file output its length
+int trimmer_finish(LineTrimmer *t) {
+    if (trimmer_by_line(t) && !t->trim_lines && t->pending_len + t->pending_zeros > 0) {
+        if (trimmer_hold(t, "", 0) != 0) {
+            return -1;
+        }
+        if (t->jsonl ? trimmer_emit_records(t, t->pending, t->pending_len, NULL, 0, 0)
+                     : trimmer_emit_lines(t, t->pending, t->pending_len)) {
+            return -1;
+        }
+        t->pending_len = 0;
+    }
+    if (t->hole_at_end) {
+        off_t end = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+        if (end < 0 || ftruncate(STDOUT_FILENO, end) != 0) {
+            perror("ftruncate on output");
+            return -1;
+        }
+        t->hole_at_end = 0;
+    }
+    return 0;
+}
 
-        // Trim partial first line
-        if (start > 0) {
-            char *first_nl = memchr(line_buffer, '\n', total_read);
-            if (first_nl) {
-                size_t offset = (first_nl - line_buffer) + 1;
-                if (offset <= total_read) {
-                    out_buf = line_buffer + offset;
-                    out_len = total_read - offset;
-                } else {
-                    out_len = 0;
+void trimmer_free(LineTrimmer *t) {
+    free(t->pending);
+    t->pending = NULL;
+    free(t->projected);
+    t->projected = NULL;
+    jsonl_scan_free(&t->json);
+    free(t->ends);
+    t->ends = NULL;
+}
+
+// Discard the first `count` bytes of a non-seekable input. On Linux a pipe is
+// drained into /dev/null with splice(2) so the skipped data never reaches
+// user space; anything else is read into the reused chunk buffer and dropped.
+// Returns the number of bytes skipped (less than count at EOF), or -1.
+off_t skip_stream(int fd, size_t count, char *buffer, size_t buffer_size, int debug) {
+    size_t skipped = 0;
+
+#ifdef __linux__
+    struct stat st;
+    if (count > 0 && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        int devnull = open("/dev/null", O_WRONLY);
+        while (devnull >= 0 && skipped < count) {
+            ssize_t n = splice(fd, NULL, devnull, NULL, count - skipped, SPLICE_F_MOVE);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                if (n == 0) {
+                    close(devnull);
+                    return (off_t)skipped;  // EOF before start
                 }
-            } else {
-                out_len = 0;
+                break;  // Not spliceable, fall back to reading
             }
+            skipped += (size_t)n;
+        }
+        if (devnull >= 0) {
+            close(devnull);
+        }
+        if (debug && skipped > 0) {
+            fprintf(stderr, "[DEBUG] Skipped %zu bytes with splice\n", skipped);
         }
+    }
+#endif
 
-        // Trim partial last line
-        if (out_len > 0 && out_buf[out_len - 1] != '\n') {
-            char *last_nl = memrchr_portable(out_buf, '\n', out_len);
-            if (last_nl && last_nl >= out_buf) {
-                out_len = last_nl - out_buf + 1;
-            } else {
-                out_len = 0;
+    while (skipped < count) {
+        size_t want = (count - skipped < buffer_size) ? count - skipped : buffer_size;
+        ssize_t n = read(fd, buffer, want);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            perror("read");
+            return -1;
+        }
+        if (n == 0) {
+            break;  // EOF before start
         }
+        skipped += (size_t)n;
+    }
 
-        if (debug) {
-            fprintf(stderr, "[DEBUG] After trimming: output length = %zu\n", out_len);
-            if (out_len == 0 && total_read > 0) {
-                fprintf(stderr, "[DEBUG] Warning: All content was trimmed due to --full-lines-only\n");
-                fprintf(stderr, "[DEBUG] Hint: Try using 'linex' tool to analyze line structure\n");
+    return (off_t)skipped;
+}
+
+// Read the file names listed in list_path (one per line, blank lines ignored)
+// and lay them out as consecutive segments. Returns 0 on success.
+int load_file_list(const char *list_path, Segment **out, size_t *out_count) {
+    FILE *list = fopen(list_path, "r");
+    if (!list) {
+        fprintf(stderr, "Error: cannot open file list '%s': %s\n", list_path, strerror(errno));
+        return 1;
+    }
+
+    Segment *segs = NULL;
+    size_t count = 0, capacity = 0;
+    off_t base = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    int rc = 0;
+
+    while ((len = getline(&line, &line_cap, list)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0) {
+            continue;
+        }
+
+        struct stat st;
+        if (stat(line, &st) != 0) {
+            fprintf(stderr, "Error: cannot stat file '%s': %s\n", line, strerror(errno));
+            rc = 1;
+            break;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            fprintf(stderr, "Error: not a regular file: %s\n", line);
+            rc = 1;
+            break;
+        }
+
+        if (count == capacity) {
+            size_t new_capacity = capacity ? capacity * 2 : 16;
+            Segment *grown = realloc(segs, new_capacity * sizeof(Segment));
+            if (!grown) {
+                perror("realloc for file list");
+                rc = 1;
+                break;
             }
+            segs = grown;
+            capacity = new_capacity;
         }
 
-        // Write the trimmed output
-        if (out_len > 0) {
-            if (write(STDOUT_FILENO, out_buf, out_len) != (ssize_t)out_len) {
-                perror("write");
-                exit_code = 1;
-                goto cleanup;
+        segs[count].path = strdup(line);
+        if (!segs[count].path) {
+            perror("strdup");
+            rc = 1;
+            break;
+        }
+        segs[count].size = st.st_size;
+        segs[count].base = base;
+        segs[count].sparse = is_sparse(&st);
+        base += st.st_size;
+        count++;
+    }
+
+    if (rc == 0 && ferror(list)) {
+        fprintf(stderr, "Error: cannot read file list '%s'\n", list_path);
+        rc = 1;
+    }
+    if (rc == 0 && count == 0) {
+        fprintf(stderr, "Error: file list '%s' is empty\n", list_path);
+        rc = 1;
+    }
+
+    free(line);
+    fclose(list);
+
+    if (rc != 0) {
+        for (size_t i = 0; i < count; i++) {
+            free(segs[i].path);
+        }
+        free(segs);
+        return rc;
+    }
+
+    *out = segs;
+    *out_count = count;
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// HTTP Range backend (--url). Plain http:// only: each request is a GET with
+// a single "Range: bytes=first-last" on its own connection.
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    char *host;
+    char *port;
+    char *path;  // includes the query string
+} HttpUrl;
+
+typedef struct {
+    int fd;
+    int status;
+    off_t total;           // object size from Content-Range, -1 if unknown
+    off_t content_length;  // -1 if unknown
+    char head[HTTP_HEAD_MAX];
+    size_t pre_off;        // body bytes read along with the head
+    size_t pre_len;
+} HttpResponse;
+
+void free_http_url(HttpUrl *u) {
+    free(u->host);
+    free(u->port);
+    free(u->path);
+    memset(u, 0, sizeof(*u));
+}
+
+// Split http://host[:port]/path into its parts. Returns 0 on success.
+int parse_http_url(const char *url, HttpUrl *u) {
+    memset(u, 0, sizeof(*u));
+    if (strncmp(url, "http://", 7) != 0) {
+        fprintf(stderr, "Error: only http:// URLs are supported: %s\n", url);
+        return 1;
+    }
+
+    const char *authority = url + 7;
+    const char *path = strchr(authority, '/');
+    size_t auth_len = path ? (size_t)(path - authority) : strlen(authority);
+    const char *host = authority;
+    size_t host_len = auth_len;
+    const char *port = NULL;
+
+    if (auth_len > 0 && authority[0] == '[') {
+        // [IPv6]:port
+        const char *close_bracket = memchr(authority, ']', auth_len);
+        if (!close_bracket) {
+            fprintf(stderr, "Error: malformed URL: %s\n", url);
+            return 1;
+        }
+        host = authority + 1;
+        host_len = (size_t)(close_bracket - host);
+        if (close_bracket + 1 < authority + auth_len && close_bracket[1] == ':') {
+            port = close_bracket + 2;
+        }
+    } else {
+        const char *colon = memchr(authority, ':', auth_len);
+        if (colon) {
+            host_len = (size_t)(colon - authority);
+            port = colon + 1;
+        }
+    }
+
+    if (host_len == 0) {
+        fprintf(stderr, "Error: malformed URL: %s\n", url);
+        return 1;
+    }
+
+    u->host = strndup(host, host_len);
+    u->port = port ? strndup(port, (size_t)(authority + auth_len - port)) : strdup("80");
+    u->path = strdup(path ? path : "/");
+    if (!u->host || !u->port || !u->path) {
+        perror("strdup");
+        free_http_url(u);
+        return 1;
+    }
+    return 0;
+}
+
+int http_connect(const HttpUrl *u) {
+    struct addrinfo hints, *res, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int rc = getaddrinfo(u->host, u->port, &hints, &res);
+    if (rc != 0) {
+        fprintf(stderr, "Error: cannot resolve '%s': %s\n", u->host, gai_strerror(rc));
+        return -1;
+    }
+
+    int fd = -1;
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        struct timeval tv = { HTTP_TIMEOUT_SEC, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot connect to %s:%s: %s\n", u->host, u->port, strerror(errno));
+    }
+    return fd;
+}
+
+// Find a header in the response head (case-insensitive name), or NULL
+const char *http_header(const HttpResponse *r, const char *name) {
+    size_t name_len = strlen(name);
+    const char *line = strstr(r->head, "\r\n");
+    while (line != NULL && line[2] != '\r') {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char *value = line + name_len + 1;
+            while (*value == ' ' || *value == '\t') {
+                value++;
             }
+            return value;
         }
+        line = strstr(line, "\r\n");
     }
+    return NULL;
+}
 
-cleanup:
-    free(buffer);
-    free(line_buffer);
-    if (fd >= 0) close(fd);
-    return exit_code;
-}
\ No newline at end of file
+// Send "GET path" for bytes [first, last] and read the response head.
+// Returns 0 with r->fd open at the start of the body, or -1.
+int http_request_range(const HttpUrl *u, off_t first, off_t last, HttpResponse *r) {
+    r->fd = http_connect(u);
+    r->status = 0;
+    r->total = -1;
+    r->content_length = -1;
+    r->pre_off = r->pre_len = 0;
+    if (r->fd < 0) {
+        return -1;
+    }
+
+    char request[4096];
+    int n = snprintf(request, sizeof(request),
+                     "GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%lld-%lld\r\n"
+                     "User-Agent: slice4\r\nConnection: close\r\n\r\n",
+                     u->path, u->host, (long long)first, (long long)last);
+    if (n < 0 || (size_t)n >= sizeof(request)) {
+        fprintf(stderr, "Error: URL path too long\n");
+        goto fail;
+    }
+    if (write_all(r->fd, request, (size_t)n) != 0) {
+        perror("send");
+        goto fail;
+    }
+
+    size_t len = 0;
+    char *end = NULL;
+    while (end == NULL) {
+        if (len == sizeof(r->head) - 1) {
+            fprintf(stderr, "Error: HTTP response head too large\n");
+            goto fail;
+        }
+        ssize_t got = read(r->fd, r->head + len, sizeof(r->head) - 1 - len);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            fprintf(stderr, "Error: connection closed before HTTP response head\n");
+            goto fail;
+        }
+        len += (size_t)got;
+        r->head[len] = '\0';
+        end = strstr(r->head, "\r\n\r\n");
+    }
+
+    if (sscanf(r->head, "HTTP/%*d.%*d %d", &r->status) != 1) {
+        fprintf(stderr, "Error: malformed HTTP status line\n");
+        goto fail;
+    }
+
+    r->pre_off = (size_t)(end + 4 - r->head);
+    r->pre_len = len - r->pre_off;
+
+    const char *value = http_header(r, "Content-Length");
+    if (value) {
+        r->content_length = strtoll(value, NULL, 10);
+    }
+    value = http_header(r, "Content-Range");
+    if (value) {
+        const char *slash = strchr(value, '/');
+        if (slash && slash[1] != '*') {
+            r->total = strtoll(slash + 1, NULL, 10);
+        }
+    }
+    value = http_header(r, "Transfer-Encoding");
+    if (value && strncasecmp(value, "chunked", 7) == 0) {
+        fprintf(stderr, "Error: chunked HTTP responses are not supported for ranges\n");
+        goto fail;
+    }
+    return 0;
+
+fail:
+    close(r->fd);
+    r->fd = -1;
+    return -1;
+}
+
+// Read body bytes, starting with those that arrived with the head
+ssize_t http_read_body(HttpResponse *r, char *dst, size_t len) {
+    if (r->pre_len > 0) {
+        size_t n = r->pre_len < len ? r->pre_len : len;
+        memcpy(dst, r->head + r->pre_off, n);
+        r->pre_off += n;
+        r->pre_len -= n;
+        return (ssize_t)n;
+    }
+    for (;;) {
+        ssize_t n = read(r->fd, dst, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        return n;
+    }
+}
+
+// Fetch exactly `len` bytes at `first` into dst. Returns 0 on success, 1 if
+// the range starts beyond the end of the object, -1 on error. *total gets
+// the object size when the server reports it.
+int http_fetch(const HttpUrl *u, off_t first, size_t len, char *dst, off_t *total) {
+    HttpResponse *r = malloc(sizeof(HttpResponse));
+    if (!r) {
+        perror("malloc for HTTP response");
+        return -1;
+    }
+    int rc = -1;
+
+    if (http_request_range(u, first, first + (off_t)len - 1, r) != 0) {
+        free(r);
+        return -1;
+    }
+    if (total && r->total >= 0) {
+        *total = r->total;
+    }
+
+    if (r->status == 416) {
+        rc = 1;  // Range not satisfiable: first is at or beyond the end
+        goto done;
+    }
+    if (r->status == 200 && first != 0) {
+        fprintf(stderr, "Error: server at %s ignores Range requests\n", u->host);
+        goto done;
+    }
+    if (r->status != 206 && r->status != 200) {
+        fprintf(stderr, "Error: HTTP status %d for bytes %lld-%lld\n",
+                r->status, (long long)first, (long long)(first + (off_t)len - 1));
+        goto done;
+    }
+    if (r->status == 200 && total && r->content_length >= 0) {
+        *total = r->content_length;
+    }
+
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = http_read_body(r, dst + got, len - got);
+        if (n < 0) {
+            perror("recv");
+            goto done;
+        }
+        if (n == 0) {
+            break;  // Short body: the object ends inside the range
+        }
+        got += (size_t)n;
+    }
+    if (got < len && (r->total < 0 || first + (off_t)got < r->total)) {
+        fprintf(stderr, "Error: short HTTP body: %zu of %zu bytes\n", got, len);
+        goto done;
+    }
+    rc = 0;
+
+done:
+    close(r->fd);
+    free(r);
+    return rc;
+}
+
+typedef struct {
+    const HttpUrl *url;
+    off_t first;
+    size_t len;
+    char *data;
+    int rc;
+    pthread_t thread;
+} HttpPart;
+
+void *http_part_worker(void *arg) {
+    HttpPart *part = arg;
+    part->rc = http_fetch(part->url, part->first, part->len, part->data, NULL);
+    return NULL;
+}
+
+// Search [from, limit) for the first newline (forward) or the last newline
+// (backward) with ranged probes that start small and double. Returns the
+// offset just past the newline, or -1 if there is none. *requests counts
+// the probes issued.
+off_t http_find_boundary(const HttpUrl *u, off_t from, off_t limit, int forward,
+                         size_t *requests) {
+    size_t window = SLICE_PROBE_SIZE;
+    char *probe = NULL;
+    off_t found = -2;
+
+    while (found == -2) {
+        off_t lo, hi;
+        if (forward) {
+            if (from >= limit) {
+                found = -1;
+                break;
+            }
+            lo = from;
+            hi = (limit - from > (off_t)window) ? from + (off_t)window : limit;
+        } else {
+            if (limit <= from) {
+                found = -1;
+                break;
+            }
+            hi = limit;
+            lo = (limit - from > (off_t)window) ? limit - (off_t)window : from;
+        }
+
+        size_t len = (size_t)(hi - lo);
+        char *grown = realloc(probe, len);
+        if (!grown) {
+            perror("realloc for probe");
+            break;
+        }
+        probe = grown;
+        (*requests)++;
+        if (http_fetch(u, lo, len, probe, NULL) != 0) {
+            break;
+        }
+
+        char *nl = forward ? memchr(probe, '\n', len) : slice_memrchr(probe, '\n', len);
+        if (nl) {
+            found = lo + (off_t)(nl - probe) + 1;
+        } else if (forward) {
+            from = hi;
+        } else {
+            limit = lo;
+        }
+        if (window < HTTP_PROBE_MAX) {
+            window *= 2;
+        }
+    }
+
+    free(probe);
+    return found == -2 ? -3 : found;  // -3: probe failed
+}
+
+// Write [first, first + len) of the object to stdout. Ranges larger than two
+// parts are fetched with up to `connections` concurrent GETs over a sliding
+// window and written strictly in order; smaller ones use a single GET
+// streamed through one buffer.
+int http_copy_range(const HttpUrl *u, off_t first, size_t len, int connections,
+                    size_t chunk_size, int debug) {
+    int rc = 0;
+
+    if (len <= 2 * (size_t)HTTP_PART_SIZE || connections <= 1) {
+        char *buffer = malloc(chunk_size);
+        HttpResponse *r = malloc(sizeof(HttpResponse));
+        if (!buffer || !r) {
+            perror("malloc for HTTP transfer");
+            free(buffer);
+            free(r);
+            return 1;
+        }
+        if (http_request_range(u, first, first + (off_t)len - 1, r) != 0) {
+            free(buffer);
+            free(r);
+            return 1;
+        }
+        if (r->status != 206 && !(r->status == 200 && first == 0)) {
+            fprintf(stderr, "Error: HTTP status %d for bytes %lld-%lld\n",
+                    r->status, (long long)first, (long long)(first + (off_t)len - 1));
+            rc = 1;
+        }
+        size_t done = 0;
+        while (rc == 0 && done < len) {
+            size_t want = (len - done < chunk_size) ? len - done : chunk_size;
+            ssize_t n = http_read_body(r, buffer, want);
+            if (n <= 0) {
+                if (n < 0) {
+                    perror("recv");
+                } else {
+                    fprintf(stderr, "Error: short HTTP body: %zu of %zu bytes\n", done, len);
+                }
+                rc = 1;
+                break;
+            }
+            if (write_all(STDOUT_FILENO, buffer, (size_t)n) != 0) {
+                perror("write");
+                rc = 1;
+                break;
+            }
+            done += (size_t)n;
+        }
+        close(r->fd);
+        free(r);
+        free(buffer);
+        return rc;
+    }
+
+    size_t part_count = (len + HTTP_PART_SIZE - 1) / HTTP_PART_SIZE;
+    if ((size_t)connections > part_count) {
+        connections = (int)part_count;
+    }
+    if (debug) {
+        fprintf(stderr, "[DEBUG] Fetching %zu parts over %d connections\n", part_count, connections);
+    }
+
+    HttpPart *slots = calloc((size_t)connections, sizeof(HttpPart));
+    if (!slots) {
+        perror("calloc for HTTP parts");
+        return 1;
+    }
+    for (int i = 0; i < connections; i++) {
+        slots[i].data = malloc(HTTP_PART_SIZE);
+        if (!slots[i].data) {
+            perror("malloc for HTTP part");
+            rc = 1;
+            goto free_slots;
+        }
+    }
+
+    // Part i lives in slot i % connections. Parts next..next+connections-1
+    // are in flight; the oldest one is joined and written before its slot
+    // is reused for the next part.
+    size_t launched = 0;
+    for (size_t next = 0; next < part_count; next++) {
+        while (launched < part_count && launched < next + (size_t)connections) {
+            HttpPart *part = &slots[launched % (size_t)connections];
+            part->url = u;
+            part->first = first + (off_t)(launched * HTTP_PART_SIZE);
+            part->len = (launched + 1 == part_count) ? len - launched * HTTP_PART_SIZE : HTTP_PART_SIZE;
+            part->rc = -1;
+            if (pthread_create(&part->thread, NULL, http_part_worker, part) != 0) {
+                fprintf(stderr, "Error: cannot start HTTP worker thread\n");
+                rc = 1;
+                break;
+            }
+            launched++;
+        }
+        if (next >= launched) {
+            break;
+        }
+
+        HttpPart *part = &slots[next % (size_t)connections];
+        pthread_join(part->thread, NULL);
+        if (rc == 0 && part->rc != 0) {
+            rc = 1;
+        }
+        if (rc == 0 && write_all(STDOUT_FILENO, part->data, part->len) != 0) {
+            perror("write");
+            rc = 1;
+        }
+        if (rc != 0) {
+            // Drain the threads still in flight before bailing out
+            for (size_t k = next + 1; k < launched; k++) {
+                pthread_join(slots[k % (size_t)connections].thread, NULL);
+            }
+            break;
+        }
+    }
+
+free_slots:
+    for (int i = 0; i < connections; i++) {
+        free(slots[i].data);
+    }
+    free(slots);
+    return rc;
+}
+
+// Slice a remote object. The size comes from the first probe's
+// Content-Range; with --full-lines-only the line boundaries are located
+// with small probes so only whole lines are transferred.
+int slice_url(const char *url, size_t start, size_t size, int trim_lines,
+              int connections, int debug) {
+    HttpUrl u;
+    if (parse_http_url(url, &u) != 0) {
+        return 1;
+    }
+
+    int rc = 1;
+    size_t requests = 1;
+    off_t total = -1;
+    char *probe = malloc(SLICE_PROBE_SIZE);
+    if (!probe) {
+        perror("malloc for probe");
+        goto done;
+    }
+
+    // First probe: learns the object size and usually contains the first
+    // line boundary as well
+    size_t probe_len = size < SLICE_PROBE_SIZE ? size : SLICE_PROBE_SIZE;
+    int fetched = http_fetch(&u, (off_t)start, probe_len, probe, &total);
+    if (fetched < 0) {
+        goto done;
+    }
+    if (fetched == 1 || total < 0 || (off_t)start >= total) {
+        if (debug) {
+            fprintf(stderr, "[DEBUG] Start position %zu is beyond object size %lld\n",
+                    start, (long long)total);
+        }
+        rc = 0;
+        goto done;
+    }
+
+    off_t first = (off_t)start;
+    off_t end = (off_t)start + (off_t)size;
+    if (end > total) {
+        end = total;
+    }
+
+    if (debug) {
+        fprintf(stderr, "[DEBUG] URL: http://%s:%s%s\n", u.host, u.port, u.path);
+        fprintf(stderr, "[DEBUG] Object size: %lld bytes\n", (long long)total);
+        fprintf(stderr, "[DEBUG] Requested start: %zu\n", start);
+        fprintf(stderr, "[DEBUG] Requested size: %zu\n", size);
+    }
+
+    if (trim_lines) {
+        // Trim partial first line
+        if (start > 0) {
+            size_t in_probe = (size_t)(end - first) < probe_len ? (size_t)(end - first) : probe_len;
+            char *nl = memchr(probe, '\n', in_probe);
+            first = nl ? first + (off_t)(nl - probe) + 1
+                       : http_find_boundary(&u, first + (off_t)in_probe, end, 1, &requests);
+        }
+        // Trim partial last line
+        if (first >= 0) {
+            end = http_find_boundary(&u, first, end, 0, &requests);
+        }
+        if (first == -3 || end == -3) {
+            goto done;
+        }
+        if (first < 0 || end < 0 || end <= first) {
+            if (debug) {
+                fprintf(stderr, "[DEBUG] Warning: All content was trimmed due to --full-lines-only\n");
+            }
+            rc = 0;
+            goto done;
+        }
+        if (debug) {
+            fprintf(stderr, "[DEBUG] Line boundaries resolved to %lld-%lld with %zu requests\n",
+                    (long long)first, (long long)end, requests);
+        }
+    }
+
+    size_t len = (size_t)(end - first);
+    if (first == (off_t)start && len <= probe_len) {
+        // The first probe already holds the whole slice
+        rc = write_all(STDOUT_FILENO, probe, len) != 0;
+        if (rc) {
+            perror("write");
+        }
+        goto done;
+    }
+
+    size_t chunk_size = calculate_chunk_size((size_t)total, 0, debug);
+    rc = http_copy_range(&u, first, len, connections, chunk_size, debug);
+    if (debug) {
+        fprintf(stderr, "[DEBUG] Transferred %zu bytes\n", len);
+    }
+
+done:
+    free(probe);
+    free_http_url(&u);
+    return rc;
+}
+
+// ---------------------------------------------------------------------------
+// Slice daemon (--serve). Answers binary-framed requests on a Unix domain
+// socket from a warm process: open descriptors, their fingerprints and the
+// line boundaries found in them are cached across requests, buffers are
+// allocated once, and payloads go out with sendfile(2).
+//
+// Request:  SliceRequest, then path_len bytes of path (no NUL)
+// Response: SliceResponse, then `length` payload bytes if status == 0
+// All integers are in host byte order; the socket never leaves the host.
+// ---------------------------------------------------------------------------
+
+#define SERVE_MAGIC 0x31434c53u           // "SLC1"
+#define SERVE_FLAG_FULL_LINES 0x1u
+#define SERVE_MAX_CLIENTS 64
+#define SERVE_FD_CACHE 64                 // Open files kept in the LRU
+#define SERVE_BOUNDARY_CACHE 16           // Boundary hints kept per file
+#define SERVE_PROBE_MAX (1024 * 1024)     // Largest boundary probe read
+#define SERVE_IO_TIMEOUT_SEC 5
+
+typedef struct {
+    uint32_t magic;
+    uint32_t flags;
+    uint64_t start;
+    uint64_t size;
+    uint32_t path_len;
+    uint32_t reserved;
+} SliceRequest;
+
+typedef struct {
+    uint32_t magic;
+    int32_t status;   // 0 or an errno value
+    uint64_t length;  // payload bytes that follow
+} SliceResponse;
+
+// Result of one boundary search: the newline search starting at `from`
+// (forward) or ending at `from` (backward) found `found`
+typedef struct {
+    off_t from;
+    off_t limit;
+    off_t found;
+    int forward;
+} BoundaryHint;
+
+typedef struct {
+    char *path;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    unsigned long last_used;
+    BoundaryHint hints[SERVE_BOUNDARY_CACHE];
+    size_t hint_count;
+    size_t hint_next;
+} CachedFile;
+
+typedef struct {
+    CachedFile files[SERVE_FD_CACHE];
+    unsigned long tick;
+    char *probe;          // pooled buffers, allocated once
+    char *copy;
+    size_t copy_size;
+    int debug;
+} ServeState;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+void serve_on_signal(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+#ifdef __APPLE__
+#define ST_MTIM(st) ((st)->st_mtimespec)
+#else
+#define ST_MTIM(st) ((st)->st_mtim)
+#endif
+
+void cached_file_close(CachedFile *cf) {
+    if (cf->fd >= 0) {
+        close(cf->fd);
+    }
+    free(cf->path);
+    memset(cf, 0, sizeof(*cf));
+    cf->fd = -1;
+}
+
+// Return the open file for path, reusing the cached descriptor while the
+// file's fingerprint (device, inode, size, mtime) is unchanged. A changed
+// or replaced file is reopened and its boundary hints are dropped.
+CachedFile *serve_get_file(ServeState *ss, const char *path, int *err) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        *err = errno;
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        *err = EINVAL;
+        return NULL;
+    }
+
+    CachedFile *victim = &ss->files[0];
+    for (int i = 0; i < SERVE_FD_CACHE; i++) {
+        CachedFile *cf = &ss->files[i];
+        if (cf->path != NULL && strcmp(cf->path, path) == 0) {
+            if (cf->dev == st.st_dev && cf->ino == st.st_ino && cf->size == st.st_size &&
+                cf->mtime.tv_sec == ST_MTIM(&st).tv_sec &&
+                cf->mtime.tv_nsec == ST_MTIM(&st).tv_nsec) {
+                cf->last_used = ++ss->tick;
+                return cf;
+            }
+            if (ss->debug) {
+                fprintf(stderr, "[DEBUG] '%s' changed, reopening\n", path);
+            }
+            victim = cf;
+            break;
+        }
+        if (cf->path == NULL || cf->last_used < victim->last_used) {
+            victim = cf;
+        }
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        *err = errno;
+        return NULL;
+    }
+    struct stat fst;
+    char *copy = strdup(path);
+    if (fstat(fd, &fst) != 0 || !copy) {
+        *err = errno ? errno : ENOMEM;
+        close(fd);
+        free(copy);
+        return NULL;
+    }
+
+    cached_file_close(victim);
+    victim->path = copy;
+    victim->fd = fd;
+    victim->dev = fst.st_dev;
+    victim->ino = fst.st_ino;
+    victim->size = fst.st_size;
+    victim->mtime = ST_MTIM(&fst);
+    victim->last_used = ++ss->tick;
+    return victim;
+}
+
+off_t serve_find_newline(ServeState *ss, CachedFile *cf, off_t from, off_t limit, int forward) {
+    for (size_t i = 0; i < cf->hint_count; i++) {
+        BoundaryHint *h = &cf->hints[i];
+        if (h->forward == forward && h->from == from && h->limit == limit) {
+            return h->found;
+        }
+    }
+
+    off_t found = slice_find_newline(cf->fd, from, limit, forward, ss->probe, SERVE_PROBE_MAX);
+    if (found >= -1) {
+        BoundaryHint *h = &cf->hints[cf->hint_next];
+        h->from = from;
+        h->limit = limit;
+        h->found = found;
+        h->forward = forward;
+        cf->hint_next = (cf->hint_next + 1) % SERVE_BOUNDARY_CACHE;
+        if (cf->hint_count < SERVE_BOUNDARY_CACHE) {
+            cf->hint_count++;
+        }
+    }
+    return found;
+}
+
+// Copy [offset, offset + len) of fd to the client socket
+int serve_send_range(ServeState *ss, int client, int fd, off_t offset, size_t len) {
+#ifdef __linux__
+    (void)ss;  // sendfile needs no copy buffer
+#endif
+    while (len > 0) {
+#ifdef __linux__
+        ssize_t n = sendfile(client, fd, &offset, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+#else
+        size_t want = len < ss->copy_size ? len : ss->copy_size;
+        ssize_t n = pread(fd, ss->copy, want, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || write_all(client, ss->copy, (size_t)n) != 0) {
+            return -1;
+        }
+        offset += n;
+#endif
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Read one request from a client and answer it. Returns -1 when the
+// connection should be closed.
+int serve_handle(ServeState *ss, int client) {
+    SliceRequest req;
+    ssize_t n = recv(client, &req, sizeof(req), MSG_WAITALL);
+    if (n != (ssize_t)sizeof(req)) {
+        return -1;  // Disconnected or malformed
+    }
+    if (req.magic != SERVE_MAGIC || req.path_len == 0 || req.path_len >= PATH_MAX) {
+        return -1;
+    }
+
+    char path[PATH_MAX];
+    if (recv(client, path, req.path_len, MSG_WAITALL) != (ssize_t)req.path_len) {
+        return -1;
+    }
+    path[req.path_len] = '\0';
+
+    SliceResponse resp = { SERVE_MAGIC, 0, 0 };
+    int err = 0;
+    off_t first = 0, end = 0;
+    CachedFile *cf = serve_get_file(ss, path, &err);
+
+    if (cf != NULL && req.size > 0 && req.start < (uint64_t)cf->size) {
+        first = (off_t)req.start;
+        end = (req.size > (uint64_t)(cf->size - first)) ? cf->size : first + (off_t)req.size;
+
+        if (req.flags & SERVE_FLAG_FULL_LINES) {
+            if (first > 0) {
+                first = serve_find_newline(ss, cf, first, end, 1);
+            }
+            if (first >= 0) {
+                end = serve_find_newline(ss, cf, first, end, 0);
+            }
+            if (first == -2 || end == -2) {
+                err = EIO;
+            } else if (first < 0 || end < 0) {
+                first = end = 0;  // All content trimmed
+            }
+        }
+    }
+
+    if (cf == NULL || err != 0) {
+        resp.status = err ? err : EIO;
+    } else {
+        resp.length = (uint64_t)(end - first);
+    }
+
+    if (ss->debug) {
+        fprintf(stderr, "[DEBUG] %s start=%llu size=%llu flags=%u -> status %d, %llu bytes\n",
+                path, (unsigned long long)req.start, (unsigned long long)req.size, req.flags,
+                resp.status, (unsigned long long)resp.length);
+    }
+
+    if (write_all(client, (const char *)&resp, sizeof(resp)) != 0) {
+        return -1;
+    }
+    if (resp.length > 0 && serve_send_range(ss, client, cf->fd, first, (size_t)resp.length) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int serve(const char *socket_path, int debug) {
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path too long: %s\n", socket_path);
+        return 1;
+    }
+
+    ServeState *ss = calloc(1, sizeof(ServeState));
+    if (!ss) {
+        perror("calloc for server state");
+        return 1;
+    }
+    for (int i = 0; i < SERVE_FD_CACHE; i++) {
+        ss->files[i].fd = -1;
+    }
+    ss->debug = debug;
+    ss->copy_size = SLICE_BASE_CHUNK_SIZE * 32;
+    ss->probe = malloc(SERVE_PROBE_MAX);
+    ss->copy = malloc(ss->copy_size);
+
+    int rc = 1;
+    int listener = -1;
+    struct pollfd fds[1 + SERVE_MAX_CLIENTS];
+    int nfds = 1;
+
+    if (!ss->probe || !ss->copy) {
+        perror("malloc for server buffers");
+        goto done;
+    }
+
+    // Replace a stale socket left by an earlier run, but nothing else
+    struct stat st;
+    if (lstat(socket_path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "Error: %s exists and is not a socket\n", socket_path);
+            goto done;
+        }
+        unlink(socket_path);
+    }
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        fprintf(stderr, "Error: cannot listen on %s: %s\n", socket_path, strerror(errno));
+        goto done;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = serve_on_signal;  // no SA_RESTART: poll() must return
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (debug) {
+        fprintf(stderr, "[DEBUG] Serving on %s\n", socket_path);
+    }
+
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+
+    while (!serve_stop) {
+        if (poll(fds, (nfds_t)nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            goto done;
+        }
+
+        for (int i = nfds - 1; i >= 1; i--) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            if ((fds[i].revents & POLLIN) == 0 || serve_handle(ss, fds[i].fd) != 0) {
+                close(fds[i].fd);
+                fds[i] = fds[--nfds];
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int client = accept(listener, NULL, NULL);
+            if (client >= 0 && nfds < 1 + SERVE_MAX_CLIENTS) {
+                struct timeval tv = { SERVE_IO_TIMEOUT_SEC, 0 };
+                setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+                fds[nfds].fd = client;
+                fds[nfds].events = POLLIN;
+                fds[nfds].revents = 0;
+                nfds++;
+            } else if (client >= 0) {
+                close(client);  // Too many clients
+            }
+        }
+    }
+    rc = 0;
+
+done:
+    for (int i = 1; i < nfds; i++) {
+        close(fds[i].fd);
+    }
+    if (listener >= 0) {
+        close(listener);
+        unlink(socket_path);
+    }
+    for (int i = 0; i < SERVE_FD_CACHE; i++) {
+        cached_file_close(&ss->files[i]);
+    }
+    free(ss->probe);
+    free(ss->copy);
+    free(ss);
+    return rc;
+}
+
+// --split: parts are handed out to worker threads one at a time
+typedef struct {
+    int in_fd;
+    const char *prefix;
+    int width;              // digits in part names
+    const off_t *bounds;    // part i is [bounds[i], bounds[i + 1])
+    size_t parts;
+    size_t next;            // next part to write
+    int failed;
+    pthread_mutex_t lock;
+} SplitJob;
+
+// Copy [offset, offset + len) of in_fd to out_fd, which is at position 0.
+// Uses copy_file_range (reflinks or in-kernel copies) when the file
+// systems allow it, then sendfile, then pread/write. Offsets are passed
+// explicitly, so threads can share in_fd.
+static int copy_part(int in_fd, int out_fd, off_t offset, size_t len) {
+    off_t in_pos = offset;
+#ifdef __linux__
+    off_t out_pos = 0;
+    int method = 1;  // 1: copy_file_range, 2: sendfile
+    while (len > 0 && method > 0) {
+        ssize_t n = method == 1 ? copy_file_range(in_fd, &in_pos, out_fd, &out_pos, len, 0)
+                                : sendfile(out_fd, in_fd, &in_pos, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                      errno == EOPNOTSUPP || errno == EBADF)) {
+            // Not for this pair of files; sendfile and write continue from
+            // the file position
+            method = method == 1 ? 2 : 0;
+            if (lseek(out_fd, in_pos - offset, SEEK_SET) < 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            return 0;  // The file shrank
+        }
+        len -= (size_t)n;
+    }
+#endif
+    char *buffer = malloc(SLICE_BASE_CHUNK_SIZE * 8);
+    if (!buffer) {
+        return -1;
+    }
+    int rc = 0;
+    while (len > 0 && rc == 0) {
+        size_t want = len < SLICE_BASE_CHUNK_SIZE * 8 ? len : SLICE_BASE_CHUNK_SIZE * 8;
+        ssize_t n = pread(in_fd, buffer, want, in_pos);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || write_all(out_fd, buffer, (size_t)n) != 0) {
+            rc = n == 0 ? 0 : -1;
+            break;
+        }
+        in_pos += n;
+        len -= (size_t)n;
+    }
+    free(buffer);
+    return rc;
+}
+
+static void *split_worker(void *arg) {
+    SplitJob *job = arg;
+    char name[PATH_MAX];
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        size_t part = job->failed ? job->parts : job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (part >= job->parts) {
+            break;
+        }
+
+        snprintf(name, sizeof(name), "%s%0*zu", job->prefix, job->width, part);
+        int out_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        off_t from = job->bounds[part];
+        size_t len = (size_t)(job->bounds[part + 1] - from);
+        if (out_fd < 0 || copy_part(job->in_fd, out_fd, from, len) != 0 || close(out_fd) != 0) {
+            fprintf(stderr, "Error writing '%s': %s\n", name, strerror(errno));
+            if (out_fd >= 0) {
+                close(out_fd);
+            }
+            pthread_mutex_lock(&job->lock);
+            job->failed = 1;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+    return NULL;
+}
+
+// Split mode: cut the lines starting in [start, start + size) into `parts`
+// files <prefix>00, <prefix>01, ... of about equal size, each ending at a
+// line end, like `split -n l/N`. Split points are found with one newline
+// probe each, and the parts are copied in parallel.
+int slice_split(const char *filename, size_t start, size_t size, size_t parts,
+                const char *prefix, int debug) {
+    int in_fd = open(filename, O_RDONLY);
+    if (in_fd < 0) {
+        fprintf(stderr, "Error: cannot open file '%s': %s\n", filename, strerror(errno));
+        return 1;
+    }
+    slice_file *f;
+    int rc = slice_open_fd(in_fd, &f);
+    if (rc != SLICE_OK) {
+        fprintf(stderr, "Error: cannot split '%s': %s\n", filename, slice_strerror(rc));
+        close(in_fd);
+        return 1;
+    }
+
+    off_t *bounds = malloc((parts + 1) * sizeof(off_t));
+    if (!bounds) {
+        fprintf(stderr, "Error: cannot allocate %zu split points\n", parts);
+        slice_close(f);
+        close(in_fd);
+        return 1;
+    }
+    off_t file_size = slice_size(f);
+    off_t from = (off_t)start < file_size ? (off_t)start : file_size;
+    off_t lo = slice_line_start(f, from);
+    off_t hi = (off_t)(size < (size_t)(file_size - from) ? from + (off_t)size : file_size);
+    bounds[0] = lo;
+    bounds[parts] = lo < 0 ? lo : slice_line_start(f, hi);
+    for (size_t i = 1; i < parts && bounds[0] >= 0 && bounds[parts] >= 0; i++) {
+        bounds[i] = query_split_point(f, lo, bounds[parts], i, parts);
+        if (bounds[i] < 0) {
+            bounds[0] = bounds[i];
+        }
+    }
+    slice_close(f);
+    if (bounds[0] < 0 || bounds[parts] < 0) {
+        fprintf(stderr, "Error: cannot read '%s': %s\n", filename,
+                slice_strerror((int)(bounds[0] < 0 ? bounds[0] : bounds[parts])));
+        free(bounds);
+        close(in_fd);
+        return 1;
+    }
+
+    int width = 2;
+    for (size_t n = parts - 1; n >= 100; n /= 10) {
+        width++;
+    }
+    SplitJob job = { in_fd, prefix, width, bounds, parts, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t workers = cpus > 0 && (size_t)cpus < parts ? (size_t)cpus : parts;
+    if (workers > 64) {
+        workers = 64;
+    }
+    if (debug) {
+        fprintf(stderr, "[DEBUG] Splitting %lld bytes into %zu parts with %zu threads\n",
+                (long long)(bounds[parts] - lo), parts, workers);
+        for (size_t i = 0; i < parts; i++) {
+            fprintf(stderr, "[DEBUG] Part %zu: %lld-%lld\n", i,
+                    (long long)bounds[i], (long long)bounds[i + 1]);
+        }
+    }
+
+    pthread_t threads[64];
+    size_t started = 0;
+    for (; started < workers; started++) {
+        if (pthread_create(&threads[started], NULL, split_worker, &job) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        split_worker(&job);  // No threads available: write the parts here
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&job.lock);
+    free(bounds);
+    close(in_fd);
+    return job.failed ? 1 : 0;
+}
+
+// Sampling mode: print up to sample_lines random whole lines of the lines
+// starting in [start, start + size), in file order. Only the probed lines
+// are read.
+int slice_sample(const char *filename, size_t start, size_t size, size_t sample_lines,
+                 uint64_t seed, int uniform, int debug) {
+    slice_file *f;
+    int rc = slice_open(filename, &f);
+    if (rc != SLICE_OK) {
+        fprintf(stderr, "Error: cannot open file '%s': %s\n", filename,
+                rc == SLICE_ERR_OPEN ? strerror(errno) : slice_strerror(rc));
+        return 1;
+    }
+
+    off_t file_size = slice_size(f);
+    off_t from = (off_t)start < file_size ? (off_t)start : file_size;
+    off_t lo = slice_line_start(f, from);
+    off_t hi = (off_t)(size < (size_t)(file_size - from) ? from + (off_t)size : file_size);
+    hi = lo < 0 ? lo : slice_line_start(f, hi);
+    if (lo < 0 || hi < 0) {
+        fprintf(stderr, "Error: cannot read '%s': %s\n", filename,
+                slice_strerror((int)(lo < 0 ? lo : hi)));
+        slice_close(f);
+        return 1;
+    }
+
+    QueryLine *lines;
+    size_t count;
+    if (query_sample(f, lo, hi, sample_lines, seed, uniform, &lines, &count, debug) != 0) {
+        slice_close(f);
+        return 1;
+    }
+
+    int exit_code = 0;
+    for (size_t i = 0; i < count && exit_code == 0; i++) {
+        slice_view view;
+        rc = slice_range(f, lines[i].start, (size_t)(lines[i].end - lines[i].start), &view);
+        if (rc != SLICE_OK) {
+            fprintf(stderr, "Error: cannot read '%s': %s\n", filename, slice_strerror(rc));
+            exit_code = 1;
+            break;
+        }
+        // Keep lines apart when the last one has no newline
+        int newline = view.len == 0 || view.data[view.len - 1] != '\n';
+        if (write_all(STDOUT_FILENO, view.data, view.len) != 0 ||
+            (newline && write_all(STDOUT_FILENO, "\n", 1) != 0)) {
+            perror("Error writing to stdout");
+            exit_code = 1;
+        }
+        slice_release(&view);
+    }
+
+    free(lines);
+    slice_close(f);
+    return exit_code;
+}
+
+// --validate: print each broken record once, even when overlapping chunks
+// both contain it
+typedef struct {
+    unsigned long long reported_end;
+    size_t count;
+} InvalidRecords;
+
+static void report_invalid_record(unsigned long long start, unsigned long long end,
+                                  const char *why, void *arg) {
+    InvalidRecords *r = arg;
+    if (r->count > 0 && end <= r->reported_end) {
+        return;
+    }
+    fprintf(stderr, "Invalid JSON record at bytes %llu-%llu: %s\n", start, end, why);
+    r->reported_end = end;
+    r->count++;
+}
+
+// --record-format counterpart of slice_range_lines: the whole records in
+// [start, start + size). A CSV record ends at a newline outside quotes, and
+// the quote state at start is inferred from CSV_RESYNC_WINDOW bytes; a JSON
+// Lines record ends after a complete value. A --record-start record ends
+// before a line that starts one, so up to RECORD_START_PEEK bytes past the
+// range are read to decide the last one. `origin` is the input offset of
+// f's first byte, for --validate reports.
+static int range_records(slice_file *f, off_t origin, off_t start, size_t size,
+                         const RecordSpec *records, InvalidRecords *invalid, slice_view *view) {
+    size_t first, last;
+    if (records->format == RECORDS_MULTILINE) {
+        off_t file_size = slice_size(f);
+        size_t ahead = 0;
+        if (start < file_size && size < (size_t)(file_size - start)) {
+            ahead = (size_t)(file_size - start) - size;
+            ahead = ahead < RECORD_START_PEEK ? ahead : RECORD_START_PEEK;
+        }
+        int rc = slice_range(f, start, size + ahead, view);
+        if (rc != SLICE_OK) {
+            return rc;
+        }
+        size_t limit = view->len < size ? view->len : size, from = 0, end;
+        first = last = SIZE_MAX;
+        while ((end = record_start_next(records->starts, view->data, view->len, from, 1, &from)) != SIZE_MAX &&
+               end <= limit) {
+            if (first == SIZE_MAX) {
+                first = end;
+            }
+            last = end;
+        }
+        goto trim;
+    }
+    if (records->format == RECORDS_JSONL) {
+        int rc = slice_range(f, start, size, view);
+        if (rc != SLICE_OK) {
+            return rc;
+        }
+        JsonlScan scan;
+        jsonl_scan_init(&scan, (unsigned long long)(origin + start));
+        if (invalid) {
+            scan.report = report_invalid_record;
+            scan.report_arg = invalid;
+        }
+        jsonl_scan(&scan, view->data, view->len, &first, &last);
+        jsonl_scan_free(&scan);
+        goto trim;
+    }
+
+    int quoted = 0;
+    if (start > 0) {
+        slice_view window;
+        int rc = slice_range(f, start, CSV_RESYNC_WINDOW, &window);
+        if (rc != SLICE_OK) {
+            return rc;
+        }
+        quoted = csv_resync(window.data, window.len, records->csv_sep);
+        slice_release(&window);
+    }
+
+    int rc = slice_range(f, start, size, view);
+    if (rc != SLICE_OK) {
+        return rc;
+    }
+    csv_scan(view->data, view->len, &quoted, &first, &last);
+
+trim:;
+    size_t from = start > 0 ? first : 0;
+    if (from == SIZE_MAX || last == SIZE_MAX || last <= from) {
+        view->len = 0;  // All content trimmed
+        return SLICE_OK;
+    }
+    view->data += from;
+    view->offset += (off_t)from;
+    view->len = last - from;
+    return SLICE_OK;
+}
+
+// --max-bandwidth / --max-iops in chunking mode: chunks are views of a
+// mapping, read by page faults when they are first touched, so pacing them
+// means touching [from, from + len) one paced piece at a time before the
+// chunk is trimmed or written. A view that is not mapped (pread fallback)
+// has been read already and is only charged.
+static void pace_range(slice_file *f, IoThrottle *throttle, off_t from, size_t len) {
+    slice_view view;
+    if (slice_range(f, from, len, &view) != SLICE_OK) {
+        throttle_acquire(throttle, len);  // The chunk itself will report the error
+        return;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    size_t step = page > 0 ? (size_t)page : 4096;
+    volatile char touched = 0;
+    for (size_t done = 0; done < view.len;) {
+        size_t piece = throttle_read_size(throttle, view.len - done);
+        throttle_acquire(throttle, piece);
+        if (view.owned == NULL) {
+            for (size_t at = done; at < done + piece; at += step) {
+                touched ^= view.data[at];
+            }
+        }
+        done += piece;
+    }
+    (void)touched;
+    slice_release(&view);
+}
+
+// The input of chunking mode: the segments of --file or --files-from, each
+// opened with libslice when a chunk first reaches it. Files stay open (and
+// mapped) until the sink is finished, since sinks may hold on to views of
+// them. The page-cache cursor follows the segment being read.
+typedef struct {
+    const Segment *segs;
+    size_t count;
+    off_t end;                // end of the concatenation
+    slice_file **files;       // per segment, NULL until opened
+    char *span;               // copy of a chunk that crosses a file edge
+    size_t span_cap;
+    slice_file *span_file;
+    size_t spans;             // chunks copied across file edges
+    CachePolicy policy;
+    int report;
+    CacheCursor cache;
+    int cache_fd;
+    size_t cache_seg;         // segment the cursor is on, count before the first
+    off_t cache_from, cache_to;  // range advised, in the concatenation
+    size_t resident, pages;
+} ChunkInput;
+
+static slice_file *input_file(ChunkInput *in, size_t i) {
+    if (!in->files[i]) {
+        int rc = slice_open(in->segs[i].path, &in->files[i]);
+        if (rc != SLICE_OK) {
+            fprintf(stderr, "Error: cannot open file '%s': %s\n", in->segs[i].path,
+                    rc == SLICE_ERR_NOT_REGULAR ? "chunking needs a regular file" : strerror(errno));
+            in->files[i] = NULL;
+        }
+    }
+    return in->files[i];
+}
+
+// Next piece of [*at, to) within a single segment: stores its segment, its
+// offset in that file and its length, and moves *at past it. Returns 0 once
+// *at reaches `to`.
+static int input_next_piece(const ChunkInput *in, off_t *at, off_t to, size_t *seg,
+                            off_t *local, size_t *len) {
+    size_t i = *seg < in->count ? *seg : 0;
+    while (i > 0 && *at < in->segs[i].base) {
+        i--;
+    }
+    while (i < in->count && *at >= in->segs[i].base + in->segs[i].size) {
+        i++;
+    }
+    if (*at >= to || i == in->count) {
+        return 0;
+    }
+    off_t seg_end = in->segs[i].base + in->segs[i].size;
+    off_t end = to < seg_end ? to : seg_end;
+    *seg = i;
+    *local = *at - in->segs[i].base;
+    *len = (size_t)(end - *at);
+    *at = end;
+    return 1;
+}
+
+// --cache-policy / --cache-report: move the cursor to the segments of
+// [from, to), each advised over the part of it in the chunked range
+static void input_advance(ChunkInput *in, off_t from, off_t to) {
+    size_t seg = in->cache_seg < in->count ? in->cache_seg : 0;
+    off_t local;
+    size_t len;
+    while (input_next_piece(in, &from, to, &seg, &local, &len)) {
+        if (in->cache_seg < in->count && seg < in->cache_seg) {
+            continue;  // Overlap with a segment already read
+        }
+        if (seg != in->cache_seg) {
+            const Segment *s = &in->segs[seg];
+            off_t lo = in->cache_from > s->base ? in->cache_from - s->base : 0;
+            off_t hi = in->cache_to < s->base + s->size ? in->cache_to - s->base : s->size;
+            cache_end(&in->cache);
+            if (in->cache_fd >= 0) {
+                close(in->cache_fd);
+            }
+            in->cache_seg = seg;
+            in->cache_fd = open(s->path, O_RDONLY);
+            if (in->cache_fd >= 0 && lo < hi) {
+                size_t resident, pages;
+                if (in->report && cache_residency(in->cache_fd, lo, hi - lo, &resident, &pages) == 0) {
+                    in->resident += resident;
+                    in->pages += pages;
+                }
+                cache_begin(&in->cache, in->policy, in->cache_fd, lo, hi);
+            }
+        }
+        cache_advance(&in->cache, local, len);
+    }
+}
+
+// The file to take the chunk [off, off + len) of segment `seg` from, with
+// `extra` bytes past it for its trimming to look at: the segment's own file
+// when they lie in it, so the chunk is a view of its mapping, otherwise a
+// copy of them wrapped with slice_open_mem. A trimmed chunk starting at a
+// file's first byte is copied too, with the byte before it, since a
+// separate run would take its first line as partial. *origin is set to the
+// offset of the file's first byte in the concatenation.
+static slice_file *input_chunk(ChunkInput *in, size_t seg, off_t off, size_t len, size_t extra,
+                               int trimmed, int own_file, off_t *origin) {
+    const Segment *s = &in->segs[seg];
+    off_t want = off + (off_t)len + (off_t)extra;
+    if (want > in->end) {
+        want = in->end;
+    }
+    if (own_file || ((off > s->base || off == 0 || !trimmed) && want <= s->base + s->size)) {
+        *origin = s->base;
+        return input_file(in, seg);
+    }
+
+    off_t from = off > 0 ? off - 1 : 0;
+    size_t need = (size_t)(want - from);
+    if (need > in->span_cap) {
+        char *grown = realloc(in->span, need);
+        if (!grown) {
+            perror("realloc for chunk across files");
+            return NULL;
+        }
+        in->span = grown;
+        in->span_cap = need;
+    }
+    size_t i = seg, n, done = 0;
+    off_t at = from, local;
+    while (input_next_piece(in, &at, want, &i, &local, &n)) {
+        slice_file *f = input_file(in, i);
+        slice_view piece;
+        if (!f) {
+            return NULL;
+        }
+        int rc = slice_range(f, local, n, &piece);
+        if (rc != SLICE_OK || piece.len != n) {
+            fprintf(stderr, "Error: cannot read '%s': %s\n", in->segs[i].path,
+                    rc != SLICE_OK ? slice_strerror(rc) : "file changed size");
+            if (rc == SLICE_OK) {
+                slice_release(&piece);
+            }
+            return NULL;
+        }
+        memcpy(in->span + done, piece.data, n);
+        done += n;
+        slice_release(&piece);
+    }
+    slice_close(in->span_file);
+    in->span_file = NULL;
+    if (slice_open_mem(in->span, need, &in->span_file) != SLICE_OK) {
+        fprintf(stderr, "Error: cannot allocate a chunk across files\n");
+        return NULL;
+    }
+    in->spans++;
+    *origin = from;
+    return in->span_file;
+}
+
+// Chunking mode: cut [start, start + size) of the input (one regular file,
+// or the files of --files-from laid end to end) into chunks of chunk_size
+// bytes, each starting chunk_size - overlap bytes after the previous one,
+// and hand them to a ChunkSink for --out-format. Chunks are views into a
+// mapping of their file (libslice), so payloads are written straight from
+// the page cache; only a chunk that crosses into the next file is copied.
+// With break_at_files no chunk crosses a file edge: a file's last chunk ends
+// with it and the next file starts a chunk of its own. With --full-lines-only
+// each chunk is trimmed exactly as a separate `slice4 --start <chunk start>`
+// run would trim it. Chunk offsets are positions in the concatenation, and
+// a chunk's source is the file holding its first byte.
+int slice_chunks(const Segment *segs, size_t seg_count, int break_at_files,
+                 size_t start, size_t size, size_t chunk_size,
+                 size_t overlap, int trim_lines, const RecordSpec *records,
+                 OutFormat format, const char *pack_prefix, Compressor *compress,
+                 IoThrottle *throttle, const CacheSpec *caching, int debug) {
+    // Tar entries carry the newest modification time of the files
+    time_t mtime = 0;
+    for (size_t i = 0; i < seg_count; i++) {
+        struct stat st;
+        if (stat(segs[i].path, &st) != 0) {
+            fprintf(stderr, "Error: cannot open file '%s': %s\n", segs[i].path, strerror(errno));
+            return 1;
+        }
+        mtime = st.st_mtime > mtime ? st.st_mtime : mtime;
+    }
+
+    ChunkInput in = { .segs = segs, .count = seg_count, .cache_fd = -1, .cache_seg = seg_count };
+    in.end = segs[seg_count - 1].base + segs[seg_count - 1].size;
+    in.files = calloc(seg_count, sizeof(slice_file *));
+    if (!in.files) {
+        perror("calloc for chunk input");
+        return 1;
+    }
+    off_t range_end = in.end;
+    if ((off_t)start < in.end && size < (size_t)(in.end - (off_t)start)) {
+        range_end = (off_t)(start + size);
+    }
+    in.policy = caching->policy;
+    in.report = caching->report;
+    in.cache = (CacheCursor){ .policy = CACHE_DEFAULT, .fd = -1 };
+    in.cache_from = (off_t)start;
+    in.cache_to = range_end;
+
+    ChunkSink sink;
+    sink_init(&sink, format, STDOUT_FILENO, mtime);
+    sink.compress = compress;
+    sink.frame_flags = trim_lines ? SLICE_FRAME_FULL_LINES : 0;
+    int exit_code = 0;
+    if (format == OUT_PACK && sink_open_pack(&sink, pack_prefix) != 0) {
+        exit_code = 1;
+    }
+    size_t step = chunk_size - overlap;
+    size_t id = 0;
+    InvalidRecords invalid = { 0, 0 };
+    off_t paced_to = (off_t)start;  // bytes before this were charged to the throttle
+
+    // Bytes past a chunk that its records are decided by
+    int by_records = (trim_lines || records->validate) && records->format != RECORDS_LINES;
+    size_t extra = 0;
+    if (by_records && records->format == RECORDS_MULTILINE) {
+        extra = RECORD_START_PEEK;
+    } else if (by_records && records->format == RECORDS_CSV) {
+        extra = CSV_RESYNC_WINDOW;
+    }
+
+    size_t seg = 0;
+    for (off_t off = (off_t)start, next; exit_code == 0 && off < range_end; off = next, id++) {
+        size_t len = (range_end - off < (off_t)chunk_size) ? (size_t)(range_end - off) : chunk_size;
+        while (off >= segs[seg].base + segs[seg].size) {
+            seg++;
+        }
+        off_t seg_end = segs[seg].base + segs[seg].size;
+        if (break_at_files && off + (off_t)len > seg_end) {
+            len = (size_t)(seg_end - off);
+        }
+        // A chunk reaching the end of a file under break_at_files is its
+        // last; the rest would be overlap
+        next = break_at_files && off + (off_t)len >= seg_end ? seg_end : off + (off_t)step;
+
+        if (in.policy != CACHE_DEFAULT || in.report) {
+            input_advance(&in, off, off + (off_t)len);
+        }
+        if (throttle_active(throttle) && off + (off_t)len > paced_to) {
+            // The overlap with the previous chunk was paced with it
+            off_t at = off > paced_to ? off : paced_to, local;
+            size_t i = seg, n;
+            while (input_next_piece(&in, &at, off + (off_t)len, &i, &local, &n)) {
+                slice_file *pf = input_file(&in, i);
+                if (pf) {
+                    pace_range(pf, throttle, local, n);
+                }
+            }
+            paced_to = off + (off_t)len;
+        }
+
+        off_t origin;
+        slice_file *f = input_chunk(&in, seg, off, len, extra, trim_lines || by_records,
+                                    break_at_files, &origin);
+        if (!f) {
+            exit_code = 1;
+            break;
+        }
+        off_t local = off - origin;
+        slice_view view;
+        int rc;
+        if (by_records) {
+            rc = range_records(f, origin, local, len, records, records->validate ? &invalid : NULL, &view);
+            if (rc == SLICE_OK && !trim_lines) {
+                slice_release(&view);
+                rc = slice_range(f, local, len, &view);
+            }
+        } else {
+            rc = trim_lines ? slice_range_lines(f, local, len, &view) : slice_range(f, local, len, &view);
+        }
+        if (rc != SLICE_OK) {
+            fprintf(stderr, "Error: chunk %zu of '%s': %s\n", id, segs[seg].path, slice_strerror(rc));
+            exit_code = 1;
+            break;
+        }
+
+        Chunk chunk = { id, segs[seg].path, off, off, view.data, view.len,
+                        view.owned == NULL && f != in.span_file };
+        if (view.len > 0) {
+            chunk.start = origin + view.offset;
+            chunk.end = chunk.start + (off_t)view.len;
+        }
+        rc = sink_write(&sink, &chunk);
+        slice_release(&view);
+        if (in.policy == CACHE_NOREUSE || in.policy == CACHE_DROP_AFTER) {
+            // Let the advice evict what this chunk mapped
+            off_t at = off, to = chunk.end > off + (off_t)len ? chunk.end : off + (off_t)len, piece_at;
+            size_t i = seg, n;
+            while (input_next_piece(&in, &at, to, &i, &piece_at, &n)) {
+                if (in.files[i]) {
+                    slice_unmap_range(in.files[i], piece_at, (off_t)n);
+                }
+            }
+        }
+        if (rc != 0) {
+            exit_code = 1;
+            break;
+        }
+
+        if (off + (off_t)len >= range_end) {
+            id++;
+            break;  // Last chunk reached the end; the rest would be overlap
+        }
+    }
+
+    if (exit_code == 0 && sink_finish(&sink) != 0) {
+        exit_code = 1;
+    }
+    cache_end(&in.cache);
+    if (in.cache_fd >= 0) {
+        close(in.cache_fd);
+    }
+    if (caching->report) {
+        print_cache_report(in.resident, in.pages, range_end > (off_t)start ? (size_t)(range_end - (off_t)start) : 0);
+    }
+    if (debug) {
+        fprintf(stderr, "[DEBUG] Chunks written: %zu (chunk size %zu, overlap %zu)\n",
+                id, chunk_size, overlap);
+        if (seg_count > 1) {
+            fprintf(stderr, "[DEBUG] Files: %zu, chunks copied across file edges: %zu\n",
+                    seg_count, in.spans);
+        }
+        fprintf(stderr, "[DEBUG] Output bytes: %llu\n", sink.bytes_out);
+        if (format == OUT_PACK) {
+            fprintf(stderr, "[DEBUG] Pack index entries: %llu\n", (unsigned long long)sink.entries);
+        }
+        if (records->validate) {
+            fprintf(stderr, "[DEBUG] Invalid records: %zu\n", invalid.count);
+        }
+        if (throttle_active(throttle)) {
+            fprintf(stderr, "[DEBUG] Waited %.3f s for --max-bandwidth/--max-iops\n", throttle->slept);
+        }
+    }
+    sink_free(&sink);
+    slice_close(in.span_file);
+    free(in.span);
+    for (size_t i = 0; i < seg_count; i++) {
+        slice_close(in.files[i]);
+    }
+    free(in.files);
+    return exit_code;
+}
+
+// --output-memfd: the slice is written into an anonymous memfd that replaces
+// stdout, so every output path (including zero-copy fills and holes) lands
+// in it unchanged. Once complete the memfd is sealed against any further
+// change and passed to the consumer listening on a Unix socket with
+// SCM_RIGHTS, alongside its length as a host-order uint64. The consumer can
+// mmap it read-only and trust it not to change under it.
+int open_output_memfd(void) {
+#ifdef __linux__
+    int mfd = memfd_create("slice4-output", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (mfd < 0) {
+        perror("memfd_create");
+        return -1;
+    }
+    if (dup2(mfd, STDOUT_FILENO) < 0) {
+        perror("dup2");
+        close(mfd);
+        return -1;
+    }
+    close(mfd);
+    return 0;
+#else
+    fprintf(stderr, "Error: --output-memfd is only supported on Linux\n");
+    return -1;
+#endif
+}
+
+int send_output_memfd(const char *socket_path, int debug) {
+#ifdef __linux__
+    struct stat st;
+    if (fstat(STDOUT_FILENO, &st) != 0) {
+        perror("fstat on output");
+        return -1;
+    }
+    if (fcntl(STDOUT_FILENO, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        perror("sealing output memfd");
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // Whatever kind of socket the consumer listens on
+    static const int types[] = { SOCK_STREAM, SOCK_SEQPACKET, SOCK_DGRAM };
+    int sock = -1;
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        sock = socket(AF_UNIX, types[i] | SOCK_CLOEXEC, 0);
+        if (sock < 0) {
+            break;
+        }
+        if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            break;
+        }
+        int saved = errno;
+        close(sock);
+        sock = -1;
+        errno = saved;
+        if (errno != EPROTOTYPE) {
+            break;
+        }
+    }
+    if (sock < 0) {
+        fprintf(stderr, "Error: cannot connect to '%s': %s\n", socket_path, strerror(errno));
+        return -1;
+    }
+
+    uint64_t length = (uint64_t)st.st_size;
+    struct iovec iov = { &length, sizeof(length) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    int out_fd = STDOUT_FILENO;
+    memcpy(CMSG_DATA(cmsg), &out_fd, sizeof(int));
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    close(sock);
+    if (n != (ssize_t)sizeof(length)) {
+        perror("sendmsg");
+        return -1;
+    }
+
+    if (debug) {
+        fprintf(stderr, "[DEBUG] Sent sealed memfd of %llu bytes to %s\n",
+                (unsigned long long)length, socket_path);
+    }
+    return 0;
+#else
+    (void)socket_path; (void)debug;
+    return -1;
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    size_t start = (size_t)-1, size = 0;
+    const char *filename = NULL;
+    const char *file_list = NULL;
+    const char *url = NULL;
+    const char *serve_socket = NULL;
+    const char *memfd_socket = NULL;
+    const char *pack_prefix = NULL;
+    const char *compress_name = NULL;
+    CompressMethod compress_method = COMPRESS_GZIP;
+    Compressor *compressor = NULL;
+    int compress_threads = 0;
+    int binary_framing = 0;
+    RangeQuery query;
+    size_t sample_lines = 0;
+    size_t split_parts = 0;
+    const char *match_pattern = NULL, *match_file = NULL;
+    LineMatcher *matcher = NULL;
+    const char *fields_spec = NULL;
+    RecordFormat record_format = RECORDS_LINES;
+    int field_sep_set = 0, validate = 0;
+    InvalidRecords invalid = { 0, 0 };
+    const char *record_start = NULL;
+    int record_start_fixed = 0;  // --record-start-prefix: a literal, not a regex
+    RecordStart *starts = NULL;
+    char *lookahead = NULL;
+    FieldList fields = { .selected = NULL };
+    const char *out_prefix = NULL;
+    uint64_t seed = 0;
+    int seed_set = 0, sample_uniform = 0;
+    double max_bandwidth = 0, max_iops = 0;
+    int idle_io = 0;
+    IoThrottle throttle;
+    CachePolicy cache_policy = CACHE_DEFAULT;
+    int cache_report = 0;
+    CacheCursor cache = { .policy = CACHE_DEFAULT, .fd = -1 };
+    size_t cache_seg = (size_t)-1;  // segment the cursor is on
+    size_t resident_pages = 0, range_pages = 0;
+    int resolved = 0;  // start/size come from a range query
+    size_t chunk_bytes = 0, overlap = 0;
+    OutFormat out_format = OUT_RAW;
+    int chunking = 0;
+    int connections = HTTP_DEFAULT_CONNECTIONS;
+    int debug = 0, trim_lines = 0, break_at_files = 0;
+    int fd = -1;
+    Segment *segs = NULL;
+    size_t seg_count = 0;
+    int is_stream = 0;  // pipe, FIFO or character device: no size, no seeking
+    char *buffer = NULL;
+    LineTrimmer trimmer;
+    int exit_code = 0;
+
+    trimmer_init(&trimmer, 0, 0);
+    query_init(&query);
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--start") && i + 1 < argc) {
+            start = parse_size(argv[++i], "--start");
+        } else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+            size = parse_size(argv[++i], "--size");
+        } else if (!strcmp(argv[i], "--file") && i + 1 < argc) {
+            filename = argv[++i];
+        } else if (!strcmp(argv[i], "--files-from") && i + 1 < argc) {
+            file_list = argv[++i];
+        } else if (!strcmp(argv[i], "--serve") && i + 1 < argc) {
+            serve_socket = argv[++i];
+        } else if (!strcmp(argv[i], "--chunk-size") && i + 1 < argc) {
+            chunk_bytes = parse_size(argv[++i], "--chunk-size");
+            chunking = 1;
+        } else if (!strcmp(argv[i], "--overlap") && i + 1 < argc) {
+            overlap = parse_size(argv[++i], "--overlap");
+        } else if (!strcmp(argv[i], "--out-format") && i + 1 < argc) {
+            if (parse_out_format(argv[++i], &out_format) != 0) {
+                fprintf(stderr, "Invalid value for --out-format: %s\n", argv[i]);
+                return 1;
+            }
+            chunking |= out_format != OUT_RAW;
+        } else if (!strcmp(argv[i], "--since") && i + 1 < argc) {
+            query.since = argv[++i];
+        } else if (!strcmp(argv[i], "--until") && i + 1 < argc) {
+            query.until = argv[++i];
+        } else if (!strcmp(argv[i], "--ts-format") && i + 1 < argc) {
+            query.ts_format = argv[++i];
+        } else if (!strcmp(argv[i], "--key-prefix") && i + 1 < argc) {
+            query.key_prefix = argv[++i];
+        } else if (!strcmp(argv[i], "--field-sep") && i + 1 < argc) {
+            field_sep_set = 1;
+            if (query_parse_separator(argv[++i], &query.field_sep) != 0) {
+                fprintf(stderr, "Invalid value for --field-sep: %s (expected one character or \\t)\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--key-field") && i + 1 < argc) {
+            size_t n = parse_size(argv[++i], "--key-field");
+            if (n > 1000000) {
+                fprintf(stderr, "Invalid value for --key-field: must be at most 1000000\n");
+                return 1;
+            }
+            query.key_field = (int)n;
+        } else if (!strcmp(argv[i], "--sample-lines") && i + 1 < argc) {
+            sample_lines = parse_size(argv[++i], "--sample-lines");
+            if (sample_lines == 0) {
+                fprintf(stderr, "Invalid value for --sample-lines: must be positive\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = parse_size(argv[++i], "--seed");
+            seed_set = 1;
+        } else if (!strcmp(argv[i], "--max-bandwidth") && i + 1 < argc) {
+            if (throttle_parse_rate(argv[++i], &max_bandwidth) != 0) {
+                fprintf(stderr, "Invalid value for --max-bandwidth: %s (expected MB/s > 0)\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--max-iops") && i + 1 < argc) {
+            if (throttle_parse_rate(argv[++i], &max_iops) != 0) {
+                fprintf(stderr, "Invalid value for --max-iops: %s (expected reads per second > 0)\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--idle-io")) {
+            idle_io = 1;
+        } else if (!strcmp(argv[i], "--cache-policy") && i + 1 < argc) {
+            if (parse_cache_policy(argv[++i], &cache_policy) != 0) {
+                fprintf(stderr, "Invalid value for --cache-policy: %s (expected default, sequential, noreuse or drop-after)\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--cache-report")) {
+            cache_report = 1;
+        } else if (!strcmp(argv[i], "--sample-uniform")) {
+            sample_uniform = 1;
+        } else if (!strcmp(argv[i], "--split") && i + 1 < argc) {
+            split_parts = parse_size(argv[++i], "--split");
+            if (split_parts == 0 || split_parts > 1000000) {
+                fprintf(stderr, "Invalid value for --split: must be 1-1000000\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--out-prefix") && i + 1 < argc) {
+            out_prefix = argv[++i];
+        } else if (!strcmp(argv[i], "--shard") && i + 1 < argc) {
+            if (query_parse_shard(argv[++i], &query.shard_index, &query.shard_count) != 0) {
+                fprintf(stderr, "Invalid value for --shard: %s (expected I/N with 0 <= I < N)\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--match") && i + 1 < argc) {
+            match_pattern = argv[++i];
+        } else if (!strcmp(argv[i], "--match-any") && i + 1 < argc) {
+            match_file = argv[++i];
+        } else if (!strcmp(argv[i], "--record-format") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "csv")) {
+                record_format = RECORDS_CSV;
+            } else if (!strcmp(argv[i], "jsonl")) {
+                record_format = RECORDS_JSONL;
+            } else if (strcmp(argv[i], "lines") != 0) {
+                fprintf(stderr, "Invalid value for --record-format: %s (expected lines, csv or jsonl)\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--validate")) {
+            validate = 1;
+        } else if (!strcmp(argv[i], "--record-start") && i + 1 < argc) {
+            record_start = argv[++i];
+            record_start_fixed = 0;
+        } else if (!strcmp(argv[i], "--record-start-prefix") && i + 1 < argc) {
+            record_start = argv[++i];
+            record_start_fixed = 1;
+        } else if (!strcmp(argv[i], "--fields") && i + 1 < argc) {
+            fields_spec = argv[++i];
+        } else if (!strcmp(argv[i], "--framing") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "binary")) {
+                binary_framing = 1;
+            } else if (!strcmp(argv[i], "none")) {
+                binary_framing = 0;
+            } else {
+                fprintf(stderr, "Invalid value for --framing: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--pack-prefix") && i + 1 < argc) {
+            pack_prefix = argv[++i];
+        } else if (!strcmp(argv[i], "--compress") && i + 1 < argc) {
+            compress_name = argv[++i];
+            int rc = parse_compress_method(compress_name, &compress_method);
+            if (rc == -2) {
+                fprintf(stderr, "Error: --compress %s: slice4 was built without it (make slice4 ZSTD=1)\n",
+                        compress_name);
+                return 1;
+            }
+            if (rc != 0) {
+                fprintf(stderr, "Invalid value for --compress: %s\n", compress_name);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--compress-threads") && i + 1 < argc) {
+            size_t n = parse_size(argv[++i], "--compress-threads");
+            if (n == 0 || n > 64) {
+                fprintf(stderr, "Invalid value for --compress-threads: must be 1-64\n");
+                return 1;
+            }
+            compress_threads = (int)n;
+        } else if (!strcmp(argv[i], "--output-memfd") && i + 1 < argc) {
+            memfd_socket = argv[++i];
+        } else if (!strcmp(argv[i], "--url") && i + 1 < argc) {
+            url = argv[++i];
+        } else if (!strcmp(argv[i], "--connections") && i + 1 < argc) {
+            size_t n = parse_size(argv[++i], "--connections");
+            if (n == 0 || n > 64) {
+                fprintf(stderr, "Invalid value for --connections: must be 1-64\n");
+                return 1;
+            }
+            connections = (int)n;
+        } else if (!strcmp(argv[i], "--break-at-files")) {
+            break_at_files = 1;
+        } else if (!strcmp(argv[i], "--debug")) {
+            debug = 1;
+        } else if (!strcmp(argv[i], "--full-lines-only")) {
+            trim_lines = 1;
+        } else if (!strcmp(argv[i], "--help")) {
+            show_help();
+            return 0;
+        } else {
+            fprintf(stderr, "Unknown or incomplete option: %s\n", argv[i]);
+            show_help();
+            return 1;
+        }
+    }
+
+    if (idle_io) {
+        if (throttle_set_idle_io() != 0) {
+            fprintf(stderr, "Warning: cannot use the idle I/O class: %s\n", strerror(errno));
+        } else if (debug) {
+            fprintf(stderr, "[DEBUG] I/O scheduling class: idle\n");
+        }
+    }
+    throttle_init(&throttle, max_bandwidth * THROTTLE_MB, max_iops);
+
+    if (serve_socket != NULL) {
+        return serve(serve_socket, debug);
+    }
+
+    if (binary_framing) {
+        if (out_format != OUT_RAW) {
+            fprintf(stderr, "Error: --framing binary only applies to raw output\n");
+            return 1;
+        }
+        out_format = OUT_FRAMED;
+        chunking = 1;
+    }
+
+    int inputs = (filename != NULL) + (file_list != NULL) + (url != NULL);
+
+    if (record_format != RECORDS_LINES && (filename == NULL || file_list != NULL || url != NULL)) {
+        fprintf(stderr, "Error: --record-format %s needs --file\n",
+                record_format == RECORDS_CSV ? "csv" : "jsonl");
+        return 1;
+    }
+    if (record_format == RECORDS_CSV && !field_sep_set) {
+        query.field_sep = ',';
+    }
+    if (record_format == RECORDS_JSONL && fields_spec != NULL) {
+        fprintf(stderr, "Error: --fields cannot be combined with --record-format jsonl\n");
+        return 1;
+    }
+    if (record_start != NULL) {
+        if (record_format != RECORDS_LINES) {
+            fprintf(stderr, "Error: --record-start cannot be combined with --record-format\n");
+            return 1;
+        }
+        if (fields_spec != NULL) {
+            fprintf(stderr, "Error: --fields cannot be combined with --record-start\n");
+            return 1;
+        }
+        if (filename == NULL || file_list != NULL || url != NULL) {
+            fprintf(stderr, "Error: --record-start needs --file\n");
+            return 1;
+        }
+        record_format = RECORDS_MULTILINE;
+    }
+    if (validate && record_format != RECORDS_JSONL) {
+        fprintf(stderr, "Error: --validate needs --record-format jsonl\n");
+        return 1;
+    }
+
+    if (query_active(&query)) {
+        if (filename == NULL || !strcmp(filename, "-") || file_list != NULL || url != NULL) {
+            fprintf(stderr, "Error: range queries need a regular --file\n");
+            return 1;
+        }
+        if (start != (size_t)-1 || size != 0) {
+            fprintf(stderr, "Error: range queries cannot be combined with --start or --size\n");
+            return 1;
+        }
+        if (query_resolve(&query, filename, &start, &size, debug) != 0) {
+            return 1;
+        }
+        resolved = 1;
+    }
+
+    // When chunking, sampling or splitting, the range defaults to the whole
+    // file
+    if ((chunk_bytes > 0 || sample_lines > 0 || split_parts > 0) && !resolved) {
+        if (start == (size_t)-1) {
+            start = 0;
+        }
+        if (size == 0) {
+            size = SIZE_MAX - start;
+        }
+    }
+
+    if ((!resolved && (start == (size_t)-1 || size == 0)) || inputs == 0) {
+        fprintf(stderr, "Error: --start, --size, and --file (or --files-from, --url) are required.\n");
+        show_help();
+        return 1;
+    }
+
+    if (inputs > 1) {
+        fprintf(stderr, "Error: --file, --files-from and --url are mutually exclusive.\n");
+        return 1;
+    }
+
+    if (SIZE_MAX - start < size) {
+        fprintf(stderr, "Error: start + size causes overflow\n");
+        return 1;
+    }
+
+    if (memfd_socket != NULL && open_output_memfd() != 0) {
+        return 1;
+    }
+
+    if (compress_name != NULL) {
+        if (out_format == OUT_PACK) {
+            fprintf(stderr, "Error: --compress cannot be used with --out-format pack\n");
+            return 1;
+        }
+        // Chunk output feeds the compressor directly so that blocks end at
+        // chunk boundaries; everything else is compressed on its way out
+        compressor = chunking ? compressor_start(compress_method, compress_threads, STDOUT_FILENO)
+                              : compress_stdout_start(compress_method, compress_threads);
+        if (!compressor) {
+            return 1;
+        }
+    }
+
+    if ((match_pattern != NULL || match_file != NULL || fields_spec != NULL) &&
+        (chunking || sample_lines || split_parts || url != NULL)) {
+        fprintf(stderr, "Error: --match and --fields cannot be combined with chunking, --sample-lines, --split or --url\n");
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    if (throttle_active(&throttle) && (sample_lines || split_parts || url != NULL)) {
+        fprintf(stderr, "Error: --max-bandwidth and --max-iops cannot be combined with --sample-lines, --split or --url\n");
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    if ((cache_policy != CACHE_DEFAULT || cache_report) && (sample_lines || split_parts || url != NULL)) {
+        fprintf(stderr, "Error: --cache-policy and --cache-report cannot be combined with --sample-lines, --split or --url\n");
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    if (validate && (sample_lines || split_parts)) {
+        fprintf(stderr, "Error: --validate cannot be combined with --sample-lines or --split\n");
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    if (record_start != NULL) {
+        if (sample_lines || split_parts) {
+            fprintf(stderr, "Error: --record-start cannot be combined with --sample-lines or --split\n");
+            exit_code = 1;
+            goto cleanup;
+        }
+        starts = record_start_new(record_start, record_start_fixed);
+        if (!starts) {
+            exit_code = 1;
+            goto cleanup;
+        }
+        if (debug) {
+            fprintf(stderr, "[DEBUG] Record start pattern is %s\n",
+                    record_start_literal(starts) ? "a literal prefix" : "a regex");
+        }
+    }
+
+    if (split_parts > 0) {
+        if (filename == NULL || !strcmp(filename, "-") || chunking || sample_lines > 0 ||
+            out_prefix == NULL) {
+            fprintf(stderr, "Error: --split needs a regular --file and --out-prefix, and no chunking or sampling\n");
+            exit_code = 1;
+            goto cleanup;
+        }
+        exit_code = slice_split(filename, start, size, split_parts, out_prefix, debug);
+        goto cleanup;
+    }
+
+    if (sample_lines > 0) {
+        if (filename == NULL || !strcmp(filename, "-") || chunking) {
+            fprintf(stderr, "Error: --sample-lines needs a regular --file and no chunking\n");
+            exit_code = 1;
+            goto cleanup;
+        }
+        if (!seed_set) {
+            seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+        }
+        exit_code = slice_sample(filename, start, size, sample_lines, seed, sample_uniform, debug);
+        goto cleanup;
+    }
+
+    if (chunking) {
+        if (url != NULL || (filename != NULL && !strcmp(filename, "-"))) {
+            fprintf(stderr, "Error: --chunk-size and --out-format need a regular --file or --files-from\n");
+            exit_code = 1;
+            goto cleanup;
+        }
+        if (chunk_bytes == 0) {
+            chunk_bytes = size > 0 ? size : 1;  // The whole slice as a single chunk
+        }
+        if ((out_format == OUT_PACK) != (pack_prefix != NULL)) {
+            fprintf(stderr, "Error: --out-format pack and --pack-prefix go together\n");
+            exit_code = 1;
+            goto cleanup;
+        }
+        if (overlap >= chunk_bytes) {
+            fprintf(stderr, "Error: --overlap must be smaller than --chunk-size\n");
+            exit_code = 1;
+            goto cleanup;
+        }
+        Segment whole = { (char *)filename, 0, 0, 0 };  // --file: a single segment
+        if (file_list != NULL) {
+            if (load_file_list(file_list, &segs, &seg_count) != 0) {
+                exit_code = 1;
+                goto cleanup;
+            }
+        } else {
+            struct stat st;
+            if (stat(filename, &st) != 0) {
+                fprintf(stderr, "Error: cannot open file '%s': %s\n", filename, strerror(errno));
+                exit_code = 1;
+                goto cleanup;
+            }
+            if (!S_ISREG(st.st_mode)) {
+                fprintf(stderr, "Error: cannot open file '%s': chunking needs a regular file\n", filename);
+                exit_code = 1;
+                goto cleanup;
+            }
+            whole.size = st.st_size;
+            whole.sparse = is_sparse(&st);
+        }
+        RecordSpec records = { record_format, query.field_sep, starts, validate };
+        CacheSpec caching = { cache_policy, cache_report };
+        exit_code = slice_chunks(file_list != NULL ? segs : &whole, file_list != NULL ? seg_count : 1,
+                                 break_at_files, start, size, chunk_bytes, overlap, trim_lines,
+                                 &records, out_format, pack_prefix, compressor, &throttle,
+                                 &caching, debug);
+        goto cleanup;
+    }
+
+    // A resolved range is already line aligned: trimming would drop its
+    // first line
+    if (resolved) {
+        trim_lines = 0;
+        if (size == 0) {
+            goto cleanup;
+        }
+    }
+
+    if (match_pattern != NULL || match_file != NULL) {
+        if (match_pattern != NULL && match_file != NULL) {
+            fprintf(stderr, "Error: --match and --match-any are mutually exclusive\n");
+            exit_code = 1;
+            goto cleanup;
+        }
+        matcher = match_pattern ? matcher_new(match_pattern) : matcher_load(match_file);
+        if (!matcher) {
+            exit_code = 1;
+            goto cleanup;
+        }
+        if (debug) {
+            fprintf(stderr, "[DEBUG] Filtering lines on %zu pattern(s)\n", matcher_patterns(matcher));
+        }
+    }
+
+    if (fields_spec != NULL) {
+        if (fields_parse(fields_spec, query.field_sep, &fields) != 0) {
+            exit_code = 1;
+            goto cleanup;
+        }
+        fields.records = record_format == RECORDS_CSV;
+    }
+
+    if (url != NULL) {
+        exit_code = slice_url(url, start, size, trim_lines, connections, debug);
+        goto cleanup;
+    }
+
+    if (file_list != NULL) {
+        if (load_file_list(file_list, &segs, &seg_count) != 0) {
+            exit_code = 1;
+            goto cleanup;
+        }
+    } else {
+        // Open file using low-level I/O for better performance
+        fd = strcmp(filename, "-") ? open(filename, O_RDONLY) : dup(STDIN_FILENO);
+        if (fd < 0) {
+            fprintf(stderr, "Error: cannot open file '%s': %s\n", filename, strerror(errno));
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            fprintf(stderr, "Error: cannot stat file '%s': %s\n", filename, strerror(errno));
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        if (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode) || S_ISSOCK(st.st_mode)) {
+            is_stream = 1;
+        } else if (!S_ISREG(st.st_mode)) {
+            fprintf(stderr, "Error: not a regular file: %s\n", filename);
+            exit_code = 1;
+            goto cleanup;
+        } else {
+            segs = malloc(sizeof(Segment));
+            if (!segs) {
+                perror("malloc for segment");
+                exit_code = 1;
+                goto cleanup;
+            }
+            segs[0].path = NULL;  // borrowed from argv, see cleanup
+            segs[0].size = st.st_size;
+            segs[0].base = 0;
+            segs[0].sparse = is_sparse(&st);
+            seg_count = 1;
+        }
+    }
+
+    size_t seg_idx = 0;
+    size_t to_read, chunk_size;
+
+    if (is_stream) {
+        // Streaming input: the size is unknown, so the requested size is the
+        // only hint for the chunk size, and the start is reached by discarding
+        chunk_size = calculate_chunk_size(size, trim_lines, debug);
+        to_read = size;
+
+        if (cache_policy != CACHE_DEFAULT || cache_report) {
+            fprintf(stderr, "Warning: --cache-policy and --cache-report need a regular file, ignored for %s\n", filename);
+        }
+        if (debug) {
+            fprintf(stderr, "[DEBUG] Streaming input: %s\n", filename);
+            fprintf(stderr, "[DEBUG] Calculated chunk size: %zu bytes\n", chunk_size);
+            fprintf(stderr, "[DEBUG] Requested start: %zu\n", start);
+            fprintf(stderr, "[DEBUG] Requested size: %zu\n", size);
+        }
+
+        buffer = malloc(chunk_size);
+        if (!buffer) {
+            perror("malloc for buffer");
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        off_t skipped = skip_stream(fd, start, buffer, chunk_size, debug);
+        if (skipped < 0) {
+            exit_code = 1;
+            goto cleanup;
+        }
+        if ((size_t)skipped < start) {
+            if (debug) {
+                fprintf(stderr, "[DEBUG] Start position %zu is beyond end of stream at %lld\n",
+                        start, (long long)skipped);
+            }
+            goto cleanup;  // Nothing to read
+        }
+    } else {
+        off_t file_size = segs[seg_count - 1].base + segs[seg_count - 1].size;
+
+        if (start >= (size_t)file_size) {
+            if (debug) {
+                fprintf(stderr, "[DEBUG] Start position %zu is beyond file size %lld\n", 
+                        start, (long long)file_size);
+            }
+            goto cleanup;  // Nothing to read
+        }
+
+        // Find the segment holding the first byte of the slice
+        while (seg_idx + 1 < seg_count && (off_t)start >= segs[seg_idx].base + segs[seg_idx].size) {
+            seg_idx++;
+        }
+
+        // With --break-at-files a slice never runs past the end of its file
+        off_t range_end = (off_t)file_size;
+        if (break_at_files) {
+            range_end = segs[seg_idx].base + segs[seg_idx].size;
+        }
+
+        to_read = (start + size > (size_t)range_end) ? (size_t)range_end - start : size;
+
+        if (to_read == 0) {
+            fprintf(stderr, "Error: nothing to read\n");
+            goto cleanup;
+        }
+
+        // Calculate optimal chunk size based on file size
+        chunk_size = calculate_chunk_size((size_t)file_size, trim_lines, debug);
+
+        if (debug) {
+            fprintf(stderr, "[DEBUG] File size: %lld bytes\n", (long long)file_size);
+            if (file_list != NULL) {
+                fprintf(stderr, "[DEBUG] Files in list: %zu, slice starts in '%s'\n",
+                        seg_count, segs[seg_idx].path);
+            }
+            fprintf(stderr, "[DEBUG] Calculated chunk size: %zu bytes\n", chunk_size);
+            fprintf(stderr, "[DEBUG] Requested start: %zu\n", start);
+            fprintf(stderr, "[DEBUG] Requested size: %zu\n", size);
+            fprintf(stderr, "[DEBUG] Actual bytes to read: %zu\n", to_read);
+        }
+
+        // Allocate buffer for chunks
+        buffer = malloc(chunk_size);
+        if (!buffer) {
+            perror("malloc for buffer");
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
+    trimmer_init(&trimmer, trim_lines, start > 0);
+    trimmer.match = matcher;
+    trimmer.fields = fields_spec != NULL ? &fields : NULL;
+    if (starts && (trim_lines || matcher)) {
+        trimmer.starts = starts;
+    }
+    if (record_format == RECORDS_JSONL) {
+        trimmer.jsonl = 1;
+        jsonl_scan_init(&trimmer.json, start);
+        if (validate) {
+            trimmer.json.report = report_invalid_record;
+            trimmer.json.report_arg = &invalid;
+        }
+    }
+    if (record_format == RECORDS_CSV) {
+        trimmer.csv = 1;
+        trimmer.csv_sep = query.field_sep;
+        trimmer.resync = start > 0;
+        // Find the quote state at the start from a fixed window, so that the
+        // result is the same as for a chunk starting there; a stream uses its
+        // first read instead
+        if (trimmer.resync && !is_stream) {
+            char *window = malloc(CSV_RESYNC_WINDOW);
+            ssize_t n = window ? pread(fd, window, CSV_RESYNC_WINDOW, (off_t)start) : -1;
+            if (n >= 0) {
+                trimmer.quoted = csv_resync(window, (size_t)n, trimmer.csv_sep);
+                trimmer.resync = 0;
+            }
+            free(window);
+        }
+        if (debug && !trimmer.resync) {
+            fprintf(stderr, "[DEBUG] CSV quote state at start: %s\n",
+                    trimmer.quoted ? "inside a quoted field" : "outside quotes");
+        }
+    }
+
+    // Read data in chunks, moving on to the next segment whenever the
+    // current one is exhausted. A chunk never straddles two files.
+    size_t total_read = 0, hole_bytes = 0;
+    int need_seek = 1;
+    off_t data_end = -1;  // logical end of the current data extent (sparse files)
+    while (total_read < to_read) {
+        size_t current_chunk = (to_read - total_read < chunk_size) ? (to_read - total_read) : chunk_size;
+
+        if (!is_stream) {
+            off_t pos = (off_t)(start + total_read);
+            off_t seg_end = segs[seg_idx].base + segs[seg_idx].size;
+
+            if (pos >= seg_end) {
+                if (seg_idx + 1 >= seg_count) {
+                    break;  // Logical EOF
+                }
+                seg_idx++;
+                if (fd >= 0) close(fd);
+                fd = -1;
+                need_seek = 1;
+                data_end = -1;
+                continue;
+            }
+
+            if (fd < 0) {
+                fd = open(segs[seg_idx].path, O_RDONLY);
+                if (fd < 0) {
+                    fprintf(stderr, "Error: cannot open file '%s': %s\n", segs[seg_idx].path, strerror(errno));
+                    exit_code = 1;
+                    goto cleanup;
+                }
+                if (debug) {
+                    fprintf(stderr, "[DEBUG] Reading '%s' from offset %lld\n",
+                            segs[seg_idx].path, (long long)(pos - segs[seg_idx].base));
+                }
+            }
+
+            // --cache-policy / --cache-report: per segment, over the part
+            // of it the slice covers
+            if (cache_seg != seg_idx) {
+                off_t local = pos - segs[seg_idx].base;
+                off_t local_end = (off_t)(start + to_read) - segs[seg_idx].base;
+                if (local_end > segs[seg_idx].size) {
+                    local_end = segs[seg_idx].size;
+                }
+                cache_end(&cache);
+                cache_begin(&cache, cache_policy, fd, local, local_end);
+                if (cache_report) {
+                    size_t resident, pages;
+                    if (cache_residency(fd, local, local_end - local, &resident, &pages) == 0) {
+                        resident_pages += resident;
+                        range_pages += pages;
+                    }
+                }
+                cache_seg = seg_idx;
+            }
+
+#ifdef SEEK_DATA
+            // Sparse file: jump over holes instead of reading them as zeros.
+            // data_end caches the end of the extent being read, so probing
+            // happens once per extent rather than once per chunk.
+            if (segs[seg_idx].sparse && pos >= data_end) {
+                off_t local = pos - segs[seg_idx].base;
+                off_t data = lseek(fd, local, SEEK_DATA);
+                if (data < 0 && errno != ENXIO) {
+                    perror("lseek SEEK_DATA");
+                    exit_code = 1;
+                    goto cleanup;
+                }
+                off_t hole_end = (data < 0) ? segs[seg_idx].size : data;  // ENXIO: hole runs to EOF
+                if (hole_end > local) {
+                    size_t hole = (size_t)(hole_end - local);
+                    if (hole > to_read - total_read) {
+                        hole = to_read - total_read;
+                    }
+                    if (debug) {
+                        fprintf(stderr, "[DEBUG] Skipping hole of %zu bytes at offset %lld\n",
+                                hole, (long long)pos);
+                    }
+                    if (trimmer_feed_zeros(&trimmer, hole) != 0) {
+                        exit_code = 1;
+                        goto cleanup;
+                    }
+                    total_read += hole;
+                    hole_bytes += hole;
+                    need_seek = 1;
+                    continue;
+                }
+                off_t hole_start = lseek(fd, local, SEEK_HOLE);
+                if (hole_start < 0) {
+                    hole_start = segs[seg_idx].size;
+                }
+                data_end = segs[seg_idx].base + hole_start;
+                need_seek = 1;
+            }
+#endif
+
+            if (need_seek) {
+                off_t local = pos - segs[seg_idx].base;
+                if (lseek(fd, local, SEEK_SET) != local) {
+                    perror("lseek");
+                    exit_code = 1;
+                    goto cleanup;
+                }
+                need_seek = 0;
+            }
+
+            if ((off_t)current_chunk > seg_end - pos) {
+                current_chunk = (size_t)(seg_end - pos);
+            }
+            if (segs[seg_idx].sparse && (off_t)current_chunk > data_end - pos) {
+                current_chunk = (size_t)(data_end - pos);
+            }
+        }
+
+        // --max-bandwidth / --max-iops: pace reads (and zero-copy transfers,
+        // which read the file just the same)
+        current_chunk = throttle_read_size(&throttle, current_chunk);
+        throttle_acquire(&throttle, current_chunk);
+
+        if (!is_stream) {
+            cache_advance(&cache, (off_t)(start + total_read) - segs[seg_idx].base, current_chunk);
+            ssize_t copied = trimmer_emit_fd(&trimmer, fd, current_chunk);
+            if (copied < 0) {
+                exit_code = 1;
+                goto cleanup;
+            }
+            if (copied > 0) {
+                total_read += (size_t)copied;
+                continue;
+            }
+        }
+
+        ssize_t bytes_read = read(fd, buffer, current_chunk);
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            if (bytes_read < 0) {
+                perror("read");
+                exit_code = 1;
+            }
+            break;  // EOF or error
+        }
+
+        if (trimmer_feed(&trimmer, buffer, (size_t)bytes_read) != 0) {
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        total_read += bytes_read;
+    }
+
+    if (trimmer.starts) {
+        // Whether the last record ends with the slice depends on the line
+        // after it
+        size_t ahead = 0;
+        lookahead = malloc(RECORD_START_PEEK);
+        if (!lookahead) {
+            perror("malloc for record lookahead");
+            exit_code = 1;
+            goto cleanup;
+        }
+        while (fd >= 0 && total_read == to_read && ahead < RECORD_START_PEEK) {
+            ssize_t n = is_stream ? read(fd, lookahead + ahead, RECORD_START_PEEK - ahead)
+                                  : pread(fd, lookahead + ahead, RECORD_START_PEEK - ahead,
+                                          (off_t)(start + total_read + ahead));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;  // End of input, or an error the slice itself did not hit
+            }
+            ahead += (size_t)n;
+        }
+        if (trimmer_finish_records(&trimmer, lookahead, ahead) != 0) {
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
+    if (trimmer_finish(&trimmer) != 0) {
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    if (cache_report && !is_stream) {
+        print_cache_report(resident_pages, range_pages, total_read);
+    }
+
+    if (debug) {
+        fprintf(stderr, "[DEBUG] Total bytes read: %zu\n", total_read);
+        if (hole_bytes > 0) {
+            fprintf(stderr, "[DEBUG] Bytes in holes (not read): %zu\n", hole_bytes);
+        }
+        if (throttle_active(&throttle)) {
+            fprintf(stderr, "[DEBUG] Waited %.3f s for --max-bandwidth/--max-iops\n", throttle.slept);
+        }
+        if (trimmer.zero_copy > 0) {
+            fprintf(stderr, "[DEBUG] Copied to output with %s\n",
+                    trimmer.zero_copy == 1 ? "copy_file_range" : "sendfile");
+        }
+        if (validate) {
+            fprintf(stderr, "[DEBUG] Invalid records: %zu\n", invalid.count);
+        }
+        if (matcher || fields_spec) {
+            fprintf(stderr, "[DEBUG] After filtering: output length = %zu\n", trimmer.written);
+        } else if (trim_lines) {
+            fprintf(stderr, "[DEBUG] After trimming: output length = %zu\n", trimmer.written);
+            if (trimmer.written == 0 && total_read > 0) {
+                fprintf(stderr, "[DEBUG] Warning: All content was trimmed due to --full-lines-only\n");
+                fprintf(stderr, "[DEBUG] Hint: Try using 'linex' tool to analyze line structure\n");
+            }
+        }
+    }
+
+cleanup:
+    cache_end(&cache);
+    free(buffer);
+    free(lookahead);
+    trimmer_free(&trimmer);
+    matcher_free(matcher);
+    record_start_free(starts);
+    fields_free(&fields);
+    if (file_list != NULL) {
+        for (size_t i = 0; i < seg_count; i++) {
+            free(segs[i].path);
+        }
+    }
+    free(segs);
+    if (fd >= 0) close(fd);
+    if (compressor != NULL) {
+        int rc = chunking ? compressor_end(compressor) : compress_stdout_end(compressor);
+        if (rc != 0) {
+            exit_code = 1;
+        }
+    }
+    if (memfd_socket != NULL && exit_code == 0 && send_output_memfd(memfd_socket, debug) != 0) {
+        exit_code = 1;
+    }
+    return exit_code;
+}
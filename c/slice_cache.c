@@ -0,0 +1,152 @@
+#define _GNU_SOURCE  // mincore(2)
+#define _FILE_OFFSET_BITS 64
+#include "slice_cache.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define CACHE_MAP_WINDOW ((off_t)1 << 30)  // cache_residency maps at most 1 GiB at a time
+#define CACHE_DROP_BATCH ((off_t)2 << 20)  // noreuse: bytes read between drops
+
+int parse_cache_policy(const char *name, CachePolicy *out) {
+    static const char *const names[] = { "default", "sequential", "noreuse", "drop-after" };
+    for (int i = 0; i < 4; i++) {
+        if (!strcmp(name, names[i])) {
+            *out = (CachePolicy)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static size_t page_size(void) {
+    long p = sysconf(_SC_PAGESIZE);
+    return p > 0 ? (size_t)p : 4096;
+}
+
+// mincore vector for the pages of [start, start + len), whose start is
+// page aligned. Returns 0, or -1 if fd cannot be mapped.
+static int residency_vector(int fd, off_t start, size_t len, unsigned char *vec) {
+    void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, start);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    int rc = mincore(map, len, vec);
+    munmap(map, len);
+    return rc;
+}
+
+int cache_residency(int fd, off_t start, off_t len, size_t *resident, size_t *pages) {
+    size_t page = page_size();
+    off_t from = start - start % (off_t)page, end = start + len;
+    unsigned char *vec = NULL;
+    *resident = 0;
+    *pages = 0;
+    for (off_t at = from; at < end; at += CACHE_MAP_WINDOW) {
+        size_t span = (size_t)(end - at < CACHE_MAP_WINDOW ? end - at : CACHE_MAP_WINDOW);
+        size_t n = (span + page - 1) / page;
+        if (!vec && !(vec = malloc((size_t)(CACHE_MAP_WINDOW / (off_t)page)))) {
+            return -1;
+        }
+        if (residency_vector(fd, at, span, vec) != 0) {
+            free(vec);
+            return -1;
+        }
+        for (size_t i = 0; i < n; i++) {
+            *resident += vec[i] & 1;
+        }
+        *pages += n;
+    }
+    free(vec);
+    return 0;
+}
+
+void cache_begin(CacheCursor *c, CachePolicy policy, int fd, off_t start, off_t end) {
+    memset(c, 0, sizeof(*c));
+    c->policy = policy;
+    c->fd = policy == CACHE_DEFAULT ? -1 : fd;
+    c->start = start;
+    c->end = end;
+    c->advised = start;
+    c->dropped = start;
+    c->page = page_size();
+    if (c->fd < 0 || end <= start) {
+        c->fd = -1;
+        return;
+    }
+    if (policy == CACHE_SEQUENTIAL || policy == CACHE_NOREUSE) {
+        posix_fadvise(fd, start, end - start, POSIX_FADV_SEQUENTIAL);
+    }
+    if (policy == CACHE_NOREUSE) {
+        posix_fadvise(fd, start, end - start, POSIX_FADV_NOREUSE);
+        c->resident_from = start - start % (off_t)c->page;
+        size_t span = (size_t)(end - c->resident_from);
+        c->resident = malloc((span + c->page - 1) / c->page);
+        // Without the snapshot hot pages cannot be told apart: drop nothing
+        if (c->resident && residency_vector(fd, c->resident_from, span, c->resident) != 0) {
+            free(c->resident);
+            c->resident = NULL;
+        }
+    }
+}
+
+// noreuse: drop the pages before `limit` that were not cached before reading
+// began. The page cache holds large folios that are only evicted when a
+// DONTNEED range covers them whole, so drops are batched and every batch
+// starts CACHE_DROP_BATCH before the previous one ended.
+static void drop_behind(CacheCursor *c, off_t limit) {
+    off_t from = c->dropped - CACHE_DROP_BATCH;
+    if (from < c->resident_from) {
+        from = c->resident_from;
+    }
+    size_t first = (size_t)((from - c->resident_from) / (off_t)c->page);
+    size_t last = (size_t)((limit - c->resident_from) / (off_t)c->page);  // exclusive
+    size_t run = first;
+    for (size_t i = first; i <= last; i++) {
+        if (i < last && !(c->resident[i] & 1)) {
+            continue;
+        }
+        if (i > run) {
+            posix_fadvise(c->fd, c->resident_from + (off_t)(run * c->page),
+                          (off_t)((i - run) * c->page), POSIX_FADV_DONTNEED);
+        }
+        run = i + 1;
+    }
+    c->dropped = c->resident_from + (off_t)(last * c->page);
+}
+
+void cache_advance(CacheCursor *c, off_t pos, size_t len) {
+    if (c->fd < 0) {
+        return;
+    }
+    off_t next = pos + (off_t)len;
+    if (c->policy == CACHE_SEQUENTIAL && next + CACHE_READAHEAD / 2 > c->advised) {
+        // Keep CACHE_READAHEAD bytes past this read in flight, topping up
+        // by half of it at a time
+        off_t to = next + CACHE_READAHEAD < c->end ? next + CACHE_READAHEAD : c->end;
+        if (to > c->advised) {
+            posix_fadvise(c->fd, c->advised, to - c->advised, POSIX_FADV_WILLNEED);
+            c->advised = to;
+        }
+    } else if (c->policy == CACHE_NOREUSE && c->resident && pos - c->dropped >= CACHE_DROP_BATCH) {
+        drop_behind(c, pos < c->end ? pos : c->end);
+    }
+}
+
+void cache_end(CacheCursor *c) {
+    if (c->fd >= 0) {
+        if (c->policy == CACHE_NOREUSE && c->resident) {
+            // The last page counts as read even if the range ends inside it
+            off_t last = c->end + (off_t)c->page - 1;
+            drop_behind(c, last - (last - c->resident_from) % (off_t)c->page);
+        } else if (c->policy == CACHE_DROP_AFTER) {
+            posix_fadvise(c->fd, c->start, c->end - c->start, POSIX_FADV_DONTNEED);
+        }
+    }
+    free(c->resident);
+    c->resident = NULL;
+    c->fd = -1;
+}
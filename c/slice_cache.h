@@ -0,0 +1,59 @@
+#ifndef SLICE_CACHE_H
+#define SLICE_CACHE_H
+
+// Page-cache policy for slice4's reads (--cache-policy) and residency
+// reporting (--cache-report).
+//
+//   default     leave the kernel's heuristics alone
+//   sequential  POSIX_FADV_SEQUENTIAL on the range, and POSIX_FADV_WILLNEED
+//               for CACHE_READAHEAD bytes past the current read
+//   noreuse     POSIX_FADV_NOREUSE, and POSIX_FADV_DONTNEED behind the read
+//               cursor for the pages the read itself brought in: residency
+//               of the range is taken with mincore(2) before the first read
+//               (one byte per page), so pages that were already cached
+//               (someone else's hot data) stay cached
+//   drop-after  POSIX_FADV_DONTNEED on the whole range once it is read
+//
+// Advice is best effort: errors (a pipe, a filesystem without page cache)
+// are ignored.
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define CACHE_READAHEAD (8 * 1024 * 1024)  // sequential: bytes advised past the current read
+
+typedef enum {
+    CACHE_DEFAULT,
+    CACHE_SEQUENTIAL,
+    CACHE_NOREUSE,
+    CACHE_DROP_AFTER
+} CachePolicy;
+
+typedef struct {
+    CachePolicy policy;
+    int fd;                 // -1 when inactive
+    off_t start, end;       // byte range being read
+    off_t advised;          // sequential: WILLNEED issued up to here
+    off_t dropped;          // noreuse: DONTNEED issued up to here
+    unsigned char *resident;// noreuse: mincore vector of the range before reading
+    off_t resident_from;    // page-aligned offset of resident[0]
+    size_t page;
+} CacheCursor;
+
+// Map a --cache-policy name to its policy. Returns 0, or -1 if unknown.
+int parse_cache_policy(const char *name, CachePolicy *out);
+
+// Start reading [start, end) of fd under `policy`
+void cache_begin(CacheCursor *c, CachePolicy policy, int fd, off_t start, off_t end);
+
+// The reader is about to read [pos, pos + len)
+void cache_advance(CacheCursor *c, off_t pos, size_t len);
+
+// The reader is done with the range
+void cache_end(CacheCursor *c);
+
+// Count the pages of [start, start + len) of fd that are in the page cache.
+// Returns 0, or -1 if fd cannot be mapped.
+int cache_residency(int fd, off_t start, off_t len, size_t *resident, size_t *pages);
+
+#endif /* SLICE_CACHE_H */
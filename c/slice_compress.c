@@ -0,0 +1,503 @@
+#define _FILE_OFFSET_BITS 64
+#include "slice_compress.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef SLICE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define COMPRESS_MAX_THREADS 64
+#define ZSTD_LEVEL 3
+#define ZSTD_SKIPPABLE_MAGIC 0x184D2A5EU  // Skippable frame holding the seek table
+#define ZSTD_SEEKABLE_MAGIC 0x8F92EAB1U
+
+enum { SLOT_FREE, SLOT_FILLED, SLOT_BUSY, SLOT_DONE };
+
+typedef struct {
+    char *in;
+    size_t in_len;
+    char *out;
+    size_t out_len;
+    size_t out_cap;
+    int state;
+    int rc;
+} CompressSlot;
+
+struct Compressor {
+    CompressMethod method;
+    int out_fd;
+    int threads;
+    pthread_t *workers;
+    CompressSlot *slots;      // ring of 2 * threads blocks
+    size_t slot_count;
+    size_t next_fill;         // sequence number of the block being filled
+    size_t next_compress;     // next block a worker will take
+    size_t next_write;        // next block to be written out
+    int stopping;
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    uint32_t *frames;         // zstd seek table: compressed, decompressed size pairs
+    size_t frame_count;
+    size_t frame_cap;
+
+    // compress_stdout_start
+    int pipe_fd;
+    int saved_stdout;
+    pthread_t reader;
+};
+
+int parse_compress_method(const char *name, CompressMethod *out) {
+    if (!strcmp(name, "gzip")) {
+        *out = COMPRESS_GZIP;
+        return 0;
+    }
+    if (!strcmp(name, "zstd")) {
+#ifdef SLICE_HAVE_ZSTD
+        *out = COMPRESS_ZSTD;
+        return 0;
+#else
+        return -2;
+#endif
+    }
+    return -1;
+}
+
+static int write_full(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Each block becomes one gzip member; concatenated members are a valid gzip
+// stream (RFC 1952)
+static int compress_gzip(CompressSlot *slot) {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
+    }
+
+    size_t bound = deflateBound(&z, (uLong)slot->in_len) + 64;
+    if (bound > slot->out_cap) {
+        char *grown = realloc(slot->out, bound);
+        if (!grown) {
+            deflateEnd(&z);
+            return -1;
+        }
+        slot->out = grown;
+        slot->out_cap = bound;
+    }
+
+    // zlib counts in uInt, so very large blocks go in pieces
+    size_t in_left = slot->in_len, out_used = 0;
+    const char *in = slot->in;
+    int rc;
+    do {
+        size_t in_now = in_left < UINT_MAX ? in_left : UINT_MAX;
+        size_t out_now = slot->out_cap - out_used < UINT_MAX ? slot->out_cap - out_used : UINT_MAX;
+        z.next_in = (Bytef *)in;
+        z.avail_in = (uInt)in_now;
+        z.next_out = (Bytef *)slot->out + out_used;
+        z.avail_out = (uInt)out_now;
+        rc = deflate(&z, in_now == in_left ? Z_FINISH : Z_NO_FLUSH);
+        in += in_now - z.avail_in;
+        in_left -= in_now - z.avail_in;
+        out_used += out_now - z.avail_out;
+    } while (rc == Z_OK);
+
+    deflateEnd(&z);
+    slot->out_len = out_used;
+    return rc == Z_STREAM_END ? 0 : -1;
+}
+
+#ifdef SLICE_HAVE_ZSTD
+static int compress_zstd(CompressSlot *slot, ZSTD_CCtx *cctx) {
+    size_t bound = ZSTD_compressBound(slot->in_len);
+    if (bound > slot->out_cap) {
+        char *grown = realloc(slot->out, bound);
+        if (!grown) {
+            return -1;
+        }
+        slot->out = grown;
+        slot->out_cap = bound;
+    }
+    size_t n = ZSTD_compressCCtx(cctx, slot->out, slot->out_cap, slot->in, slot->in_len, ZSTD_LEVEL);
+    if (ZSTD_isError(n)) {
+        fprintf(stderr, "Error: zstd: %s\n", ZSTD_getErrorName(n));
+        return -1;
+    }
+    slot->out_len = n;
+    return 0;
+}
+#endif
+
+static void *compress_worker(void *arg) {
+    Compressor *c = arg;
+#ifdef SLICE_HAVE_ZSTD
+    ZSTD_CCtx *cctx = c->method == COMPRESS_ZSTD ? ZSTD_createCCtx() : NULL;
+#endif
+
+    pthread_mutex_lock(&c->lock);
+    for (;;) {
+        CompressSlot *slot = &c->slots[c->next_compress % c->slot_count];
+        if (c->next_compress < c->next_fill && slot->state == SLOT_FILLED) {
+            c->next_compress++;
+            slot->state = SLOT_BUSY;
+            pthread_mutex_unlock(&c->lock);
+
+#ifdef SLICE_HAVE_ZSTD
+            int rc = c->method == COMPRESS_ZSTD
+                   ? (cctx ? compress_zstd(slot, cctx) : -1)
+                   : compress_gzip(slot);
+#else
+            int rc = compress_gzip(slot);
+#endif
+
+            pthread_mutex_lock(&c->lock);
+            slot->rc = rc;
+            slot->state = SLOT_DONE;
+            pthread_cond_broadcast(&c->cond);
+            continue;
+        }
+        if (c->stopping) {
+            break;
+        }
+        pthread_cond_wait(&c->cond, &c->lock);
+    }
+    pthread_mutex_unlock(&c->lock);
+
+#ifdef SLICE_HAVE_ZSTD
+    ZSTD_freeCCtx(cctx);
+#endif
+    return NULL;
+}
+
+// Write out finished blocks in order. Called with the lock held; the lock
+// is dropped around the write itself.
+static void write_done_blocks(Compressor *c) {
+    for (;;) {
+        CompressSlot *slot = &c->slots[c->next_write % c->slot_count];
+        if (c->next_write >= c->next_fill || slot->state != SLOT_DONE) {
+            return;
+        }
+        pthread_mutex_unlock(&c->lock);
+
+        int rc = slot->rc;
+        if (rc != 0) {
+            fprintf(stderr, "Error: compressing block %zu failed\n", c->next_write);
+        } else if (write_full(c->out_fd, slot->out, slot->out_len) != 0) {
+            perror("write");
+            rc = -1;
+        }
+        if (rc == 0 && c->method == COMPRESS_ZSTD) {
+            if (c->frame_count == c->frame_cap) {
+                size_t new_cap = c->frame_cap ? c->frame_cap * 2 : 256;
+                uint32_t *grown = realloc(c->frames, new_cap * 2 * sizeof(uint32_t));
+                if (!grown) {
+                    perror("realloc for seek table");
+                    rc = -1;
+                } else {
+                    c->frames = grown;
+                    c->frame_cap = new_cap;
+                }
+            }
+            if (rc == 0) {
+                c->frames[2 * c->frame_count] = (uint32_t)slot->out_len;
+                c->frames[2 * c->frame_count + 1] = (uint32_t)slot->in_len;
+                c->frame_count++;
+            }
+        }
+
+        pthread_mutex_lock(&c->lock);
+        if (rc != 0) {
+            c->failed = 1;
+        }
+        slot->in_len = 0;
+        slot->state = SLOT_FREE;
+        c->next_write++;
+        pthread_cond_broadcast(&c->cond);
+    }
+}
+
+// Queue the block being filled and wait for a free slot to fill next
+static int submit_block(Compressor *c) {
+    pthread_mutex_lock(&c->lock);
+    CompressSlot *slot = &c->slots[c->next_fill % c->slot_count];
+    if (slot->in_len > 0) {
+        slot->state = SLOT_FILLED;
+        c->next_fill++;
+        pthread_cond_broadcast(&c->cond);
+    }
+
+    for (;;) {
+        write_done_blocks(c);
+        if (c->slots[c->next_fill % c->slot_count].state == SLOT_FREE) {
+            break;
+        }
+        pthread_cond_wait(&c->cond, &c->lock);
+    }
+    int rc = c->failed ? -1 : 0;
+    pthread_mutex_unlock(&c->lock);
+    return rc;
+}
+
+Compressor *compressor_start(CompressMethod method, int threads, int out_fd) {
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > COMPRESS_MAX_THREADS) {
+        threads = COMPRESS_MAX_THREADS;
+    }
+
+    Compressor *c = calloc(1, sizeof(Compressor));
+    if (!c) {
+        perror("calloc for compressor");
+        return NULL;
+    }
+    c->method = method;
+    c->out_fd = out_fd;
+    c->pipe_fd = -1;
+    c->saved_stdout = -1;
+    c->slot_count = 2 * (size_t)threads;
+    c->slots = calloc(c->slot_count, sizeof(CompressSlot));
+    c->workers = calloc((size_t)threads, sizeof(pthread_t));
+    if (!c->slots || !c->workers) {
+        perror("calloc for compressor");
+        free(c->slots);
+        free(c->workers);
+        free(c);
+        return NULL;
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->cond, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&c->workers[i], NULL, compress_worker, c) != 0) {
+            break;
+        }
+        c->threads++;
+    }
+    if (c->threads == 0) {
+        fprintf(stderr, "Error: cannot start compression threads\n");
+        compressor_end(c);
+        return NULL;
+    }
+    return c;
+}
+
+int compressor_write(Compressor *c, const char *data, size_t len) {
+    while (len > 0) {
+        CompressSlot *slot = &c->slots[c->next_fill % c->slot_count];
+        if (!slot->in) {
+            slot->in = malloc(COMPRESS_BLOCK_SIZE);
+            if (!slot->in) {
+                perror("malloc for compression block");
+                return -1;
+            }
+        }
+        size_t room = COMPRESS_BLOCK_SIZE - slot->in_len;
+        if (room > len) {
+            room = len;
+        }
+        memcpy(slot->in + slot->in_len, data, room);
+        slot->in_len += room;
+        data += room;
+        len -= room;
+
+        if (slot->in_len == COMPRESS_BLOCK_SIZE && submit_block(c) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int compressor_boundary(Compressor *c) {
+    // gzip has no index to align: its members are cut by size alone
+    if (c->method == COMPRESS_ZSTD &&
+        c->slots[c->next_fill % c->slot_count].in_len >= COMPRESS_MIN_FRAME) {
+        return submit_block(c);
+    }
+    return 0;
+}
+
+// Seek table as a skippable frame: one (compressed, decompressed) size pair
+// per frame, then the frame count, a descriptor without checksums and the
+// seekable magic number. All fields are little endian.
+static int write_seek_table(Compressor *c) {
+    size_t len = 8 + c->frame_count * 8 + 9;
+    unsigned char *table = malloc(len);
+    if (!table) {
+        perror("malloc for seek table");
+        return -1;
+    }
+
+    size_t pos = 0;
+    uint32_t words[2] = { ZSTD_SKIPPABLE_MAGIC, (uint32_t)(len - 8) };
+    for (size_t i = 0; i < 2 + 2 * c->frame_count + 1; i++) {
+        uint32_t v = i < 2 ? words[i] : i < 2 + 2 * c->frame_count ? c->frames[i - 2]
+                                                                  : (uint32_t)c->frame_count;
+        for (int b = 0; b < 4; b++) {
+            table[pos++] = (unsigned char)(v >> (8 * b));
+        }
+    }
+    table[pos++] = 0;  // Seek_Table_Descriptor: no checksums
+    for (int b = 0; b < 4; b++) {
+        table[pos++] = (unsigned char)(ZSTD_SEEKABLE_MAGIC >> (8 * b));
+    }
+
+    int rc = write_full(c->out_fd, (const char *)table, len);
+    if (rc != 0) {
+        perror("write");
+    }
+    free(table);
+    return rc;
+}
+
+int compressor_end(Compressor *c) {
+    if (!c) {
+        return 0;
+    }
+    int rc = 0;
+    if (c->threads > 0) {
+        rc = submit_block(c);
+
+        // Drain: write every block still in flight
+        pthread_mutex_lock(&c->lock);
+        while (c->next_write < c->next_fill) {
+            write_done_blocks(c);
+            if (c->next_write < c->next_fill) {
+                pthread_cond_wait(&c->cond, &c->lock);
+            }
+        }
+        if (c->failed) {
+            rc = -1;
+        }
+        c->stopping = 1;
+        pthread_cond_broadcast(&c->cond);
+        pthread_mutex_unlock(&c->lock);
+
+        for (int i = 0; i < c->threads; i++) {
+            pthread_join(c->workers[i], NULL);
+        }
+        if (rc == 0 && c->method == COMPRESS_ZSTD) {
+            rc = write_seek_table(c);
+        }
+    }
+
+    for (size_t i = 0; i < c->slot_count; i++) {
+        free(c->slots[i].in);
+        free(c->slots[i].out);
+    }
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->cond);
+    free(c->slots);
+    free(c->workers);
+    free(c->frames);
+    free(c);
+    return rc;
+}
+
+// Record a failure seen outside the workers
+static void set_failed(Compressor *c) {
+    pthread_mutex_lock(&c->lock);
+    c->failed = 1;
+    pthread_mutex_unlock(&c->lock);
+}
+
+static void *stdout_reader(void *arg) {
+    Compressor *c = arg;
+    int broken = 0;
+    char *buf = malloc(COMPRESS_BLOCK_SIZE);
+    if (!buf) {
+        perror("malloc for compression reader");
+        set_failed(c);
+        return NULL;
+    }
+
+    for (;;) {
+        ssize_t n = read(c->pipe_fd, buf, COMPRESS_BLOCK_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        // After a failure keep draining, so writers to stdout never block
+        if (!broken && compressor_write(c, buf, (size_t)n) != 0) {
+            broken = 1;
+            set_failed(c);
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+Compressor *compress_stdout_start(CompressMethod method, int threads) {
+    int saved = dup(STDOUT_FILENO);
+    int fds[2];
+    if (saved < 0 || pipe(fds) != 0) {
+        perror("pipe for compression");
+        if (saved >= 0) close(saved);
+        return NULL;
+    }
+
+    Compressor *c = compressor_start(method, threads, saved);
+    if (!c || dup2(fds[1], STDOUT_FILENO) < 0) {
+        if (c) perror("dup2");
+        compressor_end(c);
+        close(fds[0]);
+        close(fds[1]);
+        close(saved);
+        return NULL;
+    }
+    close(fds[1]);
+    c->pipe_fd = fds[0];
+    c->saved_stdout = saved;
+
+    if (pthread_create(&c->reader, NULL, stdout_reader, c) != 0) {
+        fprintf(stderr, "Error: cannot start compression reader\n");
+        dup2(saved, STDOUT_FILENO);
+        close(fds[0]);
+        compressor_end(c);
+        close(saved);
+        return NULL;
+    }
+    return c;
+}
+
+int compress_stdout_end(Compressor *c) {
+    // Putting the original stdout back closes the pipe's only write end, so
+    // the reader sees EOF once everything written so far has been consumed
+    int saved = c->saved_stdout;
+    int rc = dup2(saved, STDOUT_FILENO) < 0 ? -1 : 0;
+    pthread_join(c->reader, NULL);
+    close(c->pipe_fd);
+    if (c->failed) {
+        rc = -1;
+    }
+    if (compressor_end(c) != 0) {
+        rc = -1;
+    }
+    close(saved);
+    return rc;
+}
@@ -0,0 +1,52 @@
+#ifndef SLICE_COMPRESS_H
+#define SLICE_COMPRESS_H
+
+// Parallel block compression for slice4's output (--compress).
+//
+// Output is cut into blocks that a pool of worker threads compresses
+// independently; the thread that feeds the compressor writes the results in
+// order. Every block is a complete gzip member or zstd frame, so the output
+// is a valid .gz or .zst file. zstd output ends with a seek table in the
+// zstd seekable format, listing every frame, so readers can decompress any
+// block on its own.
+
+#include <stddef.h>
+
+typedef enum {
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD    // only when built with SLICE_HAVE_ZSTD
+} CompressMethod;
+
+#define COMPRESS_BLOCK_SIZE (1024 * 1024)  // Uncompressed bytes per block, at most
+#define COMPRESS_MIN_FRAME (COMPRESS_BLOCK_SIZE / 4)  // zstd: shortest block cut at a boundary
+
+typedef struct Compressor Compressor;
+
+// Map a --compress name to its method. Returns 0, -1 if unknown, or -2 if
+// the method was not compiled in.
+int parse_compress_method(const char *name, CompressMethod *out);
+
+// Compressor writing to out_fd with `threads` workers (0: one per CPU)
+Compressor *compressor_start(CompressMethod method, int threads, int out_fd);
+
+// Append data to the current block. Blocks are cut every
+// COMPRESS_BLOCK_SIZE bytes, so memory use does not depend on the input.
+int compressor_write(Compressor *c, const char *data, size_t len);
+
+// Tell the compressor that a record ends here. zstd cuts the block early
+// once it holds COMPRESS_MIN_FRAME bytes, so most frames start with a chunk
+// (a chunk larger than a block still spans several frames); gzip ignores
+// boundaries.
+int compressor_boundary(Compressor *c);
+
+// Compress and write everything still buffered, stop the workers and free
+// the compressor. Returns 0, or -1 if any block failed.
+int compressor_end(Compressor *c);
+
+// Route everything written to stdout through a compressor: stdout becomes
+// a pipe that a reader thread feeds to the compressor, which writes to the
+// original stdout. compress_stdout_end restores stdout.
+Compressor *compress_stdout_start(CompressMethod method, int threads);
+int compress_stdout_end(Compressor *c);
+
+#endif /* SLICE_COMPRESS_H */
@@ -0,0 +1,292 @@
+#include "slice_fields.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define FIELDS_BLOCK 64
+
+int fields_parse(const char *spec, char sep, FieldList *out) {
+    memset(out, 0, sizeof(*out));
+    out->sep = sep;
+
+    // First pass for the highest field, second to mark the selection
+    for (int pass = 0; pass < 2; pass++) {
+        const char *p = spec;
+        while (*p) {
+            char *end;
+            unsigned long from = strtoul(p, &end, 10), to = from;
+            int ok = end != p && from >= 1 && from <= FIELDS_MAX;
+            if (ok && *end == '-') {
+                p = end + 1;
+                to = strtoul(p, &end, 10);
+                ok = end != p && to >= from && to <= FIELDS_MAX;
+            }
+            if (!ok || (*end != ',' && *end != '\0') || (*end == ',' && end[1] == '\0')) {
+                fprintf(stderr, "Invalid value for --fields: %s (expected a list such as 1,4,7 or 2-5)\n", spec);
+                free(out->selected);
+                out->selected = NULL;
+                return -1;
+            }
+            if (pass == 0) {
+                out->max_field = to > out->max_field ? to : out->max_field;
+            } else {
+                memset(out->selected + from, 1, to - from + 1);
+            }
+            p = *end ? end + 1 : end;
+        }
+        if (pass == 0 && !(out->selected = calloc(out->max_field + 1, 1))) {
+            fprintf(stderr, "Error: cannot allocate the field list\n");
+            return -1;
+        }
+        if (out->max_field == 0) {
+            fprintf(stderr, "Invalid value for --fields: empty list\n");
+            fields_free(out);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void fields_free(FieldList *f) {
+    free(f->selected);
+    f->selected = NULL;
+}
+
+// Bit i of each mask is set when p[i] is the separator, a quote, a newline
+static inline void classify(const char *p, char sep, uint64_t *seps, uint64_t *quotes,
+                            uint64_t *newlines) {
+#if defined(__SSE2__)
+    const __m128i vsep = _mm_set1_epi8(sep), vquote = _mm_set1_epi8('"'), vnl = _mm_set1_epi8('\n');
+    uint64_t s = 0, q = 0, n = 0;
+    for (int i = 0; i < FIELDS_BLOCK; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        s |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vsep)) << i;
+        q |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vquote)) << i;
+        n |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vnl)) << i;
+    }
+    *seps = s;
+    *quotes = q;
+    *newlines = n;
+#elif defined(__aarch64__)
+    // Weight each lane by its bit, then add neighbouring lanes until every
+    // byte of the result holds eight lanes' bits
+    static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x16_t w = vld1q_u8(weights);
+    uint8x16_t v0 = vld1q_u8((const uint8_t *)p), v1 = vld1q_u8((const uint8_t *)p + 16);
+    uint8x16_t v2 = vld1q_u8((const uint8_t *)p + 32), v3 = vld1q_u8((const uint8_t *)p + 48);
+    const char wanted[3] = { sep, '"', '\n' };
+    uint64_t *masks[3] = { seps, quotes, newlines };
+    for (int k = 0; k < 3; k++) {
+        uint8x16_t c = vdupq_n_u8((uint8_t)wanted[k]);
+        uint8x16_t m0 = vandq_u8(vceqq_u8(v0, c), w), m1 = vandq_u8(vceqq_u8(v1, c), w);
+        uint8x16_t m2 = vandq_u8(vceqq_u8(v2, c), w), m3 = vandq_u8(vceqq_u8(v3, c), w);
+        uint8x16_t sum = vpaddq_u8(vpaddq_u8(m0, m1), vpaddq_u8(m2, m3));
+        sum = vpaddq_u8(sum, sum);
+        *masks[k] = vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+    }
+#else
+    uint64_t s = 0, q = 0, n = 0;
+    for (int i = 0; i < FIELDS_BLOCK; i++) {
+        s |= (uint64_t)(p[i] == sep) << i;
+        q |= (uint64_t)(p[i] == '"') << i;
+        n |= (uint64_t)(p[i] == '\n') << i;
+    }
+    *seps = s;
+    *quotes = q;
+    *newlines = n;
+#endif
+}
+
+// Bit i is the XOR of bits 0..i: set inside quoted spans (from an opening
+// quote up to, not including, its closing quote)
+static inline uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Bits a..b-1 (b up to 64)
+static inline uint64_t bit_span(int a, int b) {
+    uint64_t below_b = b >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << b) - 1;
+    return below_b & ~(((uint64_t)1 << a) - 1);
+}
+
+typedef struct {
+    int open;            // a quoted span continues into the next block
+    size_t closed_at;    // offset of the last closing quote, SIZE_MAX if none
+} LineQuotes;
+
+// Quoted spans of plain lines. A quote opens a span only as the first byte
+// of a field, or right after a closing quote (the "" escape); elsewhere it
+// is an ordinary byte, so a stray quote in TSV data cannot hide the rest of
+// the line. A newline ends any span, so quote state never crosses lines and
+// does not depend on where the caller's buffers split.
+static uint64_t line_quotes(const char *data, size_t base, uint64_t quotes, uint64_t newlines,
+                            char sep, LineQuotes *q) {
+    if (!quotes && !q->open) {
+        return 0;
+    }
+    uint64_t quoted = 0, events = quotes | newlines;
+    int from = 0;  // bit of the opening quote, 0 for a span carried in
+    while (events) {
+        int i = __builtin_ctzll(events);
+        size_t at = base + (size_t)i;
+        events &= events - 1;
+        if ((newlines >> i) & 1) {
+            if (q->open) {
+                quoted |= bit_span(from, i);
+                q->open = 0;
+            }
+        } else if (q->open) {
+            quoted |= bit_span(from, i);
+            q->open = 0;
+            q->closed_at = at;
+        } else if (at == 0 || data[at - 1] == sep || data[at - 1] == '\n' || q->closed_at == at - 1) {
+            q->open = 1;
+            from = i;
+        }
+    }
+    if (q->open) {
+        quoted |= bit_span(from, 64);
+    }
+    return quoted;
+}
+
+size_t fields_project(const FieldList *f, const char *data, size_t len, char *out) {
+    char *o = out;
+    size_t field = 1;         // field number at the current position
+    size_t field_start = 0;   // offset of its first byte
+    int line_has_output = 0;
+    uint64_t inside = 0;      // all ones while a quoted span continues into the next block
+    LineQuotes line_q = { 0, SIZE_MAX };
+    char tail[FIELDS_BLOCK];
+
+    for (size_t base = 0; base < len; base += FIELDS_BLOCK) {
+        const char *block = data + base;
+        if (len - base < FIELDS_BLOCK) {
+            // Zero padding is neither separator, quote nor newline
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, block, len - base);
+            block = tail;
+        }
+        uint64_t seps, quotes, newlines;
+        classify(block, f->sep, &seps, &quotes, &newlines);
+        uint64_t quoted;
+        if (f->records) {
+            quoted = prefix_xor(quotes) ^ inside;
+            inside = (uint64_t)0 - (quoted >> 63);
+        } else {
+            quoted = line_quotes(data, base, quotes, newlines, f->sep, &line_q);
+        }
+
+        uint64_t bits = f->records ? (seps | newlines) & ~quoted : (seps & ~quoted) | newlines;
+        while (bits) {
+            if (field > f->max_field) {
+                // Nothing more to keep on this line: jump to its end
+                uint64_t nl = bits & newlines & (f->records ? ~quoted : ~(uint64_t)0);
+                if (!nl) {
+                    break;
+                }
+                bits &= ~((nl & (0 - nl)) - 1);
+            }
+            size_t at = base + (size_t)__builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (field <= f->max_field && f->selected[field]) {
+                if (line_has_output) {
+                    *o++ = f->sep;
+                }
+                memcpy(o, data + field_start, at - field_start);
+                o += at - field_start;
+                line_has_output = 1;
+            }
+            if (data[at] == '\n') {
+                *o++ = '\n';
+                field = 1;
+                line_has_output = 0;
+            } else {
+                field++;
+            }
+            field_start = at + 1;
+        }
+    }
+
+    // Last line without a newline
+    if (len > 0 && data[len - 1] != '\n' && field <= f->max_field && f->selected[field]) {
+        if (line_has_output) {
+            *o++ = f->sep;
+        }
+        memcpy(o, data + field_start, len - field_start);
+        o += len - field_start;
+    }
+    return (size_t)(o - out);
+}
+
+int csv_resync(const char *text, size_t len, char sep) {
+    int parity = 0;  // quotes seen so far, mod 2
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] != '"') {
+            continue;
+        }
+        // A byte that cannot border a quote at a field edge
+        int next_plain = i + 1 < len && text[i + 1] != sep && text[i + 1] != '\n' &&
+                         text[i + 1] != '\r' && text[i + 1] != '"';
+        int prev_plain = i > 0 && text[i - 1] != sep && text[i - 1] != '\n' &&
+                         text[i - 1] != '\r' && text[i - 1] != '"';
+        if (next_plain) {
+            return parity;       // Opening: outside quotes just before it
+        }
+        if (prev_plain) {
+            return parity ^ 1;   // Closing: inside quotes just before it
+        }
+        parity ^= 1;
+    }
+    return 0;
+}
+
+void csv_scan(const char *data, size_t len, int *quoted, size_t *first, size_t *last) {
+    uint64_t inside = (uint64_t)0 - (uint64_t)(*quoted != 0);
+    char tail[FIELDS_BLOCK];
+    *first = SIZE_MAX;
+    if (last) {
+        *last = SIZE_MAX;
+    }
+
+    for (size_t base = 0; base < len; base += FIELDS_BLOCK) {
+        const char *block = data + base;
+        if (len - base < FIELDS_BLOCK) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, block, len - base);
+            block = tail;
+        }
+        uint64_t seps, quotes, newlines;
+        classify(block, '"', &seps, &quotes, &newlines);
+        uint64_t quoted_bits = prefix_xor(quotes) ^ inside;
+        inside = (uint64_t)0 - (quoted_bits >> 63);
+
+        uint64_t ends = newlines & ~quoted_bits;
+        if (ends) {
+            if (*first == SIZE_MAX) {
+                *first = base + (size_t)__builtin_ctzll(ends) + 1;
+                if (!last) {
+                    return;
+                }
+            }
+            *last = base + 63 - (size_t)__builtin_clzll(ends) + 1;
+        }
+    }
+    if (last) {
+        *quoted = inside != 0;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef SLICE_FIELDS_H
+#define SLICE_FIELDS_H
+
+// Column projection and CSV records for slice4 (--fields, --field-sep,
+// --record-format csv).
+//
+// Lines are split into fields at the separator, except inside double quotes
+// (RFC 4180: a quoted field may hold separators, and "" stands for a quote).
+// On plain lines a quote only opens a quoted field as the field's first
+// byte, and quoting ends at the newline. Selected fields are copied
+// verbatim, quotes included, so the output is valid CSV/TSV again. Input is
+// classified 64 bytes at a time into bitmasks of separators, quotes and
+// newlines (SSE2 on x86-64, NEON on AArch64, a scalar loop elsewhere); a
+// prefix XOR over the quote mask marks the quoted spans, and only the
+// remaining separator and newline bits are visited.
+//
+// The same masks find CSV record ends: newlines outside quoted fields.
+
+#include <stddef.h>
+
+#define FIELDS_MAX 1000000   // Highest field number accepted
+#define CSV_RESYNC_WINDOW 65536  // Bytes examined to find the quote state mid-file
+
+typedef struct {
+    unsigned char *selected;  // selected[i] != 0 if field i (from 1) is kept
+    size_t max_field;         // highest selected field
+    char sep;
+    int records;              // --record-format csv: quoted newlines do not end a line
+} FieldList;
+
+// Parse a list such as "1,4,7" or "2-5,9" (fields counted from 1). Fields
+// are output in file order, as cut(1) does. Returns 0, or -1 with a message.
+int fields_parse(const char *spec, char sep, FieldList *out);
+
+// Project the lines in data[0..len). data holds whole lines; the last one
+// may lack its newline. out needs room for len bytes. Quote state starts
+// afresh on each call (plain lines also reset it at every newline). Returns
+// the number of bytes written.
+size_t fields_project(const FieldList *f, const char *data, size_t len, char *out);
+
+void fields_free(FieldList *f);
+
+// Quote state (1 inside a quoted field) at text[0], where text starts at
+// an arbitrary offset of a CSV file. A quote followed by a byte other than
+// a separator, newline or quote opens a field, and one preceded by such a
+// byte closes it; the first quote in text that shows either fixes the state,
+// counting back over the quotes before it. Returns 0 if no quote in text
+// decides.
+int csv_resync(const char *text, size_t len, char sep);
+
+// Find record ends (newlines outside quotes) in data[0..len), which starts
+// in quote state *quoted; *quoted is updated to the state after data.
+// Stores the offset just past the first record end in *first and just past
+// the last in *last, or SIZE_MAX if there is none. With last == NULL the
+// scan stops at the first record end, and *quoted is left unchanged.
+void csv_scan(const char *data, size_t len, int *quoted, size_t *first, size_t *last);
+
+#endif /* SLICE_FIELDS_H */
@@ -0,0 +1,364 @@
+#include "slice_json.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define JSON_SIMD 1
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define JSON_SIMD 1
+#else
+#define JSON_SIMD 0
+#endif
+
+#define JSON_BLOCK 32
+
+// Escape character for each byte: 0 to copy it as is, 'u' for \u00XX
+static const unsigned char escape_table[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    ['"'] = '"',
+    ['\\'] = '\\',
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static char *escape_byte(char *out, unsigned char c) {
+    unsigned char e = escape_table[c];
+    *out++ = '\\';
+    if (e != 'u') {
+        *out++ = (char)e;
+        return out;
+    }
+    memcpy(out, "u00", 3);
+    out[3] = hex_digits[c >> 4];
+    out[4] = hex_digits[c & 0xf];
+    return out + 5;
+}
+
+#if JSON_SIMD
+// Index of the first byte in p[0..32) that needs escaping, or 32
+static inline unsigned first_special(const char *p) {
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+    // Unsigned byte <= 0x1f exactly when min(byte, 0x1f) == byte
+    __m128i ma = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(a, quote), _mm_cmpeq_epi8(a, backslash)),
+                              _mm_cmpeq_epi8(_mm_min_epu8(a, control), a));
+    __m128i mb = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(b, quote), _mm_cmpeq_epi8(b, backslash)),
+                              _mm_cmpeq_epi8(_mm_min_epu8(b, control), b));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(ma) | ((uint32_t)_mm_movemask_epi8(mb) << 16);
+    return mask ? (unsigned)__builtin_ctz(mask) : JSON_BLOCK;
+#else
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t control = vdupq_n_u8(0x1f);
+    for (unsigned half = 0; half < JSON_BLOCK; half += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)p + half);
+        uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)),
+                                vcleq_u8(v, control));
+        // Narrow to one nibble per byte to get a 64-bit mask
+        uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+        if (bits) {
+            return half + ((unsigned)__builtin_ctzll(bits) >> 2);
+        }
+    }
+    return JSON_BLOCK;
+#endif
+}
+#endif
+
+size_t slice_json_escape(const char *in, size_t len, char *out) {
+    char *start = out;
+    size_t i = 0;
+
+#if JSON_SIMD
+    while (len - i >= JSON_BLOCK) {
+        unsigned n = first_special(in + i);
+        memcpy(out, in + i, n);
+        out += n;
+        i += n;
+        if (n < JSON_BLOCK) {
+            out = escape_byte(out, (unsigned char)in[i++]);
+        }
+    }
+#endif
+
+    while (i < len) {
+        unsigned char c = (unsigned char)in[i++];
+        if (escape_table[c]) {
+            out = escape_byte(out, c);
+        } else {
+            *out++ = (char)c;
+        }
+    }
+    return (size_t)(out - start);
+}
+
+// --- JSON Lines records
+
+#define JSONL_BLOCK 64
+
+typedef struct {
+    uint64_t quotes, backslashes, newlines, opens, closes, squares;
+} JsonMasks;
+
+#if defined(__SSE2__)
+static inline uint64_t eq_mask(const __m128i v[4], char c) {
+    const __m128i b = _mm_set1_epi8(c);
+    uint64_t m = 0;
+    for (int i = 0; i < 4; i++) {
+        m |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v[i], b)) << (16 * i);
+    }
+    return m;
+}
+#elif defined(__aarch64__)
+static inline uint64_t eq_mask(const uint8x16_t v[4], char c) {
+    // Weight each lane by its bit, then add neighbouring lanes until every
+    // byte of the result holds eight lanes' bits
+    static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x16_t w = vld1q_u8(weights), b = vdupq_n_u8((uint8_t)c);
+    uint8x16_t m0 = vandq_u8(vceqq_u8(v[0], b), w), m1 = vandq_u8(vceqq_u8(v[1], b), w);
+    uint8x16_t m2 = vandq_u8(vceqq_u8(v[2], b), w), m3 = vandq_u8(vceqq_u8(v[3], b), w);
+    uint8x16_t sum = vpaddq_u8(vpaddq_u8(m0, m1), vpaddq_u8(m2, m3));
+    sum = vpaddq_u8(sum, sum);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+}
+#else
+static inline uint64_t eq_mask(const char *p, char c) {
+    uint64_t m = 0;
+    for (int i = 0; i < JSONL_BLOCK; i++) {
+        m |= (uint64_t)(p[i] == c) << i;
+    }
+    return m;
+}
+#endif
+
+static inline void classify_json(const char *p, JsonMasks *m) {
+#if defined(__SSE2__)
+    __m128i v[4];
+    for (int i = 0; i < 4; i++) {
+        v[i] = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+    }
+#elif defined(__aarch64__)
+    uint8x16_t v[4];
+    for (int i = 0; i < 4; i++) {
+        v[i] = vld1q_u8((const uint8_t *)p + 16 * i);
+    }
+#else
+    const char *v = p;
+#endif
+    uint64_t lsquare = eq_mask(v, '['), rsquare = eq_mask(v, ']');
+    m->quotes = eq_mask(v, '"');
+    m->backslashes = eq_mask(v, '\\');
+    m->newlines = eq_mask(v, '\n');
+    m->opens = eq_mask(v, '{') | lsquare;
+    m->closes = eq_mask(v, '}') | rsquare;
+    m->squares = lsquare | rsquare;
+}
+
+// Bytes escaped by a preceding odd run of backslashes; *carry says whether
+// the first byte is escaped and receives the same for the next block
+static inline uint64_t escaped_bytes(uint64_t backslashes, uint64_t *carry) {
+    const uint64_t even = 0x5555555555555555ULL;
+    backslashes &= ~*carry;
+    uint64_t follows = (backslashes << 1) | *carry;
+    uint64_t odd_starts = backslashes & ~even & ~follows;
+    uint64_t even_runs;
+    *carry = __builtin_add_overflow(odd_starts, backslashes, &even_runs);
+    return (even ^ (even_runs << 1)) & follows;
+}
+
+static inline uint64_t json_prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+void jsonl_scan_init(JsonlScan *s, unsigned long long offset) {
+    memset(s, 0, sizeof(*s));
+    s->broken = offset > 0;
+    s->offset = offset;
+    s->record_start = offset;
+}
+
+void jsonl_scan_free(JsonlScan *s) {
+    free(s->ends);
+    s->ends = NULL;
+}
+
+static int starts_record(char c) {
+    return c == '{' || c == '[';
+}
+
+// A record ends just before data[at]
+static int end_record(JsonlScan *s, size_t at, size_t *first, size_t *last) {
+    unsigned long long end = s->offset + at;
+    if (s->problem && s->report) {
+        s->report(s->record_start, end, s->problem, s->report_arg);
+    }
+    s->record_start = end;
+    s->problem = NULL;
+    s->broken = 0;
+    s->in_string = 0;
+    s->escaped = 0;
+    s->depth = 0;
+    s->at_line_start = 0;
+    if (*first == SIZE_MAX) {
+        *first = at;
+    }
+    *last = at;
+    if (s->collect) {
+        if (s->ends_len == s->ends_cap) {
+            size_t cap = s->ends_cap ? s->ends_cap * 2 : 1024;
+            size_t *grown = realloc(s->ends, cap * sizeof(size_t));
+            if (!grown) {
+                return -1;
+            }
+            s->ends = grown;
+            s->ends_cap = cap;
+        }
+        s->ends[s->ends_len++] = at;
+    }
+    return 0;
+}
+
+int jsonl_scan(JsonlScan *s, const char *data, size_t len, size_t *first, size_t *last) {
+    *first = SIZE_MAX;
+    *last = SIZE_MAX;
+    s->ends_len = 0;
+    size_t pos = 0;
+    char tail[JSONL_BLOCK];
+
+    // A newline inside a value ended the previous data
+    if (len > 0 && s->at_line_start) {
+        s->at_line_start = 0;
+        if (starts_record(data[0])) {
+            if (!s->broken && !s->problem) {
+                s->problem = s->in_string ? "newline inside a string" : "unterminated value";
+            }
+            if (end_record(s, 0, first, last) != 0) {
+                return -1;
+            }
+        } else if (s->in_string) {
+            if (!s->broken && !s->problem) {
+                s->problem = "newline inside a string";
+            }
+            s->broken = 1;
+        }
+    }
+
+    while (pos < len) {
+        if (s->broken) {
+            // Skip to a line that starts a record
+            const char *nl = memchr(data + pos, '\n', len - pos);
+            if (!nl) {
+                break;
+            }
+            pos = (size_t)(nl - data) + 1;
+            if (pos == len) {
+                s->at_line_start = 1;
+            } else if (starts_record(data[pos]) && end_record(s, pos, first, last) != 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        size_t n = len - pos < JSONL_BLOCK ? len - pos : JSONL_BLOCK;
+        const char *block = data + pos;
+        if (n < JSONL_BLOCK) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, block, n);
+            block = tail;
+        }
+        JsonMasks m;
+        classify_json(block, &m);
+        uint64_t carry = s->escaped;
+        uint64_t escaped = escaped_bytes(m.backslashes, &carry);
+        uint64_t strings = json_prefix_xor(m.quotes & ~escaped) ^ ((uint64_t)0 - (uint64_t)s->in_string);
+        uint64_t valid = n == JSONL_BLOCK ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+        uint64_t events = (((m.opens | m.closes) & ~strings) | m.newlines) & valid;
+
+        size_t restart = SIZE_MAX;  // state changed: rescan from here
+        while (events) {
+            unsigned bit = (unsigned)__builtin_ctzll(events);
+            uint64_t b = (uint64_t)1 << bit;
+            events &= events - 1;
+            size_t at = pos + bit;
+
+            if (m.opens & b) {
+                s->kinds = (s->kinds << 1) | ((m.squares & b) != 0);
+                s->depth++;
+            } else if (m.closes & b) {
+                if (s->depth == 0) {
+                    s->problem = "unbalanced bracket";
+                    s->broken = 1;
+                    restart = at + 1;
+                    break;
+                }
+                if (s->depth <= 64 && (s->kinds & 1) != ((m.squares & b) != 0) && !s->problem) {
+                    s->problem = "mismatched bracket";
+                }
+                s->kinds >>= 1;
+                s->depth--;
+            } else {
+                int in_string = (strings & b) != 0;
+                if (!in_string && s->depth == 0) {
+                    if (end_record(s, at + 1, first, last) != 0) {
+                        return -1;
+                    }
+                    // State is unchanged (outside strings, depth 0): keep going
+                    continue;
+                }
+                if (at + 1 == len) {
+                    // Decide with the next data
+                    s->in_string = in_string;
+                    s->escaped = 0;
+                    s->at_line_start = 1;
+                    restart = len;
+                    break;
+                }
+                if (starts_record(data[at + 1])) {
+                    if (!s->problem) {
+                        s->problem = in_string ? "newline inside a string" : "unterminated value";
+                    }
+                    if (end_record(s, at + 1, first, last) != 0) {
+                        return -1;
+                    }
+                    restart = at + 1;
+                    break;
+                }
+                if (in_string) {
+                    if (!s->problem) {
+                        s->problem = "newline inside a string";
+                    }
+                    s->broken = 1;
+                    restart = at + 1;
+                    break;
+                }
+            }
+        }
+
+        if (restart != SIZE_MAX) {
+            pos = restart;
+            continue;
+        }
+        // Carry the string and escape state past the last valid byte
+        s->in_string = (int)((strings >> (n - 1)) & 1);
+        s->escaped = n == JSONL_BLOCK ? carry : (escaped >> n) & 1;
+        pos += n;
+    }
+
+    s->offset += len;
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef SLICE_JSON_H
+#define SLICE_JSON_H
+
+// JSON string escaping for --out-format jsonl, and JSON Lines record
+// boundaries for --record-format jsonl.
+//
+// Bytes that JSON requires to be escaped (", \ and control bytes below 0x20)
+// are found 32 at a time with SSE2 on x86-64 or NEON on AArch64, and the
+// clean runs between them are copied with memcpy; other targets use a
+// table-driven scalar loop. All other bytes, including UTF-8 sequences, are
+// copied unchanged.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Worst case output size: every byte becomes \u00XX
+#define SLICE_JSON_ESCAPE_MAX(len) ((len) * 6)
+
+// Escape len bytes of in into out, which must have room for
+// SLICE_JSON_ESCAPE_MAX(len) bytes. No quotes are added. Returns the number
+// of bytes written.
+size_t slice_json_escape(const char *in, size_t len, char *out);
+
+// Record boundaries in JSON Lines input whose values may be pretty-printed
+// over several lines. A record ends at a newline outside strings with all
+// brackets closed. Input is classified 64 bytes at a time into bitmasks of
+// quotes, backslashes, brackets and newlines; escaped quotes are removed
+// with the odd-backslash-run trick and a prefix XOR marks the strings (as
+// in simdjson), so only brackets outside strings and newlines are visited.
+//
+// Malformed input cannot swallow the rest of the file: when a newline is
+// reached inside a string or an unclosed value and the next line starts
+// with { or [ at column 0, the broken record ends there. A raw newline
+// inside a string makes the record broken until such a line. A scan that
+// starts mid-file is in that state too, as its position in the structure
+// is unknown.
+typedef void (*jsonl_report_fn)(unsigned long long start, unsigned long long end,
+                                const char *why, void *arg);
+
+typedef struct {
+    int broken;             // structure lost: waiting for a line starting a record
+    int in_string;
+    uint64_t escaped;       // 1 if the next byte is escaped by a backslash
+    size_t depth;
+    uint64_t kinds;         // innermost 64 open brackets, bit set for [
+    int at_line_start;      // the last byte scanned was a newline inside a value
+    const char *problem;    // why the current record is invalid, NULL if it is not
+    unsigned long long offset;       // input offset of the next byte to scan
+    unsigned long long record_start; // input offset of the current record
+    jsonl_report_fn report; // called at the end of each invalid record (--validate)
+    void *report_arg;
+    size_t *ends;           // if collect is set: record ends found by the last scan
+    size_t ends_len;
+    size_t ends_cap;
+    int collect;
+} JsonlScan;
+
+// Start scanning at input offset `offset`; mid-file the first record is
+// treated as broken (and not reported)
+void jsonl_scan_init(JsonlScan *s, unsigned long long offset);
+
+// Scan data[0..len), continuing from the state left by the previous call.
+// Stores the offsets just past the first and last record end in *first and
+// *last, or SIZE_MAX if there is none; an end at 0 means the record ended
+// with the previous call's data. Returns 0, or -1 if out of memory.
+int jsonl_scan(JsonlScan *s, const char *data, size_t len, size_t *first, size_t *last);
+
+void jsonl_scan_free(JsonlScan *s);
+
+#endif /* SLICE_JSON_H */
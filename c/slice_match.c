@@ -0,0 +1,410 @@
+#define _GNU_SOURCE  // memmem(3)
+#include "slice_match.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <regex.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MATCH_SIMD 1
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define MATCH_SIMD 1
+#else
+#define MATCH_SIMD 0
+#endif
+
+#define MATCH_BLOCK 16
+#define MATCH_ACCEPT 0x80000000U             // Set on transitions into a matching state
+#define MATCH_MAX_TABLE (1UL << 30)          // 1 GiB of transitions at most
+
+struct LineMatcher {
+    // One pattern
+    char *pattern;
+    size_t pattern_len;
+
+    // Aho-Corasick over byte classes: next = delta[state * classes + class_of[byte]]
+    size_t count;
+    uint8_t class_of[256];
+    size_t classes;
+    uint32_t *delta;
+};
+
+// --- One pattern
+
+#if MATCH_SIMD
+// Bit i set when p[i] == first and p[i + last_at] == last, for i in [0, 16)
+static inline uint32_t candidates(const char *p, size_t last_at, char first, char last) {
+#if defined(__SSE2__)
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + last_at));
+    __m128i m = _mm_and_si128(_mm_cmpeq_epi8(a, _mm_set1_epi8(first)),
+                              _mm_cmpeq_epi8(b, _mm_set1_epi8(last)));
+    return (uint32_t)_mm_movemask_epi8(m);
+#else
+    uint8x16_t a = vld1q_u8((const uint8_t *)p);
+    uint8x16_t b = vld1q_u8((const uint8_t *)p + last_at);
+    uint8x16_t m = vandq_u8(vceqq_u8(a, vdupq_n_u8((uint8_t)first)),
+                            vceqq_u8(b, vdupq_n_u8((uint8_t)last)));
+    // Narrow to one nibble per byte, then keep one bit of each nibble
+    uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    uint32_t mask = 0;
+    for (bits &= 0x1111111111111111ULL; bits; bits &= bits - 1) {
+        mask |= 1U << (__builtin_ctzll(bits) >> 2);
+    }
+    return mask;
+#endif
+}
+#endif
+
+static const char *find_literal(const LineMatcher *m, const char *text, size_t len) {
+    const char *pat = m->pattern;
+    size_t n = m->pattern_len;
+    if (n > len) {
+        return NULL;
+    }
+    if (n == 1) {
+        return memchr(text, pat[0], len);
+    }
+
+    size_t i = 0;
+#if MATCH_SIMD
+    while (len - i >= n - 1 + MATCH_BLOCK) {
+        uint32_t mask = candidates(text + i, n - 1, pat[0], pat[n - 1]);
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(text + i + bit + 1, pat + 1, n - 2) == 0) {
+                return text + i + bit;
+            }
+            mask &= mask - 1;
+        }
+        i += MATCH_BLOCK;
+    }
+#endif
+    return memmem(text + i, len - i, pat, n);
+}
+
+// --- Pattern sets
+
+typedef struct {
+    char **items;
+    size_t *lens;
+    size_t count;
+} PatternList;
+
+static int build_automaton(LineMatcher *m, const PatternList *list) {
+    // Bytes that occur in no pattern share class 0
+    size_t total = 1;
+    memset(m->class_of, 0, sizeof(m->class_of));
+    m->classes = 1;
+    for (size_t p = 0; p < list->count; p++) {
+        total += list->lens[p];
+        for (size_t i = 0; i < list->lens[p]; i++) {
+            unsigned char c = (unsigned char)list->items[p][i];
+            if (m->class_of[c] == 0) {
+                m->class_of[c] = (uint8_t)m->classes++;
+            }
+        }
+    }
+    if (total >= MATCH_ACCEPT || total * m->classes > MATCH_MAX_TABLE / sizeof(uint32_t)) {
+        fprintf(stderr, "Error: pattern set too large (%zu bytes)\n", total - 1);
+        return -1;
+    }
+
+    size_t classes = m->classes;
+    uint32_t *delta = calloc(total * classes, sizeof(uint32_t));
+    uint32_t *fail = calloc(total, sizeof(uint32_t));
+    uint32_t *queue = malloc(total * sizeof(uint32_t));
+    uint8_t *accept = calloc(total, 1);
+    if (!delta || !fail || !queue || !accept) {
+        fprintf(stderr, "Error: cannot allocate the pattern automaton\n");
+        free(delta);
+        free(fail);
+        free(queue);
+        free(accept);
+        return -1;
+    }
+
+    // Trie; 0 doubles as "no edge yet" since no edge leads back to the root
+    size_t states = 1;
+    for (size_t p = 0; p < list->count; p++) {
+        uint32_t s = 0;
+        for (size_t i = 0; i < list->lens[p]; i++) {
+            uint32_t *edge = &delta[s * classes + m->class_of[(unsigned char)list->items[p][i]]];
+            if (*edge == 0) {
+                *edge = (uint32_t)states++;
+            }
+            s = *edge;
+        }
+        accept[s] = 1;
+    }
+
+    // Breadth first, fill the missing edges from the failure state, whose
+    // row is already complete
+    size_t head = 0, tail = 0;
+    for (size_t c = 0; c < classes; c++) {
+        if (delta[c] != 0) {
+            queue[tail++] = delta[c];
+        }
+    }
+    while (head < tail) {
+        uint32_t s = queue[head++];
+        accept[s] |= accept[fail[s]];
+        for (size_t c = 0; c < classes; c++) {
+            uint32_t *edge = &delta[s * classes + c];
+            uint32_t via_fail = delta[fail[s] * classes + c];
+            if (*edge == 0) {
+                *edge = via_fail;
+            } else {
+                fail[*edge] = via_fail;
+                queue[tail++] = *edge;
+            }
+        }
+    }
+
+    // Mark transitions into matching states so the scan needs one load per byte
+    for (size_t i = 0; i < states * classes; i++) {
+        if (accept[delta[i]]) {
+            delta[i] |= MATCH_ACCEPT;
+        }
+    }
+
+    free(fail);
+    free(queue);
+    free(accept);
+    m->delta = delta;
+    return 0;
+}
+
+static const char *find_any(const LineMatcher *m, const char *text, size_t len) {
+    const uint32_t *delta = m->delta;
+    size_t classes = m->classes;
+    uint32_t s = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint32_t next = delta[s * classes + m->class_of[(unsigned char)text[i]]];
+        if (next & MATCH_ACCEPT) {
+            return text + i;
+        }
+        s = next;
+    }
+    return NULL;
+}
+
+// --- Interface
+
+LineMatcher *matcher_new(const char *pattern) {
+    if (pattern[0] == '\0' || strchr(pattern, '\n')) {
+        fprintf(stderr, "Error: --match pattern must be non-empty and on one line\n");
+        return NULL;
+    }
+    LineMatcher *m = calloc(1, sizeof(LineMatcher));
+    if (!m || !(m->pattern = strdup(pattern))) {
+        fprintf(stderr, "Error: cannot allocate the pattern\n");
+        free(m);
+        return NULL;
+    }
+    m->pattern_len = strlen(pattern);
+    m->count = 1;
+    return m;
+}
+
+LineMatcher *matcher_load(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "Error: cannot open pattern file '%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    PatternList list = { NULL, NULL, 0 };
+    size_t cap = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t n;
+    int ok = 1;
+    while (ok && (n = getline(&line, &line_cap, in)) >= 0) {
+        if (n > 0 && line[n - 1] == '\n') {
+            line[--n] = '\0';
+        }
+        if (n > 0 && line[n - 1] == '\r') {
+            line[--n] = '\0';  // CRLF pattern file
+        }
+        if (n == 0) {
+            continue;
+        }
+        if (list.count == cap) {
+            cap = cap ? cap * 2 : 64;
+            char **items = realloc(list.items, cap * sizeof(char *));
+            size_t *lens = items ? realloc(list.lens, cap * sizeof(size_t)) : NULL;
+            if (items) {
+                list.items = items;
+            }
+            if (!lens) {
+                ok = 0;
+                break;
+            }
+            list.lens = lens;
+        }
+        if (!(list.items[list.count] = malloc((size_t)n))) {
+            ok = 0;
+            break;
+        }
+        memcpy(list.items[list.count], line, (size_t)n);
+        list.lens[list.count++] = (size_t)n;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: cannot allocate patterns from '%s'\n", path);
+    } else if (ferror(in)) {
+        fprintf(stderr, "Error reading pattern file '%s': %s\n", path, strerror(errno));
+        ok = 0;
+    } else if (list.count == 0) {
+        fprintf(stderr, "Error: no patterns in '%s'\n", path);
+        ok = 0;
+    }
+    free(line);
+    fclose(in);
+
+    LineMatcher *m = ok ? calloc(1, sizeof(LineMatcher)) : NULL;
+    if (m) {
+        m->count = list.count;
+        if (list.count == 1) {
+            // One pattern takes the SIMD path; keep its bytes
+            m->pattern = list.items[0];
+            m->pattern_len = list.lens[0];
+            list.items[0] = NULL;
+        } else if (build_automaton(m, &list) != 0) {
+            free(m);
+            m = NULL;
+        }
+    } else if (ok) {
+        fprintf(stderr, "Error: cannot allocate the pattern matcher\n");
+    }
+
+    for (size_t i = 0; i < list.count; i++) {
+        free(list.items[i]);
+    }
+    free(list.items);
+    free(list.lens);
+    return m;
+}
+
+const char *matcher_find(const LineMatcher *m, const char *text, size_t len) {
+    return m->delta ? find_any(m, text, len) : find_literal(m, text, len);
+}
+
+size_t matcher_patterns(const LineMatcher *m) {
+    return m->count;
+}
+
+void matcher_free(LineMatcher *m) {
+    if (m) {
+        free(m->pattern);
+        free(m->delta);
+        free(m);
+    }
+}
+
+// --- Record starts
+
+struct RecordStart {
+    char *prefix;       // literal prefix every matching line starts with
+    size_t prefix_len;
+    int literal;        // the prefix is the whole pattern
+    regex_t regex;
+};
+
+RecordStart *record_start_new(const char *pattern, int fixed) {
+    if (pattern[0] == '\0' || strchr(pattern, '\n')) {
+        fprintf(stderr, "Error: --record-start pattern must be non-empty and fit on one line\n");
+        return NULL;
+    }
+    const char *body = pattern[0] == '^' && !fixed ? pattern + 1 : pattern;
+
+    RecordStart *r = calloc(1, sizeof(RecordStart));
+    size_t n = fixed ? strlen(body) : strcspn(body, ".[]()*+?{}|\\^$");
+    char *anchored = malloc(strlen(body) + 4);
+    if (!r || !anchored || !(r->prefix = strndup(body, n))) {
+        fprintf(stderr, "Error: cannot allocate the record start pattern\n");
+        free(anchored);
+        record_start_free(r);
+        return NULL;
+    }
+    r->literal = body[n] == '\0';
+    if (fixed) {
+        // Taken as is
+    } else if (strchr(body, '|')) {
+        n = 0;  // Alternatives need not share a prefix
+    } else if (n > 0 && body[n] != '\0' && strchr("*?{", body[n])) {
+        n--;    // The last literal byte is optional or repeated
+    }
+    r->prefix_len = n;
+    if (r->literal) {
+        free(anchored);
+        return r;
+    }
+
+    sprintf(anchored, "^(%s)", body);
+    int rc = regcomp(&r->regex, anchored, REG_EXTENDED | REG_NOSUB);
+    free(anchored);
+    if (rc != 0) {
+        char message[256];
+        regerror(rc, &r->regex, message, sizeof(message));
+        fprintf(stderr, "Error: invalid --record-start pattern '%s': %s\n", pattern, message);
+        free(r->prefix);
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+static int starts_record(const RecordStart *r, const char *line, size_t len) {
+    if (len < r->prefix_len || memcmp(line, r->prefix, r->prefix_len) != 0) {
+        return 0;
+    }
+    if (r->literal) {
+        return 1;
+    }
+    char text[RECORD_START_PEEK + 1];
+    memcpy(text, line, len);
+    text[len] = '\0';
+    return regexec(&r->regex, text, 0, NULL, 0) == 0;
+}
+
+size_t record_start_next(const RecordStart *r, const char *data, size_t len, size_t from,
+                         int final, size_t *resume) {
+    const char *nl = from < len ? memchr(data + from, '\n', len - from) : NULL;
+    while (nl) {
+        size_t line = (size_t)(nl - data) + 1;
+        size_t avail = len - line < RECORD_START_PEEK ? len - line : RECORD_START_PEEK;
+        const char *line_end = memchr(data + line, '\n', avail);
+        if (!line_end && avail < RECORD_START_PEEK && !final) {
+            *resume = line - 1;
+            return SIZE_MAX;  // Wait for the rest of the line
+        }
+        size_t line_len = line_end ? (size_t)(line_end - (data + line)) : avail;
+        if (line == len || starts_record(r, data + line, line_len)) {
+            *resume = line;
+            return line;
+        }
+        nl = line_end ? line_end : memchr(data + line + avail, '\n', len - line - avail);
+    }
+    *resume = len;
+    return SIZE_MAX;
+}
+
+int record_start_literal(const RecordStart *r) {
+    return r->literal;
+}
+
+void record_start_free(RecordStart *r) {
+    if (r) {
+        if (!r->literal && r->prefix) {
+            regfree(&r->regex);
+        }
+        free(r->prefix);
+        free(r);
+    }
+}
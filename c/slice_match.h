@@ -0,0 +1,66 @@
+#ifndef SLICE_MATCH_H
+#define SLICE_MATCH_H
+
+// Literal line filters for slice4 (--match, --match-any), and the record
+// start test behind --record-start.
+//
+// A single pattern is searched for with a SIMD prefilter (SSE2 on x86-64,
+// NEON on AArch64): 16 candidate positions at a time are checked for the
+// pattern's first and last byte, and only positions where both agree are
+// compared in full. A pattern set is compiled into an Aho-Corasick
+// automaton, stored as a dense transition table over the bytes that occur
+// in the patterns, so the text is scanned once whatever the number of
+// patterns. Patterns never contain a newline, so a match lies within one
+// line.
+
+#include <stddef.h>
+
+typedef struct LineMatcher LineMatcher;
+
+// Matcher for one literal pattern. Returns NULL (with a message) if the
+// pattern is empty or contains a newline.
+LineMatcher *matcher_new(const char *pattern);
+
+// Matcher for the patterns in path, one per line; empty lines are skipped.
+// Returns NULL with a message on error.
+LineMatcher *matcher_load(const char *path);
+
+// First position in text[0..len) that lies inside an occurrence of a
+// pattern, or NULL if there is none
+const char *matcher_find(const LineMatcher *m, const char *text, size_t len);
+
+size_t matcher_patterns(const LineMatcher *m);
+
+void matcher_free(LineMatcher *m);
+
+// --record-start: lines matching a POSIX extended regex, anchored at the
+// start of the line, begin a record; other lines continue the previous
+// one. The literal prefix of the pattern (up to its first metacharacter)
+// is compared with memcmp before the regex runs, and a pattern that is all
+// literal never reaches regexec. Only the first RECORD_START_PEEK bytes of
+// a line are matched against.
+#define RECORD_START_PEEK 1024
+
+typedef struct RecordStart RecordStart;
+
+// Returns NULL (with a message) if the pattern is empty, contains a
+// newline or does not compile. With `fixed` the pattern is a plain prefix
+// (--record-start-prefix): brackets and other metacharacters match
+// themselves.
+RecordStart *record_start_new(const char *pattern, int fixed);
+
+// Offset just past the first newline at or after `from` in data[0..len)
+// whose next line starts a record, or SIZE_MAX if there is none. A line
+// that is neither complete nor RECORD_START_PEEK bytes long cannot be
+// tested until more data arrives, unless `final` says there is none (the
+// data then ends a record if it ends with a newline). *resume receives the
+// offset to pass as `from` once data has grown.
+size_t record_start_next(const RecordStart *r, const char *data, size_t len, size_t from,
+                         int final, size_t *resume);
+
+// Whether the pattern needs the regex or only the literal prefix
+int record_start_literal(const RecordStart *r);
+
+void record_start_free(RecordStart *r);
+
+#endif /* SLICE_MATCH_H */
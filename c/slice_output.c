@@ -0,0 +1,787 @@
+#define _FILE_OFFSET_BITS 64
+#include "slice_output.h"
+#include "slice_json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define TAR_BLOCK 512
+#define TAR_RECORD (20 * TAR_BLOCK)             // Archives end on a 10 KB record
+#define TAR_MAX_OCTAL_SIZE 077777777777ULL      // Largest size a ustar field holds
+
+#define ARROW_BATCH_ROWS 65536                  // Rows per Arrow record batch...
+#define ARROW_BATCH_BYTES (64 * 1024 * 1024)    // ...or text bytes, whichever comes first
+#define JSON_PIECE (64 * 1024)                  // Input bytes escaped per write
+#define ARROW_METADATA_MAX 2048                 // Flatbuffer space for one message
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static const char zero_block[TAR_RECORD];
+
+int parse_out_format(const char *name, OutFormat *out) {
+    if (!strcmp(name, "raw")) {
+        *out = OUT_RAW;
+    } else if (!strcmp(name, "tar")) {
+        *out = OUT_TAR;
+    } else if (!strcmp(name, "pack")) {
+        *out = OUT_PACK;
+    } else if (!strcmp(name, "arrow")) {
+        *out = OUT_ARROW;
+    } else if (!strcmp(name, "jsonl")) {
+        *out = OUT_JSONL;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void sink_init(ChunkSink *s, OutFormat format, int fd, time_t mtime) {
+    memset(s, 0, sizeof(*s));
+    s->format = format;
+    s->fd = fd;
+    s->index_fd = -1;
+    s->mtime = mtime;
+}
+
+int sink_writev(ChunkSink *s, struct iovec *iov, int count) {
+    if (s->compress) {
+        for (int i = 0; i < count; i++) {
+            if (compressor_write(s->compress, iov[i].iov_base, iov[i].iov_len) != 0) {
+                return -1;
+            }
+            s->bytes_out += iov[i].iov_len;
+        }
+        return 0;
+    }
+
+    while (count > 0) {
+        ssize_t n = writev(s->fd, iov, count < IOV_MAX ? count : IOV_MAX);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            return -1;
+        }
+        s->bytes_out += (unsigned long long)n;
+
+        // Skip what was written, resuming inside a partly written vector
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+// Octal numeric field, zero padded to its full width and NUL terminated.
+// Callers keep value within width - 1 digits.
+static void tar_octal(char *field, size_t width, unsigned long long value) {
+    field[width - 1] = '\0';
+    for (size_t i = width - 1; i > 0; i--) {
+        field[i - 1] = (char)('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+static void tar_header(char *block, const char *name, char type,
+                       unsigned long long size, time_t mtime) {
+    memset(block, 0, TAR_BLOCK);
+    snprintf(block, 100, "%s", name);                   // name
+    tar_octal(block + 100, 8, 0644);                     // mode
+    tar_octal(block + 108, 8, 0);                        // uid
+    tar_octal(block + 116, 8, 0);                        // gid
+    tar_octal(block + 124, 12, size <= TAR_MAX_OCTAL_SIZE ? size : 0);
+    tar_octal(block + 136, 12, mtime > 0 ? (unsigned long long)mtime : 0);
+    block[156] = type;                                   // typeflag
+    memcpy(block + 257, "ustar", 6);                     // magic
+    memcpy(block + 263, "00", 2);                        // version
+
+    // Checksum: byte sum with the checksum field itself taken as spaces
+    memset(block + 148, ' ', 8);
+    unsigned int sum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++) {
+        sum += (unsigned char)block[i];
+    }
+    tar_octal(block + 148, 7, sum);
+    block[155] = ' ';
+}
+
+// Append one "<len> <key>=<value>\n" pax record, where <len> counts itself
+static int pax_add(ChunkSink *s, size_t *used, const char *key, const char *value) {
+    size_t body = strlen(key) + strlen(value) + 3;  // ' ', '=' and '\n'
+    size_t len = body + 1;
+    while ((size_t)snprintf(NULL, 0, "%zu", len) != len - body) {
+        len++;
+    }
+
+    if (*used + len + 1 > s->scratch_cap) {
+        size_t new_cap = s->scratch_cap ? s->scratch_cap : TAR_BLOCK;
+        while (new_cap < *used + len + 1) {
+            new_cap *= 2;
+        }
+        char *grown = realloc(s->scratch, new_cap);
+        if (!grown) {
+            perror("realloc for tar header");
+            return -1;
+        }
+        s->scratch = grown;
+        s->scratch_cap = new_cap;
+    }
+    *used += (size_t)snprintf(s->scratch + *used, len + 1, "%zu %s=%s\n", len, key, value);
+    return 0;
+}
+
+// Entry `chunk_<id>.txt`, preceded by a pax extended header that records
+// where in the source the chunk came from
+static int tar_write_chunk(ChunkSink *s, const Chunk *c) {
+    char name[64], pax_name[80], number[32];
+    snprintf(name, sizeof(name), "chunk_%06zu.txt", c->id);
+    snprintf(pax_name, sizeof(pax_name), "PaxHeaders/%s", name);
+
+    size_t used = 0;
+    snprintf(number, sizeof(number), "%zu", c->id);
+    if (pax_add(s, &used, "SLICE.id", number) != 0 ||
+        pax_add(s, &used, "SLICE.source", c->source) != 0) {
+        return -1;
+    }
+    snprintf(number, sizeof(number), "%lld", (long long)c->start);
+    if (pax_add(s, &used, "SLICE.start", number) != 0) {
+        return -1;
+    }
+    snprintf(number, sizeof(number), "%lld", (long long)c->end);
+    if (pax_add(s, &used, "SLICE.end", number) != 0) {
+        return -1;
+    }
+    if (c->len > TAR_MAX_OCTAL_SIZE) {
+        snprintf(number, sizeof(number), "%zu", c->len);
+        if (pax_add(s, &used, "size", number) != 0) {
+            return -1;
+        }
+    }
+
+    char pax_header[TAR_BLOCK], header[TAR_BLOCK];
+    tar_header(pax_header, pax_name, 'x', used, s->mtime);
+    tar_header(header, name, '0', c->len, s->mtime);
+
+    size_t pax_pad = (TAR_BLOCK - used % TAR_BLOCK) % TAR_BLOCK;
+    size_t data_pad = (TAR_BLOCK - c->len % TAR_BLOCK) % TAR_BLOCK;
+    struct iovec iov[6] = {
+        { pax_header, TAR_BLOCK },
+        { s->scratch, used },
+        { (void *)zero_block, pax_pad },
+        { header, TAR_BLOCK },
+        { (void *)c->data, c->len },
+        { (void *)zero_block, data_pad },
+    };
+    return sink_writev(s, iov, 6);
+}
+
+static int open_pack_file(const char *prefix, const char *ext, int flags) {
+    size_t len = strlen(prefix) + strlen(ext) + 1;
+    char *path = malloc(len);
+    if (!path) {
+        perror("malloc for pack path");
+        return -1;
+    }
+    snprintf(path, len, "%s%s", prefix, ext);
+    int fd = open(path, flags | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot open '%s': %s\n", path, strerror(errno));
+    }
+    free(path);
+    return fd;
+}
+
+int sink_open_pack(ChunkSink *s, const char *prefix) {
+    struct stat st;
+    s->fd = open_pack_file(prefix, ".data", O_WRONLY | O_APPEND);
+    if (s->fd < 0) {
+        return -1;
+    }
+    if (fstat(s->fd, &st) != 0) {
+        perror("fstat on pack data");
+        return -1;
+    }
+    s->data_size = (uint64_t)st.st_size;
+
+    s->index_fd = open_pack_file(prefix, ".idx", O_RDWR);
+    if (s->index_fd < 0) {
+        return -1;
+    }
+    if (fstat(s->index_fd, &st) != 0) {
+        perror("fstat on pack index");
+        return -1;
+    }
+
+    SlicePackHeader header;
+    if (st.st_size == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SLICE_PACK_MAGIC, sizeof(header.magic));
+        header.version = SLICE_PACK_VERSION;
+        header.entry_size = sizeof(SlicePackEntry);
+        if (pwrite(s->index_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+            perror("write pack index header");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (pread(s->index_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, SLICE_PACK_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SLICE_PACK_VERSION || header.entry_size != sizeof(SlicePackEntry)) {
+        fprintf(stderr, "Error: '%s.idx' is not a slice pack index\n", prefix);
+        return -1;
+    }
+
+    // Drop a torn entry left by an interrupted append
+    s->entries = ((uint64_t)st.st_size - sizeof(header)) / sizeof(SlicePackEntry);
+    off_t index_end = (off_t)(sizeof(header) + s->entries * sizeof(SlicePackEntry));
+    if (index_end != st.st_size && ftruncate(s->index_fd, index_end) != 0) {
+        perror("ftruncate on pack index");
+        return -1;
+    }
+    return 0;
+}
+
+// FNV-1a, 64 bit
+static uint64_t pack_hash(const char *data, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static int pack_write_chunk(ChunkSink *s, const Chunk *c) {
+    SlicePackEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.offset = s->data_size;
+    entry.length = c->len;
+    entry.source_start = (uint64_t)c->start;
+    entry.source_end = (uint64_t)c->end;
+    entry.hash = pack_hash(c->data, c->len);
+
+    struct iovec iov = { (void *)c->data, c->len };
+    if (sink_writev(s, &iov, 1) != 0) {
+        return -1;
+    }
+    s->data_size += c->len;
+
+    off_t at = (off_t)(sizeof(SlicePackHeader) + s->entries * sizeof(SlicePackEntry));
+    if (pwrite(s->index_fd, &entry, sizeof(entry), at) != (ssize_t)sizeof(entry)) {
+        perror("write pack index");
+        return -1;
+    }
+    s->entries++;
+    return 0;
+}
+
+// Arrow IPC stream (https://arrow.apache.org/docs/format/Columnar.html).
+// A Schema message is followed by one RecordBatch message per batch of
+// chunks and an end-of-stream marker. Columns are source (utf8), start and
+// end (int64) and text (large_utf8). The text values buffer is written as the
+// chunks' own bytes, one iovec per run of contiguous payload, so chunks taken
+// from a mapped file are never copied.
+
+struct ArrowBatch {
+    size_t rows;
+    int64_t *start;           // column values, ARROW_BATCH_ROWS each
+    int64_t *end;
+    int64_t *text_offsets;    // rows + 1
+    int32_t *source_offsets;  // rows + 1
+    char *sources;            // source column values
+    size_t sources_len;
+    size_t sources_cap;
+    struct iovec *pieces;     // text column values, in order
+    size_t piece_count;
+    char **owned;             // copies of chunks that were not borrowed
+    size_t owned_count;
+    int schema_written;
+};
+
+// Just enough of a flatbuffer writer for the Arrow metadata. Objects are laid
+// out front to back, parents before children, so every offset points forward
+// and is filled in once its target exists. Flatbuffers are little endian.
+typedef struct {
+    unsigned char buf[ARROW_METADATA_MAX];
+    size_t len;
+} FlatBuf;
+
+static size_t fb_alloc(FlatBuf *b, size_t size, size_t align) {
+    size_t pos = (b->len + align - 1) & ~(align - 1);
+    if (pos + size > sizeof(b->buf)) {
+        return 0;  // Cannot happen: messages have a fixed number of fields
+    }
+    memset(b->buf + b->len, 0, pos + size - b->len);
+    b->len = pos + size;
+    return pos;
+}
+
+static void fb_le(FlatBuf *b, size_t pos, uint64_t value, size_t width) {
+    for (size_t i = 0; i < width; i++) {
+        b->buf[pos + i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static void fb_ref(FlatBuf *b, size_t field, size_t target) {
+    fb_le(b, field, target - field, 4);
+}
+
+// Table whose fields have the given inline sizes (0 for an absent field),
+// preceded by its vtable. Stores the position of each field in `at`.
+static size_t fb_table(FlatBuf *b, int count, const size_t *sizes, size_t *at) {
+    size_t vtable = fb_alloc(b, 4 + 2 * (size_t)count, 2);
+    size_t inline_size = 4, offsets[8] = { 0 };
+    for (int i = 0; i < count; i++) {
+        if (sizes[i] > 0) {
+            inline_size = (inline_size + sizes[i] - 1) & ~(sizes[i] - 1);
+            offsets[i] = inline_size;
+            inline_size += sizes[i];
+        }
+    }
+
+    size_t table = fb_alloc(b, inline_size, 8);
+    fb_le(b, table, table - vtable, 4);
+    fb_le(b, vtable, 4 + 2 * (size_t)count, 2);
+    fb_le(b, vtable + 2, inline_size, 2);
+    for (int i = 0; i < count; i++) {
+        fb_le(b, vtable + 4 + 2 * (size_t)i, offsets[i], 2);
+        at[i] = table + offsets[i];
+    }
+    return table;
+}
+
+// Vector of count elements; returns the position of its length word, the
+// elements follow it aligned to elem_align
+static size_t fb_vector(FlatBuf *b, size_t count, size_t elem_size, size_t elem_align) {
+    size_t pad = (elem_align - (b->len + 4) % elem_align) % elem_align;
+    fb_alloc(b, pad, 1);
+    size_t pos = fb_alloc(b, 4 + count * elem_size, 4);
+    fb_le(b, pos, count, 4);
+    return pos;
+}
+
+static size_t fb_string(FlatBuf *b, const char *str) {
+    size_t len = strlen(str);
+    size_t pos = fb_alloc(b, 4 + len + 1, 4);
+    fb_le(b, pos, len, 4);
+    memcpy(b->buf + pos + 4, str, len);
+    return pos;
+}
+
+// Root Message table; returns the position of its `header` field and stores
+// that of `bodyLength` in body_length_at
+static size_t fb_message(FlatBuf *b, int header_type, size_t *body_length_at) {
+    static const size_t sizes[4] = { 2, 1, 4, 8 };  // version, header_type, header, bodyLength
+    size_t at[4];
+    size_t root = fb_alloc(b, 4, 4);
+    size_t message = fb_table(b, 4, sizes, at);
+    fb_ref(b, root, message);
+    fb_le(b, at[0], 4, 2);  // MetadataVersion.V5
+    fb_le(b, at[1], (uint64_t)header_type, 1);
+    *body_length_at = at[3];
+    return at[2];
+}
+
+enum { ARROW_HEADER_SCHEMA = 1, ARROW_HEADER_RECORD_BATCH = 3 };
+enum { ARROW_TYPE_INT = 2, ARROW_TYPE_UTF8 = 5, ARROW_TYPE_LARGE_UTF8 = 20 };
+
+static void fb_schema(FlatBuf *b, size_t header) {
+    static const struct { const char *name; int type; } columns[4] = {
+        { "source", ARROW_TYPE_UTF8 },
+        { "start", ARROW_TYPE_INT },
+        { "end", ARROW_TYPE_INT },
+        { "text", ARROW_TYPE_LARGE_UTF8 },
+    };
+    static const size_t schema_sizes[2] = { 2, 4 };   // endianness, fields
+    static const size_t field_sizes[6] = { 4, 1, 1, 4, 0, 4 };  // name, nullable,
+        // type_type, type, dictionary (absent), children
+    static const size_t int_sizes[2] = { 4, 1 };      // bitWidth, is_signed
+    const uint16_t probe = 1;
+    size_t at[6];
+
+    size_t schema = fb_table(b, 2, schema_sizes, at);
+    fb_ref(b, header, schema);
+    fb_le(b, at[0], *(const unsigned char *)&probe == 0, 2);  // Body endianness: 1 = big
+    size_t fields = fb_vector(b, 4, 4, 4);
+    fb_ref(b, at[1], fields);
+
+    for (size_t i = 0; i < 4; i++) {
+        size_t field = fb_table(b, 6, field_sizes, at);
+        fb_ref(b, fields + 4 + 4 * i, field);
+        size_t name_at = at[0], type_at = at[3], children_at = at[5];
+        fb_le(b, at[2], (uint64_t)columns[i].type, 1);
+
+        size_t name = fb_string(b, columns[i].name);
+        fb_ref(b, name_at, name);
+        size_t type;
+        if (columns[i].type == ARROW_TYPE_INT) {
+            size_t int_at[2];
+            type = fb_table(b, 2, int_sizes, int_at);
+            fb_le(b, int_at[0], 64, 4);
+            fb_le(b, int_at[1], 1, 1);
+        } else {
+            type = fb_table(b, 0, NULL, NULL);
+        }
+        fb_ref(b, type_at, type);
+        fb_ref(b, children_at, fb_vector(b, 0, 4, 4));
+    }
+}
+
+static int arrow_write_message(ChunkSink *s, FlatBuf *b, struct iovec *body, int body_count) {
+    static const char pad[8];
+    unsigned char prefix[8];
+    size_t padded = (b->len + 7) & ~(size_t)7;
+    memset(prefix, 0xff, 4);  // Continuation marker
+    for (int i = 0; i < 4; i++) {
+        prefix[4 + i] = (unsigned char)(padded >> (8 * i));
+    }
+
+    struct iovec head[3] = {
+        { prefix, sizeof(prefix) },
+        { b->buf, b->len },
+        { (void *)pad, padded - b->len },
+    };
+    if (sink_writev(s, head, 3) != 0) {
+        return -1;
+    }
+    return body_count > 0 ? sink_writev(s, body, body_count) : 0;
+}
+
+static int arrow_write_schema(ChunkSink *s) {
+    FlatBuf b;
+    size_t body_length_at;
+    b.len = 0;
+    fb_schema(&b, fb_message(&b, ARROW_HEADER_SCHEMA, &body_length_at));
+    s->arrow->schema_written = 1;
+    return arrow_write_message(s, &b, NULL, 0);
+}
+
+static int arrow_flush(ChunkSink *s) {
+    static const char pad[8];
+    ArrowBatch *a = s->arrow;
+    size_t rows = a->rows;
+    size_t text_len = (size_t)a->text_offsets[rows];
+
+    // Body buffers in schema order: validity (empty, no nulls) then offsets
+    // and values for source, data for start and end, offsets and values for text
+    struct { const void *data; size_t len; } buffers[10] = {
+        { NULL, 0 }, { a->source_offsets, (rows + 1) * sizeof(int32_t) }, { a->sources, a->sources_len },
+        { NULL, 0 }, { a->start, rows * sizeof(int64_t) },
+        { NULL, 0 }, { a->end, rows * sizeof(int64_t) },
+        { NULL, 0 }, { a->text_offsets, (rows + 1) * sizeof(int64_t) }, { NULL, text_len },
+    };
+
+    struct iovec *body = malloc((a->piece_count + 20) * sizeof(struct iovec));
+    if (!body) {
+        perror("malloc for record batch");
+        return -1;
+    }
+
+    FlatBuf b;
+    size_t body_length_at;
+    b.len = 0;
+    size_t header = fb_message(&b, ARROW_HEADER_RECORD_BATCH, &body_length_at);
+    static const size_t batch_sizes[3] = { 8, 4, 4 };  // length, nodes, buffers
+    size_t at[3];
+    size_t batch = fb_table(&b, 3, batch_sizes, at);
+    fb_ref(&b, header, batch);
+    fb_le(&b, at[0], rows, 8);
+
+    size_t nodes = fb_vector(&b, 4, 16, 8);
+    fb_ref(&b, at[1], nodes);
+    for (size_t i = 0; i < 4; i++) {
+        fb_le(&b, nodes + 4 + 16 * i, rows, 8);  // length; null_count stays 0
+    }
+
+    size_t buffer_vec = fb_vector(&b, 10, 16, 8);
+    fb_ref(&b, at[2], buffer_vec);
+    int count = 0;
+    uint64_t offset = 0;
+    for (size_t i = 0; i < 10; i++) {
+        fb_le(&b, buffer_vec + 4 + 16 * i, offset, 8);
+        fb_le(&b, buffer_vec + 12 + 16 * i, buffers[i].len, 8);
+        if (i == 9) {
+            for (size_t p = 0; p < a->piece_count; p++) {
+                body[count++] = a->pieces[p];
+            }
+        } else if (buffers[i].len > 0) {
+            body[count].iov_base = (void *)buffers[i].data;
+            body[count++].iov_len = buffers[i].len;
+        }
+        size_t padding = (8 - buffers[i].len % 8) % 8;
+        if (padding > 0) {
+            body[count].iov_base = (void *)pad;
+            body[count++].iov_len = padding;
+        }
+        offset += buffers[i].len + padding;
+    }
+
+    fb_le(&b, body_length_at, offset, 8);
+
+    int rc = arrow_write_message(s, &b, body, count);
+    free(body);
+
+    for (size_t i = 0; i < a->owned_count; i++) {
+        free(a->owned[i]);
+    }
+    a->owned_count = 0;
+    a->piece_count = 0;
+    a->sources_len = 0;
+    a->rows = 0;
+    return rc;
+}
+
+static int arrow_write_chunk(ChunkSink *s, const Chunk *c) {
+    ArrowBatch *a = s->arrow;
+    if (!a) {
+        a = calloc(1, sizeof(ArrowBatch));
+        if (!a) {
+            perror("calloc for record batch");
+            return -1;
+        }
+        s->arrow = a;
+        a->start = malloc(ARROW_BATCH_ROWS * sizeof(int64_t));
+        a->end = malloc(ARROW_BATCH_ROWS * sizeof(int64_t));
+        a->text_offsets = malloc((ARROW_BATCH_ROWS + 1) * sizeof(int64_t));
+        a->source_offsets = malloc((ARROW_BATCH_ROWS + 1) * sizeof(int32_t));
+        a->pieces = malloc(ARROW_BATCH_ROWS * sizeof(struct iovec));
+        a->owned = malloc(ARROW_BATCH_ROWS * sizeof(char *));
+        if (!a->start || !a->end || !a->text_offsets || !a->source_offsets ||
+            !a->pieces || !a->owned) {
+            perror("malloc for record batch");
+            return -1;
+        }
+        a->text_offsets[0] = 0;
+        a->source_offsets[0] = 0;
+    }
+    if (!a->schema_written && arrow_write_schema(s) != 0) {
+        return -1;
+    }
+
+    size_t source_len = strlen(c->source);
+    if (a->sources_len + source_len > a->sources_cap) {
+        size_t new_cap = a->sources_cap ? a->sources_cap : 4096;
+        while (new_cap < a->sources_len + source_len) {
+            new_cap *= 2;
+        }
+        char *grown = realloc(a->sources, new_cap);
+        if (!grown) {
+            perror("realloc for source column");
+            return -1;
+        }
+        a->sources = grown;
+        a->sources_cap = new_cap;
+    }
+    memcpy(a->sources + a->sources_len, c->source, source_len);
+    a->sources_len += source_len;
+
+    // Payloads that do not outlive this call are copied; mapped ones are
+    // referenced, and adjacent ones merge into a single piece
+    const char *data = c->data;
+    if (!c->borrowed && c->len > 0) {
+        char *copy = malloc(c->len);
+        if (!copy) {
+            perror("malloc for chunk copy");
+            return -1;
+        }
+        memcpy(copy, c->data, c->len);
+        a->owned[a->owned_count++] = copy;
+        data = copy;
+    }
+    if (c->len > 0) {
+        struct iovec *last = a->piece_count > 0 ? &a->pieces[a->piece_count - 1] : NULL;
+        if (last && (const char *)last->iov_base + last->iov_len == data) {
+            last->iov_len += c->len;
+        } else {
+            a->pieces[a->piece_count].iov_base = (void *)data;
+            a->pieces[a->piece_count++].iov_len = c->len;
+        }
+    }
+
+    size_t r = a->rows++;
+    a->start[r] = (int64_t)c->start;
+    a->end[r] = (int64_t)c->end;
+    a->source_offsets[r + 1] = (int32_t)a->sources_len;
+    a->text_offsets[r + 1] = a->text_offsets[r] + (int64_t)c->len;
+
+    if (a->rows == ARROW_BATCH_ROWS || a->text_offsets[a->rows] >= ARROW_BATCH_BYTES ||
+        a->sources_len > INT32_MAX / 2) {
+        return arrow_flush(s);
+    }
+    return 0;
+}
+
+static int arrow_finish(ChunkSink *s) {
+    static const unsigned char end_of_stream[8] = { 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0 };
+    if (s->arrow && s->arrow->rows > 0 && arrow_flush(s) != 0) {
+        return -1;
+    }
+    if (!s->arrow) {
+        s->arrow = calloc(1, sizeof(ArrowBatch));
+        if (!s->arrow) {
+            perror("calloc for record batch");
+            return -1;
+        }
+    }
+    if (!s->arrow->schema_written && arrow_write_schema(s) != 0) {
+        return -1;
+    }
+    struct iovec iov = { (void *)end_of_stream, sizeof(end_of_stream) };
+    return sink_writev(s, &iov, 1);
+}
+
+static void arrow_free(ArrowBatch *a) {
+    if (!a) {
+        return;
+    }
+    for (size_t i = 0; i < a->owned_count; i++) {
+        free(a->owned[i]);
+    }
+    free(a->start);
+    free(a->end);
+    free(a->text_offsets);
+    free(a->source_offsets);
+    free(a->sources);
+    free(a->pieces);
+    free(a->owned);
+    free(a);
+}
+
+static int framed_write_chunk(ChunkSink *s, const Chunk *c) {
+    SliceFrameHeader header;
+    header.magic = SLICE_FRAME_MAGIC;
+    header.flags = s->frame_flags;
+    header.id = c->id;
+    header.offset = (uint64_t)c->start;
+    header.length = c->len;
+    struct iovec iov[2] = {
+        { &header, sizeof(header) },
+        { (void *)c->data, c->len },
+    };
+    return sink_writev(s, iov, 2);
+}
+
+static int scratch_reserve(ChunkSink *s, size_t size) {
+    if (size <= s->scratch_cap) {
+        return 0;
+    }
+    char *grown = realloc(s->scratch, size);
+    if (!grown) {
+        perror("realloc for output buffer");
+        return -1;
+    }
+    s->scratch = grown;
+    s->scratch_cap = size;
+    return 0;
+}
+
+// One JSON object per line. The text is escaped JSON_PIECE bytes at a time
+// into the scratch buffer, which is written whenever it could not take
+// another escaped piece.
+static int jsonl_write_chunk(ChunkSink *s, const Chunk *c) {
+    size_t source_len = strlen(c->source);
+    size_t piece_max = SLICE_JSON_ESCAPE_MAX(JSON_PIECE);
+    if (scratch_reserve(s, SLICE_JSON_ESCAPE_MAX(source_len) + 128 + piece_max) != 0) {
+        return -1;
+    }
+
+    char *out = s->scratch;
+    out += sprintf(out, "{\"file\":\"");
+    out += slice_json_escape(c->source, source_len, out);
+    out += sprintf(out, "\",\"start\":%lld,\"end\":%lld,\"text\":\"",
+                   (long long)c->start, (long long)c->end);
+
+    for (size_t done = 0; done < c->len;) {
+        if ((size_t)(s->scratch + s->scratch_cap - out) < piece_max) {
+            struct iovec iov = { s->scratch, (size_t)(out - s->scratch) };
+            if (sink_writev(s, &iov, 1) != 0) {
+                return -1;
+            }
+            out = s->scratch;
+        }
+        size_t n = c->len - done < JSON_PIECE ? c->len - done : JSON_PIECE;
+        out += slice_json_escape(c->data + done, n, out);
+        done += n;
+    }
+
+    memcpy(out, "\"}\n", 3);
+    out += 3;
+    struct iovec iov = { s->scratch, (size_t)(out - s->scratch) };
+    return sink_writev(s, &iov, 1);
+}
+
+static int sink_write_format(ChunkSink *s, const Chunk *c) {
+    if (s->format == OUT_TAR) {
+        return tar_write_chunk(s, c);
+    }
+    if (s->format == OUT_PACK) {
+        return pack_write_chunk(s, c);
+    }
+    if (s->format == OUT_ARROW) {
+        return arrow_write_chunk(s, c);
+    }
+    if (s->format == OUT_FRAMED) {
+        return framed_write_chunk(s, c);
+    }
+    if (s->format == OUT_JSONL) {
+        return jsonl_write_chunk(s, c);
+    }
+    struct iovec iov = { (void *)c->data, c->len };
+    return sink_writev(s, &iov, 1);
+}
+
+int sink_write(ChunkSink *s, const Chunk *c) {
+    if (sink_write_format(s, c) != 0) {
+        return -1;
+    }
+    // zstd frames preferably end between chunks
+    return s->compress ? compressor_boundary(s->compress) : 0;
+}
+
+int sink_finish(ChunkSink *s) {
+    if (s->format == OUT_TAR) {
+        // Two zero blocks mark the end; pad the archive to a whole record
+        size_t tail = 2 * TAR_BLOCK;
+        size_t rem = (size_t)((s->bytes_out + tail) % TAR_RECORD);
+        if (rem != 0) {
+            tail += TAR_RECORD - rem;
+        }
+        struct iovec iov = { (void *)zero_block, tail };
+        return sink_writev(s, &iov, 1);
+    }
+    if (s->format == OUT_ARROW) {
+        return arrow_finish(s);
+    }
+    return 0;
+}
+
+void sink_free(ChunkSink *s) {
+    free(s->scratch);
+    s->scratch = NULL;
+    arrow_free(s->arrow);
+    s->arrow = NULL;
+    if (s->format == OUT_PACK && s->fd >= 0) {
+        close(s->fd);
+    }
+    if (s->index_fd >= 0) {
+        close(s->index_fd);
+    }
+    s->fd = -1;
+    s->index_fd = -1;
+}
@@ -0,0 +1,117 @@
+#ifndef SLICE_OUTPUT_H
+#define SLICE_OUTPUT_H
+
+// Output formats for slice4's chunking mode (--chunk-size, --out-format).
+// Each chunk is handed to a ChunkSink, which frames it for the selected
+// format and writes it to a descriptor. Payloads are passed by pointer and
+// written with writev(2), so a chunk taken from a mapped file reaches the
+// output without an intermediate copy.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "slice_compress.h"
+
+typedef enum {
+    OUT_RAW,   // payloads back to back, as separate slice runs would print them
+    OUT_TAR,   // one POSIX (pax) tar entry per chunk
+    OUT_PACK,  // <prefix>.data plus a fixed-width <prefix>.idx, see below
+    OUT_ARROW, // Arrow IPC stream: source, start, end, text columns
+    OUT_FRAMED,// SliceFrameHeader then payload per chunk (--framing binary)
+    OUT_JSONL  // {"file":...,"start":...,"end":...,"text":"..."} per line
+} OutFormat;
+
+// --framing binary: every record is this header followed by `length` bytes
+// of payload, so a consumer can skip or route records without scanning for
+// delimiters. Integers are in host byte order.
+#define SLICE_FRAME_MAGIC 0x31524c53U   // "SLR1"
+#define SLICE_FRAME_FULL_LINES 0x1      // payload was trimmed to whole lines
+
+typedef struct {
+    uint32_t magic;         // SLICE_FRAME_MAGIC
+    uint32_t flags;         // SLICE_FRAME_*
+    uint64_t id;            // record number, from 0
+    uint64_t offset;        // source offset of the first payload byte
+    uint64_t length;        // payload bytes that follow the header
+} SliceFrameHeader;
+
+// Packed container. <prefix>.data holds the payloads back to back;
+// <prefix>.idx is a SlicePackHeader followed by one SlicePackEntry per
+// chunk, so entry i is at sizeof(SlicePackHeader) + i * sizeof(SlicePackEntry)
+// and readers can mmap both files and fetch any chunk with no per-chunk
+// open. Both files are only ever appended to: payload first, then its entry,
+// so an interrupted run leaves at most unreferenced bytes in the data file
+// and a torn entry that the next run truncates away. Integers are in host
+// byte order.
+#define SLICE_PACK_MAGIC "SLCPACK1"
+#define SLICE_PACK_VERSION 1
+
+typedef struct {
+    char magic[8];          // SLICE_PACK_MAGIC
+    uint32_t version;       // SLICE_PACK_VERSION
+    uint32_t entry_size;    // sizeof(SlicePackEntry)
+    uint64_t reserved[2];
+} SlicePackHeader;
+
+typedef struct {
+    uint64_t offset;        // payload position in <prefix>.data
+    uint64_t length;
+    uint64_t source_start;  // byte range of the payload in its source file
+    uint64_t source_end;
+    uint64_t hash;          // FNV-1a 64 of the payload
+    uint64_t reserved;
+} SlicePackEntry;
+
+// One chunk of the input
+typedef struct {
+    size_t id;            // chunk number, from 0
+    const char *source;   // path of the file the chunk was cut from
+    off_t start;          // source byte range of data
+    off_t end;
+    const char *data;
+    size_t len;
+    int borrowed;         // data stays valid until sink_finish (mapped views)
+} Chunk;
+
+typedef struct ArrowBatch ArrowBatch;
+
+typedef struct {
+    OutFormat format;
+    int fd;                       // output, or <prefix>.data for OUT_PACK
+    int index_fd;                 // pack: <prefix>.idx, -1 otherwise
+    uint64_t data_size;           // pack: current length of <prefix>.data
+    uint64_t entries;             // pack: entries in <prefix>.idx
+    time_t mtime;                 // tar: modification time of every entry
+    unsigned long long bytes_out; // bytes written to fd so far
+    char *scratch;                // tar: pax header; jsonl: escaped output
+    size_t scratch_cap;
+    ArrowBatch *arrow;            // arrow: rows of the record batch being built
+    Compressor *compress;         // --compress: output goes here instead of fd
+    uint32_t frame_flags;         // framed: flags set on every record
+} ChunkSink;
+
+// Map an --out-format name to its OutFormat. Returns 0, or -1 if unknown.
+int parse_out_format(const char *name, OutFormat *out);
+
+void sink_init(ChunkSink *s, OutFormat format, int fd, time_t mtime);
+
+// Open (or create) <prefix>.data and <prefix>.idx for appending and point
+// the sink at them. New entries follow the ones already present.
+int sink_open_pack(ChunkSink *s, const char *prefix);
+
+int sink_write(ChunkSink *s, const Chunk *c);
+
+// Write whatever the format needs after the last chunk (tar end-of-archive
+// blocks, the last Arrow record batch). The sink can be freed afterwards, which also closes pack files.
+int sink_finish(ChunkSink *s);
+
+void sink_free(ChunkSink *s);
+
+// Write iov[0..count) to s->fd in full, retrying after short writes, or
+// pass it to the compressor
+int sink_writev(ChunkSink *s, struct iovec *iov, int count);
+
+#endif /* SLICE_OUTPUT_H */
@@ -0,0 +1,425 @@
+#define _GNU_SOURCE  // strptime(3)
+#define _FILE_OFFSET_BITS 64
+#include "slice_query.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#define TS_PREFIX_MAX 256   // Bytes of a line offered to strptime
+#define SAMPLE_PILOT 64     // Lines drawn to estimate the shortest line length
+#define SAMPLE_MAX_STALE 16 // Rounds without a new line before scanning the range
+
+void query_init(RangeQuery *q) {
+    memset(q, 0, sizeof(*q));
+    q->ts_format = QUERY_DEFAULT_TS_FORMAT;
+    q->field_sep = '\t';
+}
+
+int query_active(const RangeQuery *q) {
+    return q->since != NULL || q->until != NULL || q->key_prefix != NULL || q->shard_count > 0;
+}
+
+int query_parse_separator(const char *arg, char *out) {
+    if (!strcmp(arg, "\\t")) {
+        *out = '\t';
+        return 0;
+    }
+    if (arg[0] == '\0' || arg[1] != '\0' || arg[0] == '\n') {
+        return -1;
+    }
+    *out = arg[0];
+    return 0;
+}
+
+int query_parse_shard(const char *arg, size_t *index, size_t *count) {
+    const char *slash = strchr(arg, '/');
+    if (!slash || slash == arg) {
+        return -1;
+    }
+    char head[32];
+    size_t n = (size_t)(slash - arg);
+    if (n >= sizeof(head)) {
+        return -1;
+    }
+    memcpy(head, arg, n);
+    head[n] = '\0';
+    if (slice_parse_size(head, index) != SLICE_OK || slice_parse_size(slash + 1, count) != SLICE_OK ||
+        *count == 0 || *index >= *count) {
+        return -1;
+    }
+    return 0;
+}
+
+off_t query_split_point(slice_file *f, off_t lo, off_t hi, size_t i, size_t n) {
+    if (i == 0) {
+        return lo;
+    }
+    if (i >= n) {
+        return hi;
+    }
+    // i/n of the span, computed without overflowing on huge files
+    off_t span = hi - lo;
+    off_t target = lo + span / (off_t)n * (off_t)i + span % (off_t)n * (off_t)i / (off_t)n;
+    return slice_line_start(f, target);
+}
+
+// --- Timestamps
+
+typedef struct {
+    const char *format;
+    struct tm target;
+    size_t probes;
+} TimeTarget;
+
+// Order two broken-down times field by field, most significant first, so no
+// time zone is involved
+static int tm_compare(const struct tm *a, const struct tm *b) {
+    int fa[6] = { a->tm_year, a->tm_mon, a->tm_mday, a->tm_hour, a->tm_min, a->tm_sec };
+    int fb[6] = { b->tm_year, b->tm_mon, b->tm_mday, b->tm_hour, b->tm_min, b->tm_sec };
+    for (int i = 0; i < 6; i++) {
+        if (fa[i] != fb[i]) {
+            return fa[i] < fb[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// Parse the timestamp at the start of a line; anything after it is ignored
+static int parse_leading_ts(const char *line, size_t len, const char *format, struct tm *tm) {
+    char buf[TS_PREFIX_MAX + 1];
+    size_t n = len < TS_PREFIX_MAX ? len : TS_PREFIX_MAX;
+    memcpy(buf, line, n);
+    buf[n] = '\0';
+    memset(tm, 0, sizeof(*tm));
+    return strptime(buf, format, tm) != NULL ? 0 : -1;
+}
+
+// Lines without a timestamp (continuations, stack traces) take the time of
+// the next line in the window that has one
+static int ts_before(const char *text, size_t len, void *arg) {
+    TimeTarget *t = arg;
+    t->probes++;
+    while (len > 0) {
+        const char *nl = memchr(text, '\n', len);
+        size_t line_len = nl ? (size_t)(nl - text) : len;
+        struct tm tm;
+        if (parse_leading_ts(text, line_len, t->format, &tm) == 0) {
+            return tm_compare(&tm, &t->target) < 0;
+        }
+        if (!nl) {
+            break;
+        }
+        len -= line_len + 1;
+        text = nl + 1;
+    }
+    return 0;
+}
+
+static int parse_ts_arg(const char *arg, const char *name, const char *format, struct tm *tm) {
+    memset(tm, 0, sizeof(*tm));
+    const char *end = strptime(arg, format, tm);
+    if (end == NULL || *end != '\0') {
+        fprintf(stderr, "Invalid value for %s: '%s' does not match --ts-format '%s'\n",
+                name, arg, format);
+        return -1;
+    }
+    return 0;
+}
+
+static int bisect_ts(slice_file *f, const char *arg, const char *name, const char *format,
+                     off_t *out, int debug) {
+    TimeTarget t = { format, { 0 }, 0 };
+    if (parse_ts_arg(arg, name, format, &t.target) != 0) {
+        return -1;
+    }
+    int rc = slice_bisect(f, ts_before, &t, out);
+    if (rc != SLICE_OK) {
+        fprintf(stderr, "Error: bisection for %s failed: %s\n", name, slice_strerror(rc));
+        return -1;
+    }
+    if (debug) {
+        fprintf(stderr, "[DEBUG] %s %s: offset %lld after %zu probes\n",
+                name, arg, (long long)*out, t.probes);
+    }
+    return 0;
+}
+
+// --- Sorted keys
+
+typedef struct {
+    const char *prefix;
+    size_t prefix_len;
+    char sep;
+    int field;
+    int upper;    // 0: before the first match; 1: before the first line past the matches
+} KeyTarget;
+
+// Locate the key field of the line at text
+static void line_key(const KeyTarget *t, const char *text, size_t len,
+                     const char **key, size_t *key_len) {
+    const char *nl = memchr(text, '\n', len);
+    if (nl) {
+        len = (size_t)(nl - text);
+    }
+    for (int i = 1; i < t->field; i++) {
+        const char *sep = memchr(text, t->sep, len);
+        if (!sep) {
+            text += len;    // Too few fields: the key is empty
+            len = 0;
+            break;
+        }
+        len -= (size_t)(sep + 1 - text);
+        text = sep + 1;
+    }
+    if (t->field > 0) {
+        const char *sep = memchr(text, t->sep, len);
+        if (sep) {
+            len = (size_t)(sep - text);
+        }
+    }
+    *key = text;
+    *key_len = len;
+}
+
+// Lines matching the prefix form one run in byte order. Below it the key
+// sorts before the prefix; past it the key cut to the prefix length sorts
+// after the prefix.
+static int key_before(const char *text, size_t len, void *arg) {
+    const KeyTarget *t = arg;
+    const char *key;
+    size_t key_len;
+    line_key(t, text, len, &key, &key_len);
+    size_t n = key_len < t->prefix_len ? key_len : t->prefix_len;
+    int cmp = memcmp(key, t->prefix, n);
+    if (t->upper) {
+        return cmp <= 0;
+    }
+    return cmp < 0 || (cmp == 0 && key_len < t->prefix_len);
+}
+
+static int bisect_key(slice_file *f, const RangeQuery *q, off_t *first, off_t *end, int debug) {
+    KeyTarget t = { q->key_prefix, strlen(q->key_prefix), q->field_sep, q->key_field, 0 };
+    int rc = slice_bisect(f, key_before, &t, first);
+    if (rc == SLICE_OK) {
+        t.upper = 1;
+        rc = slice_bisect(f, key_before, &t, end);
+    }
+    if (rc != SLICE_OK) {
+        fprintf(stderr, "Error: bisection for --key-prefix failed: %s\n", slice_strerror(rc));
+        return -1;
+    }
+    if (debug) {
+        fprintf(stderr, "[DEBUG] --key-prefix %s: offsets %lld to %lld\n",
+                q->key_prefix, (long long)*first, (long long)*end);
+    }
+    return 0;
+}
+
+int query_resolve(const RangeQuery *q, const char *filename, size_t *start, size_t *size,
+                  int debug) {
+    slice_file *f;
+    int rc = slice_open(filename, &f);
+    if (rc != SLICE_OK) {
+        fprintf(stderr, "Error: cannot open file '%s': %s\n", filename,
+                rc == SLICE_ERR_OPEN ? strerror(errno) : slice_strerror(rc));
+        return -1;
+    }
+
+    off_t first = 0, end = slice_size(f);
+    int ok = 1;
+    if (q->since && bisect_ts(f, q->since, "--since", q->ts_format, &first, debug) != 0) {
+        ok = 0;
+    }
+    if (ok && q->until && bisect_ts(f, q->until, "--until", q->ts_format, &end, debug) != 0) {
+        ok = 0;
+    }
+    if (ok && q->key_prefix) {
+        off_t key_first, key_end;
+        if (bisect_key(f, q, &key_first, &key_end, debug) != 0) {
+            ok = 0;
+        } else {
+            first = key_first > first ? key_first : first;
+            end = key_end < end ? key_end : end;
+        }
+    }
+    if (end < first) {
+        end = first;
+    }
+    if (ok && q->shard_count > 0) {
+        off_t shard_first = query_split_point(f, first, end, q->shard_index, q->shard_count);
+        off_t shard_end = query_split_point(f, first, end, q->shard_index + 1, q->shard_count);
+        if (shard_first < 0 || shard_end < 0) {
+            fprintf(stderr, "Error: cannot read '%s': %s\n", filename,
+                    slice_strerror((int)(shard_first < 0 ? shard_first : shard_end)));
+            ok = 0;
+        } else {
+            if (debug) {
+                fprintf(stderr, "[DEBUG] Shard %zu/%zu: offsets %lld to %lld\n", q->shard_index,
+                        q->shard_count, (long long)shard_first, (long long)shard_end);
+            }
+            first = shard_first;
+            end = shard_end;
+        }
+    }
+    slice_close(f);
+    if (!ok) {
+        return -1;
+    }
+
+    *start = (size_t)first;
+    *size = (size_t)(end - first);
+    if (debug) {
+        fprintf(stderr, "[DEBUG] Resolved range: start %zu, size %zu\n", *start, *size);
+    }
+    return 0;
+}
+
+// --- Line sampling
+
+// splitmix64: small, fast and good enough for picking offsets; the same
+// seed gives the same sample on every platform
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// The line containing a random offset of [lo, hi)
+static int draw_line(slice_file *f, off_t lo, off_t hi, uint64_t *state, QueryLine *line) {
+    off_t at = lo + (off_t)(next_random(state) % (uint64_t)(hi - lo));
+    off_t start = slice_line_start_before(f, at);
+    off_t end = start >= 0 ? slice_line_start(f, at + 1) : start;
+    if (end < 0) {
+        fprintf(stderr, "Error: sampling failed: %s\n", slice_strerror((int)end));
+        return -1;
+    }
+    line->start = start;
+    line->end = end;
+    return 0;
+}
+
+static int compare_lines(const void *a, const void *b) {
+    off_t x = ((const QueryLine *)a)->start, y = ((const QueryLine *)b)->start;
+    return (x > y) - (x < y);
+}
+
+// Once random probes stop finding new lines, k is close to the number of
+// lines in the range: walk all of them and add k - have of the ones not yet
+// picked, chosen by reservoir sampling. lines[0..have) is sorted and has
+// room for k.
+static int sample_scan(slice_file *f, off_t lo, off_t hi, size_t k, uint64_t *state,
+                       QueryLine *lines, size_t *have) {
+    size_t picked = *have, want = k - picked, seen = 0, next = 0;
+    QueryLine *extra = lines + picked;
+    off_t at = lo;
+    while (at < hi) {
+        off_t end = slice_line_start(f, at + 1);
+        if (end < 0) {
+            fprintf(stderr, "Error: sampling failed: %s\n", slice_strerror((int)end));
+            return -1;
+        }
+        while (next < picked && lines[next].start < at) {
+            next++;
+        }
+        if (next < picked && lines[next].start == at) {
+            at = end;
+            continue;  // Already in the sample
+        }
+        QueryLine line = { at, end };
+        if (seen < want) {
+            extra[seen] = line;
+        } else {
+            uint64_t r = next_random(state) % (uint64_t)(seen + 1);
+            if (r < want) {
+                extra[r] = line;
+            }
+        }
+        seen++;
+        at = end;
+    }
+    *have = picked + (seen < want ? seen : want);
+    qsort(lines, *have, sizeof(QueryLine), compare_lines);
+    return 0;
+}
+
+int query_sample(slice_file *f, off_t lo, off_t hi, size_t k, uint64_t seed, int uniform,
+                 QueryLine **out, size_t *count, int debug) {
+    *out = NULL;
+    *count = 0;
+    if (k == 0 || hi <= lo) {
+        return 0;
+    }
+    QueryLine *lines = malloc(k * sizeof(QueryLine));
+    if (!lines) {
+        fprintf(stderr, "Error: cannot allocate %zu sample lines\n", k);
+        return -1;
+    }
+
+    uint64_t state = seed;
+    QueryLine line;
+    off_t shortest = hi - lo;
+    if (uniform) {
+        for (int i = 0; i < SAMPLE_PILOT; i++) {
+            if (draw_line(f, lo, hi, &state, &line) != 0) {
+                free(lines);
+                return -1;
+            }
+            if (line.end - line.start < shortest) {
+                shortest = line.end - line.start;
+            }
+        }
+    }
+
+    // Draw in rounds, dropping duplicates after each one, until k distinct
+    // lines are found or the range has run out of new ones
+    size_t have = 0, draws = 0, stale = 0;
+    while (have < k && stale < SAMPLE_MAX_STALE) {
+        size_t before = have, want = k - have, accepted = 0;
+        for (size_t i = 0; i < want; i++) {
+            if (draw_line(f, lo, hi, &state, &line) != 0) {
+                free(lines);
+                return -1;
+            }
+            draws++;
+            off_t len = line.end - line.start;
+            if (uniform) {
+                if (len < shortest) {
+                    shortest = len;
+                }
+                if (next_random(&state) % (uint64_t)len >= (uint64_t)shortest) {
+                    continue;
+                }
+            }
+            lines[have++] = line;
+            accepted++;
+        }
+        qsort(lines, have, sizeof(QueryLine), compare_lines);
+        size_t unique = 0;
+        for (size_t i = 0; i < have; i++) {
+            if (unique == 0 || lines[unique - 1].start != lines[i].start) {
+                lines[unique++] = lines[i];
+            }
+        }
+        have = unique;
+        if (accepted > 0) {
+            stale = have == before ? stale + 1 : 0;
+        }
+    }
+    int scanned = have < k;
+    if (scanned && sample_scan(f, lo, hi, k, &state, lines, &have) != 0) {
+        free(lines);
+        return -1;
+    }
+
+    if (debug) {
+        fprintf(stderr, "[DEBUG] Sampled %zu lines with %zu probes%s (seed %llu)\n",
+                have, draws, scanned ? " and a scan of the range" : "", (unsigned long long)seed);
+    }
+    *out = lines;
+    *count = have;
+    return 0;
+}
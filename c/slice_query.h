@@ -0,0 +1,80 @@
+#ifndef SLICE_QUERY_H
+#define SLICE_QUERY_H
+
+// Range queries for slice4: instead of --start/--size, the byte range is
+// worked out from the content of a sorted (or simply large) regular file by
+// probing a few lines, then streamed through the normal slicing path. Every
+// range starts and ends at a line start.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "libslice.h"
+
+#define QUERY_DEFAULT_TS_FORMAT "%Y-%m-%dT%H:%M:%S"
+
+typedef struct {
+    // --since / --until / --ts-format: lines sorted by a leading timestamp
+    const char *ts_format;
+    const char *since;    // first line with a timestamp >= since
+    const char *until;    // up to the first line with a timestamp >= until
+
+    // --key-prefix / --field-sep / --key-field: lines sorted by a key in
+    // byte order (LC_ALL=C sort), selecting those whose key starts with
+    // key_prefix
+    const char *key_prefix;
+    char field_sep;       // default tab
+    int key_field;        // 1-based field holding the key, 0 for the whole line
+
+    // --shard I/N: the I-th of N line-aligned parts of the range, the same
+    // bytes --split N writes to part I
+    size_t shard_index;
+    size_t shard_count;   // 0 when not sharding
+} RangeQuery;
+
+void query_init(RangeQuery *q);
+
+// Nonzero if any query option is set
+int query_active(const RangeQuery *q);
+
+// Parse a --field-sep value: a single byte, or \t. Returns 0, or -1.
+int query_parse_separator(const char *arg, char *out);
+
+// Parse a --shard value "I/N" with 0 <= I < N. Returns 0, or -1.
+int query_parse_shard(const char *arg, size_t *index, size_t *count);
+
+// Line start at or after lo + i/n of the way from lo to hi (both line
+// starts). Part i of an n-way split is [split_point(i), split_point(i + 1)),
+// so a line belongs to the part it starts in. Returns a negative
+// SLICE_ERR_* code on failure.
+off_t query_split_point(slice_file *f, off_t lo, off_t hi, size_t i, size_t n);
+
+// Resolve the query against filename. When several queries are given the
+// result is the intersection of their ranges, and a shard is taken of that.
+// On success stores the line-aligned range in *start and *size (possibly
+// empty) and returns 0; otherwise prints an error and returns -1.
+int query_resolve(const RangeQuery *q, const char *filename, size_t *start, size_t *size,
+                  int debug);
+
+// --sample-lines: a line of the file, [start, end) including its newline
+typedef struct {
+    off_t start;
+    off_t end;
+} QueryLine;
+
+// Pick up to k distinct random lines starting in [lo, hi), both line starts,
+// without reading the rest of the file. Each pick is a random byte offset
+// widened to the line around it, which favours long lines; with `uniform` a
+// line of length L is kept with probability m / L, m being the shortest line
+// seen, so every line is about equally likely. When probes stop finding new
+// lines (k close to the number of lines in the range), the range is walked
+// line by line and the sample completed from the lines not yet picked, so
+// exactly min(k, lines in range) lines are returned. On success stores a
+// malloc'd array sorted by offset in *out and returns 0; otherwise prints an
+// error and returns -1.
+int query_sample(slice_file *f, off_t lo, off_t hi, size_t k, uint64_t seed, int uniform,
+                 QueryLine **out, size_t *count, int debug);
+
+#endif /* SLICE_QUERY_H */
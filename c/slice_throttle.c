@@ -0,0 +1,106 @@
+#define _GNU_SOURCE  // syscall(2)
+#include "slice_throttle.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+static void bucket_init(TokenBucket *b, double rate, double min_burst) {
+    b->rate = rate;
+    b->burst = rate * THROTTLE_BURST_SEC;
+    if (b->burst < min_burst) {
+        b->burst = min_burst;
+    }
+    b->tokens = b->burst;
+}
+
+void throttle_init(IoThrottle *t, double bytes_per_sec, double ops_per_sec) {
+    bucket_init(&t->bytes, bytes_per_sec, THROTTLE_MIN_READ);
+    bucket_init(&t->ops, ops_per_sec, 1);
+    clock_gettime(CLOCK_MONOTONIC, &t->last);
+    t->slept = 0;
+}
+
+int throttle_active(const IoThrottle *t) {
+    return t->bytes.rate > 0 || t->ops.rate > 0;
+}
+
+size_t throttle_read_size(const IoThrottle *t, size_t want) {
+    if (t->bytes.rate <= 0) {
+        return want;
+    }
+    // A tenth of a second of bandwidth per read, but no smaller than the
+    // reads an operation limit leaves room for
+    double cap = t->bytes.rate * THROTTLE_BURST_SEC;
+    if (t->ops.rate > 0 && cap < t->bytes.rate / t->ops.rate) {
+        cap = t->bytes.rate / t->ops.rate;
+    }
+    if (cap < THROTTLE_MIN_READ) {
+        cap = THROTTLE_MIN_READ;
+    }
+    return (double)want > cap ? (size_t)cap : want;
+}
+
+// Refill by `elapsed` seconds, take `need` tokens and return how long the
+// debt, if any, takes to repay
+static double bucket_take(TokenBucket *b, double elapsed, double need) {
+    if (b->rate <= 0) {
+        return 0;
+    }
+    b->tokens += elapsed * b->rate;
+    if (b->tokens > b->burst) {
+        b->tokens = b->burst;
+    }
+    b->tokens -= need;
+    return b->tokens < 0 ? -b->tokens / b->rate : 0;
+}
+
+void throttle_acquire(IoThrottle *t, size_t bytes) {
+    if (!throttle_active(t)) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (double)(now.tv_sec - t->last.tv_sec) +
+                     (double)(now.tv_nsec - t->last.tv_nsec) / 1e9;
+    t->last = now;
+
+    double wait = bucket_take(&t->bytes, elapsed, (double)bytes);
+    double wait_ops = bucket_take(&t->ops, elapsed, 1);
+    if (wait_ops > wait) {
+        wait = wait_ops;
+    }
+    if (wait <= 0) {
+        return;
+    }
+    // The sleep itself is refilled by the next call's elapsed time
+    struct timespec delay = { (time_t)wait, (long)((wait - (double)(time_t)wait) * 1e9) };
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+    t->slept += wait;
+}
+
+int throttle_parse_rate(const char *arg, double *out) {
+    char *end;
+    errno = 0;
+    double v = strtod(arg, &end);
+    if (errno != 0 || end == arg || *end != '\0' || !(v > 0) || v > 1e12) {
+        return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+int throttle_set_idle_io(void) {
+#if defined(__linux__) && defined(SYS_ioprio_set)
+    // From linux/ioprio.h, which glibc does not wrap
+    const int who_process = 1, class_idle = 3, class_shift = 13;
+    return (int)syscall(SYS_ioprio_set, who_process, 0, class_idle << class_shift);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
@@ -0,0 +1,56 @@
+#ifndef SLICE_THROTTLE_H
+#define SLICE_THROTTLE_H
+
+// I/O pacing for slice4 (--max-bandwidth, --max-iops) and the idle I/O
+// scheduling class (--idle-io), so bulk slicing can share a host with
+// latency-sensitive services.
+//
+// Each limit is a token bucket refilled from CLOCK_MONOTONIC. A read takes
+// its size from the byte bucket and one token from the operation bucket; a
+// bucket may go into debt, and the read after it sleeps until the debt is
+// repaid. A bucket holds at most THROTTLE_BURST_SEC worth of tokens, so an
+// idle stretch does not turn into a burst. The cost per read is one
+// clock_gettime(2) and a few arithmetic operations.
+
+#include <stddef.h>
+#include <time.h>
+
+#define THROTTLE_BURST_SEC 0.1           // Credit a bucket can save up
+#define THROTTLE_MIN_READ (64 * 1024)    // Reads are never paced below this size
+#define THROTTLE_MB (1024.0 * 1024.0)    // --max-bandwidth unit
+
+typedef struct {
+    double rate;      // tokens per second, 0 for no limit
+    double tokens;    // negative while in debt
+    double burst;
+} TokenBucket;
+
+typedef struct {
+    TokenBucket bytes;
+    TokenBucket ops;
+    struct timespec last;   // when the buckets were last refilled
+    double slept;           // seconds spent waiting, for --debug
+} IoThrottle;
+
+// Limits of 0 mean unlimited
+void throttle_init(IoThrottle *t, double bytes_per_sec, double ops_per_sec);
+
+int throttle_active(const IoThrottle *t);
+
+// Cap a read of `want` bytes so that a bandwidth limit is met by steady
+// reads rather than by large ones separated by long pauses
+size_t throttle_read_size(const IoThrottle *t, size_t want);
+
+// Account for one I/O operation of `bytes`, sleeping first if a limit is
+// in debt
+void throttle_acquire(IoThrottle *t, size_t bytes);
+
+// Parse a positive rate such as "50" or "0.5". Returns 0, or -1 if invalid.
+int throttle_parse_rate(const char *arg, double *out);
+
+// Move the process into the idle I/O scheduling class (ioprio_set(2)), so
+// its disk requests are only served when nothing else wants the disk.
+// Returns 0, or -1 with errno set (ENOSYS outside Linux).
+int throttle_set_idle_io(void);
+
+#endif /* SLICE_THROTTLE_H */
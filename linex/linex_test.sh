@@ -578,6 +578,128 @@ function test_debug_mode() {
 
 # ===== Main Test Execution =====
 
+function test_sparse_file() {
+    log_info "Testing sparse file analysis..."
+    
+    local sparse="$TEST_DIR/sparse.log"
+    local dense="$TEST_DIR/dense.log"
+    local output="$RESULT_DIR/sparse.json"
+    local expected="$RESULT_DIR/dense.json"
+    local error="$RESULT_DIR/sparse.err"
+    
+    # Data, a 64 MB hole, more data, and a trailing hole
+    printf 'first line\nstart of a long line' > "$sparse"
+    truncate -s 64M "$sparse"
+    printf ' end of it\nlast line\n' >> "$sparse"
+    truncate -s 96M "$sparse"
+    cp --sparse=never "$sparse" "$dense" 2>/dev/null || cat "$sparse" > "$dense"
+    
+    run_command_with_timeout "$BINARY --file $sparse --json" "$output" "$error"
+    local status=$?
+    
+    if [ $status -ne 0 ]; then
+        log_error "Command failed with status $status" "$output" "" "$error"
+        return
+    fi
+    
+    run_command_with_timeout "$BINARY --file $dense --json" "$expected" "$error"
+    
+    # Holes are skipped, not scanned, but the statistics must not change
+    if ! diff <(sed -n '/"stats"/,/histogram/p' "$output") \
+              <(sed -n '/"stats"/,/histogram/p' "$expected") > /dev/null; then
+        log_error "Sparse file statistics differ from the dense copy" "$output" "" "$error"
+        return
+    fi
+    
+    rm -f "$sparse" "$dense"
+    log_success "Sparse file analysis passed"
+}
+
+function test_rate_limits() {
+    log_info "Testing I/O rate limits..."
+    
+    local paced="$TEST_DIR/paced.log"
+    local output="$RESULT_DIR/paced.json"
+    local expected="$RESULT_DIR/unpaced.json"
+    local error="$RESULT_DIR/paced.err"
+    
+    # 4 MB at 8 MB/s and at most 40 reads per second
+    head -c 4194304 /dev/zero | tr '\0' 'x' | fold -w 100 > "$paced"
+    
+    run_command_with_timeout "$BINARY --file $paced --json --max-bandwidth 8 --max-iops 40 --debug" "$output" "$error"
+    local status=$?
+    
+    if [ $status -ne 0 ]; then
+        log_error "Command failed with status $status" "$output" "" "$error"
+        return
+    fi
+    
+    if ! grep -q "Waited" "$error"; then
+        log_error "Reads were not paced" "$error"
+        return
+    fi
+    
+    run_command_with_timeout "$BINARY --file $paced --json" "$expected" "$error"
+    
+    # Pacing changes when data is read, never what is counted
+    if ! diff <(sed -n '/"stats"/,/histogram/p' "$output") \
+              <(sed -n '/"stats"/,/histogram/p' "$expected") > /dev/null; then
+        log_error "Paced statistics differ from an unpaced run" "$output" "" "$error"
+        return
+    fi
+    
+    if run_command_with_timeout "$BINARY --file $paced --max-bandwidth 0" "$output" "$error"; then
+        log_error "Zero bandwidth limit was accepted" "$output" "" "$error"
+        return
+    fi
+    
+    rm -f "$paced"
+    log_success "I/O rate limits passed"
+}
+
+function test_cache_policy() {
+    log_info "Testing page cache policies..."
+    
+    local input="$TEST_DIR/cached.log"
+    local output="$RESULT_DIR/cached.json"
+    local expected="$RESULT_DIR/uncached.json"
+    local error="$RESULT_DIR/cached.err"
+    
+    yes 'cached line of text' | head -c 4194304 > "$input"
+    run_command_with_timeout "$BINARY --file $input --json" "$expected" "$error"
+    
+    # A policy changes what stays cached, never what is counted
+    for policy in sequential noreuse drop-after; do
+        run_command_with_timeout "$BINARY --file $input --json --cache-policy $policy" "$output" "$error"
+        local status=$?
+        if [ $status -ne 0 ]; then
+            log_error "--cache-policy $policy failed with status $status" "$output" "" "$error"
+            return
+        fi
+        if ! diff <(sed -n '/"stats"/,/histogram/p' "$output") \
+                  <(sed -n '/"stats"/,/histogram/p' "$expected") > /dev/null; then
+            log_error "Statistics with --cache-policy $policy differ" "$output" "" "$error"
+            return
+        fi
+    done
+    
+    # Just read with the default policy, so the whole file is resident
+    run_command_with_timeout "$BINARY --file $input" "$expected" "$error"
+    run_command_with_timeout "$BINARY --file $input --cache-report" "$output" "$error"
+    if ! grep -Eq '^Cache: ([0-9]+) of \1 pages \(100\.0%\) resident before reading 4\.0 MB in 1 file$' "$error"; then
+        log_error "Missing or wrong cache report" "$error"
+        return
+    fi
+    
+    if run_command_with_timeout "$BINARY --file $input --cache-policy lru" "$output" "$error"; then
+        log_error "Unknown cache policy was accepted" "$output" "" "$error"
+        return
+    fi
+    
+    rm -f "$input"
+    log_success "Page cache policies passed"
+}
+
 function run_all_tests() {
     log_info "Starting linex test suite..."
     
@@ -593,6 +715,9 @@ function run_all_tests() {
     test_markdown_analysis
     test_markdown_edge_cases
     test_json_output
+    test_sparse_file
+    test_rate_limits
+    test_cache_policy
     test_directory_mode
     test_directory_with_extension
     test_recursive_directory
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // SEEK_DATA/SEEK_HOLE
 #define _FILE_OFFSET_BITS 64
 #include "linestats.h"
 #include "utils.h"
@@ -5,10 +6,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>  // for SIZE_MAX
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 
+IoThrottle io_throttle;  // Unlimited until main sets it
+CacheSettings io_cache;  // CACHE_DEFAULT, no report
+
 void init_stats(LineStats *stats) {
     memset(stats, 0, sizeof(LineStats));
 }
@@ -35,6 +40,7 @@ int analyze_file(const char *filename, LineStats *stats, int debug) {
     size_t overflow_capacity = 0;  // Capacity of overflow buffer
     int exit_code = 0;
     size_t total_line_length = 0;
+    CacheCursor cache = { .policy = CACHE_DEFAULT, .fd = -1 };
     
     // Open file using low-level I/O
     fd = open(filename, O_RDONLY);
@@ -52,6 +58,16 @@ int analyze_file(const char *filename, LineStats *stats, int debug) {
     }
 
     off_t file_size = st.st_size;
+    if (io_cache.report && file_size > 0) {
+        size_t resident, pages;
+        if (cache_residency(fd, 0, file_size, &resident, &pages) == 0) {
+            io_cache.resident_pages += resident;
+            io_cache.total_pages += pages;
+            io_cache.total_bytes += (unsigned long long)file_size;
+            io_cache.files++;
+        }
+    }
+    cache_begin(&cache, io_cache.policy, fd, 0, file_size);  // --cache-policy
     
     // Calculate optimal chunk size based on file size
     size_t chunk_size = calculate_chunk_size(file_size);
@@ -83,8 +99,65 @@ int analyze_file(const char *filename, LineStats *stats, int debug) {
     off_t current_line_start = 0;     // Start position of current line
     int line_in_overflow = 0;         // Flag to indicate if current line is in overflow
     
+    // A sparse file is walked extent by extent with SEEK_DATA/SEEK_HOLE.
+    // Holes read as zeros and contain no newline, so each one just extends
+    // the current line by its length without being scanned.
+    int sparse = 0;
+#ifdef SEEK_DATA
+    sparse = (off_t)st.st_blocks * 512 < file_size;
+#endif
+    off_t data_end = 0;               // End of the extent being read
+    
     ssize_t bytes_read;
-    while ((bytes_read = read(fd, buffer, chunk_size)) > 0) {
+    for (;;) {
+        size_t want = chunk_size;
+#ifdef SEEK_DATA
+        if (sparse && total_bytes >= data_end) {
+            off_t data = lseek(fd, total_bytes, SEEK_DATA);
+            if (data < 0 && errno != ENXIO) {
+                fprintf(stderr, "Error: cannot seek in '%s': %s\n", filename, strerror(errno));
+                exit_code = 1;
+                goto cleanup;
+            }
+            off_t hole_end = (data < 0) ? file_size : data;  // ENXIO: hole runs to EOF
+            if (hole_end > total_bytes) {
+                size_t hole = (size_t)(hole_end - total_bytes);
+                if (debug) {
+                    fprintf(stderr, "[DEBUG] Hole of %zu bytes at offset %lld\n",
+                            hole, (long long)total_bytes);
+                }
+                if (SIZE_MAX - current_line_length < hole) {
+                    fprintf(stderr, "Error: Line length overflow detected\n");
+                    exit_code = 1;
+                    goto cleanup;
+                }
+                current_line_length += hole;
+                total_bytes = hole_end;
+                if (hole_end >= file_size) {
+                    break;
+                }
+            }
+            off_t hole_start = lseek(fd, total_bytes, SEEK_HOLE);
+            data_end = (hole_start < 0) ? file_size : hole_start;
+            if (lseek(fd, total_bytes, SEEK_SET) != total_bytes) {
+                fprintf(stderr, "Error: cannot seek in '%s': %s\n", filename, strerror(errno));
+                exit_code = 1;
+                goto cleanup;
+            }
+        }
+        if (sparse && (off_t)want > data_end - total_bytes) {
+            want = (size_t)(data_end - total_bytes);
+        }
+#endif
+        // --max-bandwidth / --max-iops
+        want = throttle_read_size(&io_throttle, want);
+        throttle_acquire(&io_throttle, want);
+        cache_advance(&cache, total_bytes, want);
+        bytes_read = read(fd, buffer, want);
+        if (bytes_read <= 0) {
+            break;
+        }
+
         // Process the chunk
         for (ssize_t i = 0; i < bytes_read; i++) {
             // Increment line length safely
@@ -199,8 +272,9 @@ int analyze_file(const char *filename, LineStats *stats, int debug) {
     
     // Handle last line if not terminated with newline
     if (current_line_length > 0 || overflow_size > 0) {
-        // Determine final line length
-        size_t final_line_length = line_in_overflow ? overflow_size : current_line_length;
+        // Determine final line length. current_line_length also covers
+        // holes, which never pass through the overflow buffer.
+        size_t final_line_length = current_line_length;
         
         stats->total_lines++;
         
@@ -239,8 +313,19 @@ int analyze_file(const char *filename, LineStats *stats, int debug) {
     }
     
 cleanup:
+    cache_end(&cache);
     if (buffer) free(buffer);
     if (overflow_buffer) free(overflow_buffer);
     if (fd >= 0) close(fd);
     return exit_code;
-}
\ No newline at end of file
+}
+
+void print_cache_report(void) {
+    if (!io_cache.report) {
+        return;
+    }
+    fprintf(stderr, "Cache: %zu of %zu pages (%.1f%%) resident before reading %.1f MB in %zu file%s\n",
+            io_cache.resident_pages, io_cache.total_pages,
+            io_cache.total_pages ? 100.0 * (double)io_cache.resident_pages / (double)io_cache.total_pages : 0.0,
+            (double)io_cache.total_bytes / (1024.0 * 1024.0), io_cache.files, io_cache.files == 1 ? "" : "s");
+}
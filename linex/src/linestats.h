@@ -4,6 +4,8 @@
 #include <stddef.h>
 #include <sys/types.h>
 #include "utils.h"
+#include "slice_throttle.h"
+#include "slice_cache.h"
 
 // Struct to hold line statistics for a single file
 typedef struct {
@@ -24,6 +26,25 @@ void init_stats(LineStats *stats);
 // Update the histogram for a line of a specific length
 int update_histogram(LineStats *stats, size_t line_length);
 
+// --max-bandwidth / --max-iops: one budget for every file analyzed
+extern IoThrottle io_throttle;
+
+// --cache-policy for every file analyzed, and the --cache-report totals
+typedef struct {
+    CachePolicy policy;
+    int report;                  // Count residency before each file is read
+    size_t resident_pages;       // Pages already cached when a file was opened
+    size_t total_pages;
+    size_t files;
+    unsigned long long total_bytes;
+} CacheSettings;
+
+extern CacheSettings io_cache;
+
+// --cache-report: print the residency totals on stderr. Does nothing
+// unless io_cache.report is set.
+void print_cache_report(void);
+
 // Analyze a file and collect line statistics
 int analyze_file(const char *filename, LineStats *stats, int debug);
 
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
 
 #include "utils.h"
 #include "linestats.h"
@@ -25,6 +26,10 @@ int main(int argc, char *argv[]) {
     OperationMode mode = MODE_SINGLE_FILE;
     int sample_size = 0;
     int random_seed = time(NULL);
+    double max_bandwidth = 0, max_iops = 0;
+    int idle_io = 0;
+    CachePolicy cache_policy = CACHE_DEFAULT;
+    int cache_report_wanted = 0;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -59,6 +64,25 @@ int main(int argc, char *argv[]) {
             }
         } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
             random_seed = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--max-bandwidth") && i + 1 < argc) {
+            if (throttle_parse_rate(argv[++i], &max_bandwidth) != 0) {
+                fprintf(stderr, "Error: --max-bandwidth must be a positive number of MB/s\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--max-iops") && i + 1 < argc) {
+            if (throttle_parse_rate(argv[++i], &max_iops) != 0) {
+                fprintf(stderr, "Error: --max-iops must be a positive number\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--idle-io")) {
+            idle_io = 1;
+        } else if (!strcmp(argv[i], "--cache-policy") && i + 1 < argc) {
+            if (parse_cache_policy(argv[++i], &cache_policy) != 0) {
+                fprintf(stderr, "Error: --cache-policy must be default, sequential, noreuse or drop-after\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--cache-report")) {
+            cache_report_wanted = 1;
         } else {
             fprintf(stderr, "Unknown or incomplete option: %s\n", argv[i]);
             show_help();
@@ -114,6 +138,19 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    // I/O limits and the cache policy apply to every file analyzed from
+    // here on
+    throttle_init(&io_throttle, max_bandwidth * THROTTLE_MB, max_iops);
+    io_cache.policy = cache_policy;
+    io_cache.report = cache_report_wanted;
+    if (idle_io) {
+        if (throttle_set_idle_io() != 0) {
+            fprintf(stderr, "Warning: cannot use the idle I/O class: %s\n", strerror(errno));
+        } else if (debug) {
+            fprintf(stderr, "[DEBUG] I/O scheduling class: idle\n");
+        }
+    }
+    
     // Create file list from directory if specified
     char **filenames = NULL;
     int file_count = 0;
@@ -274,6 +311,11 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (debug && throttle_active(&io_throttle)) {
+        fprintf(stderr, "[DEBUG] Waited %.3f s for --max-bandwidth/--max-iops\n", io_throttle.slept);
+    }
+    print_cache_report();
+    
     // Clean up file list if allocated
     if (filenames != NULL) {
         cleanup_file_list(filenames, file_count);
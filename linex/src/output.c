@@ -138,6 +138,14 @@ void show_help() {
     printf("  --config-output <path>     Output path for configuration file (default: .linexrc)\n");
     printf("  --markdown                 Analyze markdown structure (if file is markdown)\n");
     printf("  --json                     Output results in JSON format\n");
+    printf("  --max-bandwidth <MB/s>     Read at most this many MB (2^20 bytes) per second\n");
+    printf("  --max-iops <n>             Issue at most n reads per second\n");
+    printf("  --idle-io                  Use the idle I/O scheduling class (Linux only)\n");
+    printf("  --cache-policy <policy>    Page cache use: default, sequential (read ahead),\n");
+    printf("                             noreuse (evict only what the scan brought in) or\n");
+    printf("                             drop-after (evict each file once read)\n");
+    printf("  --cache-report             Print how much of the input was in the page cache\n");
+    printf("                             before reading (on stderr)\n");
     printf("  --debug                    Print internal debug info\n");
     printf("  --help                     Show this help message\n\n");
     printf("EXAMPLES:\n");
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <limits.h>
+#include <stdint.h>  // for SIZE_MAX
 
 // Calculate optimal chunk size based on file size
 size_t calculate_chunk_size(off_t file_size) {
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Consumer for `slice4 --output-memfd`, used by test_slice4.sh.
+
+usage: memfd_receiver.py SOCKET
+
+Listens on SOCKET, accepts one memfd passed with SCM_RIGHTS, checks that it
+is sealed and that its size matches the length sent with it, then writes its
+contents to stdout through a read-only mapping.
+"""
+import fcntl
+import mmap
+import os
+import socket
+import struct
+import sys
+
+# Linux values, for Pythons whose fcntl module does not export them
+F_GET_SEALS = getattr(fcntl, "F_GET_SEALS", 1034)
+REQUIRED_SEALS = 0x1 | 0x2 | 0x4 | 0x8  # F_SEAL_SEAL, SHRINK, GROW, WRITE
+
+
+def main(argv):
+    if len(argv) != 2:
+        sys.exit(__doc__)
+    sock_path = argv[1]
+
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    server.bind(sock_path)
+    server.listen(1)
+    conn, _ = server.accept()
+    data, fds, _, _ = socket.recv_fds(conn, 8, 1)
+    conn.close()
+    server.close()
+    os.unlink(sock_path)
+
+    if len(data) != 8 or len(fds) != 1:
+        sys.exit("expected a length and one descriptor")
+    (length,) = struct.unpack("=Q", data)
+    fd = fds[0]
+
+    seals = fcntl.fcntl(fd, F_GET_SEALS)
+    if seals & REQUIRED_SEALS != REQUIRED_SEALS:
+        sys.exit("memfd is not sealed (seals=%#x)" % seals)
+    if os.fstat(fd).st_size != length:
+        sys.exit("length %d does not match memfd size %d" % (length, os.fstat(fd).st_size))
+    try:
+        os.pwrite(fd, b"x", 0)
+        sys.exit("write to a sealed memfd succeeded")
+    except OSError:
+        pass
+
+    if length > 0:
+        with mmap.mmap(fd, length, prot=mmap.PROT_READ) as view:
+            sys.stdout.buffer.write(view)
+    os.close(fd)
+
+
+if __name__ == "__main__":
+    main(sys.argv)
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+"""Minimal stand-in for an object-storage gateway: `python -m http.server`
+with single-range support (RFC 7233), used by test_slice4.sh.
+
+Serves the current directory on 127.0.0.1, prints the chosen port on the
+first line of stdout and logs one line per request to range_server.log.
+"""
+import http.server
+import os
+import re
+import sys
+
+RANGE_RE = re.compile(r"bytes=(\d*)-(\d*)$")
+
+
+class RangeHandler(http.server.SimpleHTTPRequestHandler):
+    def do_GET(self):
+        path = self.translate_path(self.path)
+        if not os.path.isfile(path):
+            self.send_error(404)
+            return
+
+        size = os.path.getsize(path)
+        match = RANGE_RE.match(self.headers.get("Range", ""))
+        if not match:
+            return super().do_GET()
+
+        first, last = match.groups()
+        if first == "":
+            first, last = max(size - int(last), 0), size - 1
+        else:
+            first = int(first)
+            last = min(int(last), size - 1) if last else size - 1
+        if first >= size or first > last:
+            self.send_response(416)
+            self.send_header("Content-Range", "bytes */%d" % size)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+
+        self.send_response(206)
+        self.send_header("Content-Range", "bytes %d-%d/%d" % (first, last, size))
+        self.send_header("Content-Length", str(last - first + 1))
+        self.end_headers()
+        with open(path, "rb") as f:
+            f.seek(first)
+            self.wfile.write(f.read(last - first + 1))
+
+    def log_message(self, fmt, *args):
+        with open("range_server.log", "a") as log:
+            log.write("%s %s\n" % (self.headers.get("Range", "-"), fmt % args))
+
+
+if __name__ == "__main__":
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), RangeHandler)
+    print(server.server_address[1], flush=True)
+    sys.stdout.close()
+    server.serve_forever()
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""Client for `slice4 --serve`, used by test_slice4.sh.
+
+usage: slice_client.py SOCKET FILE START SIZE [--full-lines-only] [--repeat N]
+
+Sends the request N times over one connection (default 1), writes the last
+payload to stdout and reports the mean round-trip time on stderr. Exits with
+the errno returned by the daemon on failure.
+"""
+import os
+import socket
+import struct
+import sys
+import time
+
+MAGIC = 0x31434C53  # "SLC1"
+FLAG_FULL_LINES = 0x1
+REQUEST = struct.Struct("=IIQQII")
+RESPONSE = struct.Struct("=IiQ")
+
+
+def recv_exact(sock, n):
+    chunks = []
+    while n > 0:
+        chunk = sock.recv(min(n, 1 << 20))
+        if not chunk:
+            raise EOFError("daemon closed the connection")
+        chunks.append(chunk)
+        n -= len(chunk)
+    return b"".join(chunks)
+
+
+def main(argv):
+    if len(argv) < 5:
+        sys.exit(__doc__)
+    sock_path, path, start, size = argv[1], argv[2].encode(), int(argv[3]), int(argv[4])
+    flags = FLAG_FULL_LINES if "--full-lines-only" in argv else 0
+    repeat = int(argv[argv.index("--repeat") + 1]) if "--repeat" in argv else 1
+
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(sock_path)
+    request = REQUEST.pack(MAGIC, flags, start, size, len(path), 0) + path
+
+    began = time.perf_counter()
+    for _ in range(repeat):
+        sock.sendall(request)
+        magic, status, length = RESPONSE.unpack(recv_exact(sock, RESPONSE.size))
+        if magic != MAGIC:
+            sys.exit("bad response magic")
+        if status != 0:
+            print("slice daemon: %s" % os.strerror(status), file=sys.stderr)
+            sys.exit(status)
+        payload = recv_exact(sock, length)
+    elapsed = time.perf_counter() - began
+
+    sys.stdout.buffer.write(payload)
+    print("mean round trip: %.1f us" % (elapsed / repeat * 1e6), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main(sys.argv)
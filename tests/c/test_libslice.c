@@ -0,0 +1,143 @@
+// Tests for the libslice API, built and run by test_slice4.sh:
+//   cc -I../../c test_libslice.c ../../c/libslice.a -o test_libslice
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "libslice.h"
+
+static int failures = 0;
+
+static void expect_view(const char *name, const slice_view *v, const char *expected) {
+    size_t len = strlen(expected);
+    printf("=== RUN   %s\n", name);
+    if (v->len == len && memcmp(v->data, expected, len) == 0) {
+        printf("--- PASS: %s\n", name);
+    } else {
+        printf("--- FAIL: %s: expected \"%s\", got %zu bytes \"%.*s\"\n",
+               name, expected, v->len, (int)v->len, v->data);
+        failures++;
+    }
+}
+
+static void expect_rc(const char *name, int rc, int expected) {
+    printf("=== RUN   %s\n", name);
+    if (rc == expected) {
+        printf("--- PASS: %s\n", name);
+    } else {
+        printf("--- FAIL: %s: expected %d (%s), got %d (%s)\n", name,
+               expected, slice_strerror(expected), rc, slice_strerror(rc));
+        failures++;
+    }
+}
+
+static int before_line_2(const char *text, size_t len, void *arg) {
+    (void)arg;
+    return len >= 6 && memcmp(text, "Line 2", 6) < 0;
+}
+
+static int always_before(const char *text, size_t len, void *arg) {
+    (void)text;
+    (void)len;
+    (void)arg;
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <file containing \"Line 1\\nLine 2\\nLine 3\\n\">\n", argv[0]);
+        return 2;
+    }
+
+    slice_file *f;
+    slice_view v;
+    int rc = slice_open(argv[1], &f);
+    expect_rc("test_open", rc, SLICE_OK);
+    if (rc != SLICE_OK) {
+        return 1;
+    }
+
+    expect_rc("test_range", slice_range(f, 7, 7, &v), SLICE_OK);
+    expect_view("test_range_data", &v, "Line 2\n");
+    slice_release(&v);
+
+    slice_range(f, 19, 100, &v);
+    expect_view("test_range_clipped_at_eof", &v, "3\n");
+    slice_release(&v);
+
+    slice_range(f, 30, 10, &v);
+    expect_view("test_range_beyond_eof", &v, "");
+    slice_release(&v);
+
+    slice_range_lines(f, 3, 14, &v);
+    expect_view("test_range_lines", &v, "Line 2\n");
+    slice_release(&v);
+
+    slice_range_lines(f, 0, 10, &v);
+    expect_view("test_range_lines_from_zero", &v, "Line 1\n");
+    slice_release(&v);
+
+    slice_range_lines(f, 1, 5, &v);
+    expect_view("test_range_lines_all_trimmed", &v, "");
+    slice_release(&v);
+
+    // Views borrow from the same mapping and may overlap
+    slice_view a, b;
+    slice_range(f, 0, 7, &a);
+    slice_range(f, 0, 21, &b);
+    printf("=== RUN   test_views_are_borrowed\n");
+    if (a.owned == NULL && a.data == b.data) {
+        printf("--- PASS: test_views_are_borrowed\n");
+    } else {
+        printf("--- FAIL: test_views_are_borrowed\n");
+        failures++;
+    }
+    slice_release(&a);
+    slice_release(&b);
+
+    expect_rc("test_negative_start", slice_range(f, -1, 5, &v), SLICE_ERR_INVALID);
+
+    expect_rc("test_line_start_at_line", (int)slice_line_start(f, 7), 7);
+    expect_rc("test_line_start_mid_line", (int)slice_line_start(f, 8), 14);
+    expect_rc("test_line_start_last_line", (int)slice_line_start(f, 15), 21);
+    expect_rc("test_line_start_before", (int)slice_line_start_before(f, 12), 7);
+
+    // First line not before "Line 2" in line order
+    off_t found = -1;
+    rc = slice_bisect(f, before_line_2, NULL, &found);
+    expect_rc("test_bisect", rc == SLICE_OK ? (int)found : rc, 7);
+    rc = slice_bisect(f, always_before, NULL, &found);
+    expect_rc("test_bisect_past_end", rc == SLICE_OK ? (int)found : rc, 21);
+    slice_close(f);
+
+    expect_rc("test_open_missing", slice_open("does-not-exist.txt", &f), SLICE_ERR_OPEN);
+    expect_rc("test_open_directory", slice_open(".", &f), SLICE_ERR_NOT_REGULAR);
+
+    // A descriptor passed in stays open after slice_close
+    int fd = open(argv[1], O_RDONLY);
+    expect_rc("test_open_fd", slice_open_fd(fd, &f), SLICE_OK);
+    slice_close(f);
+    expect_rc("test_open_fd_not_closed", fcntl(fd, F_GETFD) >= 0 ? SLICE_OK : SLICE_ERR_IO, SLICE_OK);
+    close(fd);
+
+    // Memory the caller keeps: views point into it
+    static const char text[] = "one\ntwo\nthree";
+    expect_rc("test_open_mem", slice_open_mem(text, sizeof(text) - 1, &f), SLICE_OK);
+    slice_range_lines(f, 2, 20, &v);
+    expect_view("test_mem_range_lines", &v, "two\n");
+    expect_rc("test_mem_borrowed", v.data == text + 4 ? SLICE_OK : -99, SLICE_OK);
+    slice_release(&v);
+    slice_unmap_range(f, 0, sizeof(text));  // Not a mapping: nothing to do
+    slice_close(f);
+
+    size_t n = 0;
+    expect_rc("test_parse_size", slice_parse_size("4096", &n) == SLICE_OK && n == 4096 ? SLICE_OK : -99, SLICE_OK);
+    expect_rc("test_parse_size_negative", slice_parse_size("-5", &n), SLICE_ERR_INVALID);
+    expect_rc("test_parse_size_garbage", slice_parse_size("12abc", &n), SLICE_ERR_INVALID);
+    expect_rc("test_parse_size_overflow", slice_parse_size("99999999999999999999999", &n), SLICE_ERR_RANGE);
+
+    return failures == 0 ? 0 : 1;
+}
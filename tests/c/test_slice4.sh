@@ -0,0 +1,1252 @@
+#!/bin/bash
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+SLICE_SRC_DIR="$SCRIPT_DIR/../../c"
+SLICE_BIN="$SLICE_SRC_DIR/slice4"
+WORK_DIR="$SCRIPT_DIR/slice4_work"
+OUT_FILE="$WORK_DIR/output.txt"
+EXPECT_FILE="$WORK_DIR/expected.txt"
+DEBUG_FILE="$WORK_DIR/debug.txt"
+
+debug() {
+  echo "DEBUG: $*"
+}
+
+compile_slice4() {
+  debug "Compiling slice4 binary..."
+  (cd "$SLICE_SRC_DIR" && make -s slice4)
+  if [[ ! -x "$SLICE_BIN" ]]; then
+    echo "ERROR: $SLICE_BIN not found or not executable"
+    exit 1
+  fi
+}
+
+# run_test <name> <expected> <slice4 args...>
+run_test() {
+  local name=$1
+  local expected=$2
+  shift 2
+
+  echo "=== RUN   $name"
+
+  printf "%s" "$expected" > "$EXPECT_FILE"
+  "$SLICE_BIN" "$@" > "$OUT_FILE" 2> "$DEBUG_FILE"
+
+  if cmp -s "$OUT_FILE" "$EXPECT_FILE"; then
+    echo "--- PASS: $name"
+  else
+    echo "--- FAIL: $name"
+    echo "    Expected bytes:"
+    xxd "$EXPECT_FILE"
+    echo "    Got bytes:"
+    xxd "$OUT_FILE"
+    echo "    Debug output:"
+    cat "$DEBUG_FILE"
+    exit 1
+  fi
+
+  rm -f "$OUT_FILE" "$EXPECT_FILE" "$DEBUG_FILE"
+}
+
+# check_output <name>: compare $OUT_FILE with $EXPECT_FILE produced by the caller
+check_output() {
+  local name=$1
+  if cmp -s "$OUT_FILE" "$EXPECT_FILE"; then
+    echo "--- PASS: $name"
+  else
+    echo "--- FAIL: $name"
+    cmp "$OUT_FILE" "$EXPECT_FILE" || true
+    exit 1
+  fi
+  rm -f "$OUT_FILE" "$EXPECT_FILE"
+}
+
+run_test_expect_error() {
+  local name=$1
+  shift
+  echo "=== RUN   $name"
+  if "$SLICE_BIN" "$@" > "$OUT_FILE" 2>&1; then
+    echo "--- FAIL: $name (expected error, got success)"
+    cat "$OUT_FILE"
+    exit 1
+  else
+    echo "--- PASS: $name"
+  fi
+  rm -f "$OUT_FILE"
+}
+
+# === Setup
+debug "Working directory: $WORK_DIR"
+compile_slice4
+rm -rf "$WORK_DIR"
+mkdir -p "$WORK_DIR"
+cd "$WORK_DIR"
+
+printf 'Line 1\nLine 2\nLine 3\n' > input.txt
+
+# === Basic slicing (same contract as slice)
+run_test test_basic_slice $'Line 2\n' --start 7 --size 7 --file input.txt
+run_test test_full_lines_only $'Line 2\n' --start 3 --size 14 --file input.txt --full-lines-only
+run_test test_start_beyond_eof "" --start 30 --size 10 --file input.txt
+run_test_expect_error test_size_zero --start 0 --size 0 --file input.txt
+
+# === libslice API
+echo "=== RUN   test_libslice"
+(cd "$SLICE_SRC_DIR" && make -s libslice.a)
+cc -Wall -O2 -I"$SLICE_SRC_DIR" "$SCRIPT_DIR/test_libslice.c" "$SLICE_SRC_DIR/libslice.a" -o test_libslice
+./test_libslice input.txt
+echo "--- PASS: test_libslice"
+
+# === Virtual concatenation (--files-from)
+printf 'seg1 a\nseg1 b\n' > seg1.txt
+: > seg_empty.txt
+printf 'seg2 a\nseg2 b\n' > seg2.txt
+printf 'seg1.txt\n\nseg_empty.txt\nseg2.txt\n' > segments.list
+
+run_test test_files_from_whole $'seg1 a\nseg1 b\nseg2 a\nseg2 b\n' \
+  --start 0 --size 100 --files-from segments.list
+run_test test_files_from_across_boundary $'1 b\nseg2 a' \
+  --start 10 --size 10 --files-from segments.list
+run_test test_files_from_full_lines $'seg1 b\nseg2 a\n' \
+  --start 3 --size 20 --files-from segments.list --full-lines-only
+run_test test_files_from_second_file $'seg2 b\n' \
+  --start 21 --size 100 --files-from segments.list
+run_test test_break_at_files $'1 b\n' \
+  --start 10 --size 10 --files-from segments.list --break-at-files
+run_test test_break_at_files_later_segment $'eg2 b\n' \
+  --start 22 --size 10 --files-from segments.list --break-at-files
+run_test_expect_error test_file_and_files_from \
+  --start 0 --size 1 --file input.txt --files-from segments.list
+printf 'missing.txt\n' > missing.list
+run_test_expect_error test_files_from_missing_entry \
+  --start 0 --size 1 --files-from missing.list
+
+# === Streaming input (stdin, FIFOs)
+echo "=== RUN   test_stdin_pipe"
+printf 'Line 2\n' > "$EXPECT_FILE"
+cat input.txt | "$SLICE_BIN" --start 7 --size 7 --file - > "$OUT_FILE"
+check_output test_stdin_pipe
+
+echo "=== RUN   test_stdin_pipe_full_lines"
+seq 1 20000 > numbers.txt
+"$SLICE_BIN" --start 5000 --size 40000 --file numbers.txt --full-lines-only > "$EXPECT_FILE"
+cat numbers.txt | "$SLICE_BIN" --start 5000 --size 40000 --file - --full-lines-only > "$OUT_FILE"
+check_output test_stdin_pipe_full_lines
+
+echo "=== RUN   test_fifo_input"
+"$SLICE_BIN" --start 5000 --size 40000 --file numbers.txt --full-lines-only > "$EXPECT_FILE"
+mkfifo input.fifo
+cat numbers.txt > input.fifo &
+"$SLICE_BIN" --start 5000 --size 40000 --file input.fifo --full-lines-only > "$OUT_FILE"
+wait
+check_output test_fifo_input
+
+run_test test_stdin_start_beyond_end "" --start 100 --size 5 --file - < <(cat input.txt)
+
+echo "=== RUN   test_character_device"
+head -c 4 /dev/zero > "$EXPECT_FILE"
+"$SLICE_BIN" --start 10 --size 4 --file /dev/zero > "$OUT_FILE"
+check_output test_character_device
+
+# === Sparse files (holes are skipped, not read)
+printf 'first line\nstart of a long line' > sparse.bin
+truncate -s 32M sparse.bin
+printf ' end of it\nmiddle line\n' >> sparse.bin
+truncate -s 64M sparse.bin
+printf 'last line\n' >> sparse.bin
+
+echo "=== RUN   test_sparse_to_file"
+cat sparse.bin > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size 100000000 --file sparse.bin > "$OUT_FILE"
+check_output test_sparse_to_file
+
+echo "=== RUN   test_sparse_to_pipe"
+cat sparse.bin | "$SLICE_BIN" --start 5 --size 40000000 --file - > "$EXPECT_FILE"
+"$SLICE_BIN" --start 5 --size 40000000 --file sparse.bin | cat > "$OUT_FILE"
+check_output test_sparse_to_pipe
+
+echo "=== RUN   test_sparse_full_lines"
+cat sparse.bin | "$SLICE_BIN" --start 3 --size 60000000 --file - --full-lines-only > "$EXPECT_FILE"
+"$SLICE_BIN" --start 3 --size 60000000 --file sparse.bin --full-lines-only > "$OUT_FILE"
+check_output test_sparse_full_lines
+
+# === HTTP Range backend (--url) against a local stand-in server
+SERVER_PID=""
+stop_server() {
+  [[ -n "$SERVER_PID" ]] && kill "$SERVER_PID" 2>/dev/null || true
+}
+trap stop_server EXIT
+
+python3 "$SCRIPT_DIR/range_server.py" > server.port &
+SERVER_PID=$!
+for _ in $(seq 1 50); do
+  [[ -s server.port ]] && break
+  sleep 0.1
+done
+BASE_URL="http://127.0.0.1:$(head -n1 server.port)"
+debug "Range server at $BASE_URL"
+
+run_test test_url_basic $'Line 2\n' --start 7 --size 7 --url "$BASE_URL/input.txt"
+run_test test_url_full_lines $'Line 2\n' --start 3 --size 14 --url "$BASE_URL/input.txt" --full-lines-only
+run_test test_url_start_beyond_end "" --start 30 --size 10 --url "$BASE_URL/input.txt"
+run_test_expect_error test_url_missing_object --start 0 --size 10 --url "$BASE_URL/missing.txt"
+
+# Large enough for parallel ranged GETs (8 MB parts)
+seq 1 4000000 > large.txt
+echo "=== RUN   test_url_parallel_parts"
+"$SLICE_BIN" --start 1234 --size 25000000 --file large.txt > "$EXPECT_FILE"
+"$SLICE_BIN" --start 1234 --size 25000000 --url "$BASE_URL/large.txt" --connections 3 > "$OUT_FILE"
+check_output test_url_parallel_parts
+
+echo "=== RUN   test_url_parallel_full_lines"
+"$SLICE_BIN" --start 1234 --size 25000000 --file large.txt --full-lines-only > "$EXPECT_FILE"
+"$SLICE_BIN" --start 1234 --size 25000000 --url "$BASE_URL/large.txt" --full-lines-only > "$OUT_FILE"
+check_output test_url_parallel_full_lines
+
+# Boundaries are found with small probes, not by downloading the slice
+echo "=== RUN   test_url_probes_are_small"
+: > range_server.log
+"$SLICE_BIN" --start 1000 --size 3000000 --url "$BASE_URL/large.txt" --full-lines-only > /dev/null
+probes=$(grep -c '^bytes=' range_server.log)
+if [[ "$probes" -le 4 ]]; then
+  echo "--- PASS: test_url_probes_are_small"
+else
+  echo "--- FAIL: test_url_probes_are_small ($probes requests)"
+  cat range_server.log
+  exit 1
+fi
+
+stop_server
+trap - EXIT
+
+# === Slice daemon (--serve)
+SOCKET="$WORK_DIR/slice.sock"
+CLIENT="$SCRIPT_DIR/slice_client.py"
+"$SLICE_BIN" --serve "$SOCKET" 2> serve.log &
+SERVE_PID=$!
+trap 'kill $SERVE_PID 2>/dev/null || true' EXIT
+for _ in $(seq 1 50); do
+  [[ -S "$SOCKET" ]] && break
+  sleep 0.1
+done
+
+echo "=== RUN   test_serve_basic"
+printf 'Line 2\n' > "$EXPECT_FILE"
+python3 "$CLIENT" "$SOCKET" "$WORK_DIR/input.txt" 7 7 > "$OUT_FILE" 2> /dev/null
+check_output test_serve_basic
+
+echo "=== RUN   test_serve_full_lines_repeated"
+"$SLICE_BIN" --start 5000 --size 40000 --file numbers.txt --full-lines-only > "$EXPECT_FILE"
+python3 "$CLIENT" "$SOCKET" "$WORK_DIR/numbers.txt" 5000 40000 --full-lines-only --repeat 50 \
+  > "$OUT_FILE" 2> /dev/null
+check_output test_serve_full_lines_repeated
+
+echo "=== RUN   test_serve_file_replaced"
+printf 'old contents\n' > changing.txt
+python3 "$CLIENT" "$SOCKET" "$WORK_DIR/changing.txt" 0 100 > /dev/null 2>&1
+printf 'new contents, longer\n' > changing.txt.tmp
+mv changing.txt.tmp changing.txt
+printf 'new contents, longer\n' > "$EXPECT_FILE"
+python3 "$CLIENT" "$SOCKET" "$WORK_DIR/changing.txt" 0 100 > "$OUT_FILE" 2> /dev/null
+check_output test_serve_file_replaced
+
+echo "=== RUN   test_serve_missing_file"
+if python3 "$CLIENT" "$SOCKET" "$WORK_DIR/missing.txt" 0 10 > /dev/null 2>&1; then
+  echo "--- FAIL: test_serve_missing_file (expected error, got success)"
+  exit 1
+fi
+echo "--- PASS: test_serve_missing_file"
+
+echo "=== RUN   test_serve_socket_removed_on_exit"
+kill "$SERVE_PID"
+wait "$SERVE_PID" || true
+trap - EXIT
+if [[ -e "$SOCKET" ]]; then
+  echo "--- FAIL: test_serve_socket_removed_on_exit"
+  exit 1
+fi
+echo "--- PASS: test_serve_socket_removed_on_exit"
+
+# === Chunking (--chunk-size, --overlap, --out-format)
+# expected_chunks <chunk size> <overlap> <slice4 args...>: one slice4 run per chunk
+expected_chunks() {
+  local chunk=$1 overlap=$2
+  shift 2
+  local total
+  total=$(wc -c < numbers.txt)
+  for ((off = 0; off < total; off += chunk - overlap)); do
+    "$SLICE_BIN" --start "$off" --size "$chunk" --file numbers.txt "$@"
+    ((off + chunk >= total)) && break
+  done
+}
+
+echo "=== RUN   test_chunks_raw"
+expected_chunks 3000 1000 > "$EXPECT_FILE"
+"$SLICE_BIN" --file numbers.txt --chunk-size 3000 --overlap 1000 > "$OUT_FILE"
+check_output test_chunks_raw
+
+echo "=== RUN   test_chunks_raw_full_lines"
+expected_chunks 3000 1000 --full-lines-only > "$EXPECT_FILE"
+"$SLICE_BIN" --file numbers.txt --chunk-size 3000 --overlap 1000 --full-lines-only > "$OUT_FILE"
+check_output test_chunks_raw_full_lines
+
+echo "=== RUN   test_chunks_tar"
+"$SLICE_BIN" --file numbers.txt --chunk-size 3000 --overlap 1000 --full-lines-only \
+  --out-format tar > chunks.tar
+python3 - chunks.tar numbers.txt "$SLICE_BIN" <<'PY'
+import subprocess, sys, tarfile
+archive, source, slice_bin = sys.argv[1:]
+data = open(source, "rb").read()
+members = tarfile.open(archive).getmembers()
+assert len(members) > 1, "too few entries"
+for i, m in enumerate(members):
+    assert m.name == "chunk_%06d.txt" % i, m.name
+    payload = tarfile.open(archive).extractfile(m).read()
+    start, end = int(m.pax_headers["SLICE.start"]), int(m.pax_headers["SLICE.end"])
+    assert payload == data[start:end], m.name
+    expected = subprocess.run([slice_bin, "--start", str(i * 2000), "--size", "3000",
+                               "--file", source, "--full-lines-only"],
+                              capture_output=True, check=True).stdout
+    assert payload == expected, m.name
+assert m.pax_headers["SLICE.source"] == source
+PY
+if tar tf chunks.tar 2> /dev/null | head -1 | grep -qx 'chunk_000000.txt'; then
+  echo "--- PASS: test_chunks_tar"
+else
+  echo "--- FAIL: test_chunks_tar (tar cannot list the archive)"
+  exit 1
+fi
+
+echo "=== RUN   test_chunks_tar_single_slice"
+"$SLICE_BIN" --start 7 --size 7 --file input.txt --out-format tar > one.tar
+printf 'Line 2\n' > "$EXPECT_FILE"
+tar xOf one.tar chunk_000000.txt > "$OUT_FILE" 2> /dev/null
+check_output test_chunks_tar_single_slice
+
+# check_pack <prefix> <source> <expected entries>: every entry matches its
+# source range and hash
+check_pack() {
+  python3 - "$@" <<'PY'
+import mmap, struct, sys
+prefix, source, expected = sys.argv[1], sys.argv[2], int(sys.argv[3])
+src = open(source, "rb").read()
+with open(prefix + ".idx", "rb") as f:
+    index = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+with open(prefix + ".data", "rb") as f:
+    data = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+magic, version, entry_size = struct.unpack_from("=8sII", index, 0)
+assert magic == b"SLCPACK1" and version == 1 and entry_size == 48
+count = (len(index) - 32) // entry_size
+assert count == expected and len(index) == 32 + count * entry_size, count
+for i in range(count):
+    off, length, start, end, h, _ = struct.unpack_from("=6Q", index, 32 + i * entry_size)
+    payload = data[off:off + length]
+    assert payload == src[start:end], i
+    fnv = 14695981039346656037
+    for b in payload:
+        fnv = ((fnv ^ b) * 1099511628211) & (2**64 - 1)
+    assert fnv == h, i
+PY
+}
+
+echo "=== RUN   test_chunks_pack"
+rm -f pack.data pack.idx
+"$SLICE_BIN" --file numbers.txt --chunk-size 3000 --overlap 1000 --full-lines-only \
+  --out-format pack --pack-prefix pack
+expected_chunks 3000 1000 --full-lines-only > "$EXPECT_FILE"
+cp pack.data "$OUT_FILE"
+check_output test_chunks_pack
+entries=$(( ($(wc -c < pack.idx) - 32) / 48 ))
+check_pack pack numbers.txt "$entries"
+
+echo "=== RUN   test_chunks_pack_append"
+printf 'torn' >> pack.idx
+"$SLICE_BIN" --start 100 --size 500 --file numbers.txt --out-format pack --pack-prefix pack
+check_pack pack numbers.txt $((entries + 1))
+echo "--- PASS: test_chunks_pack_append"
+
+run_test_expect_error test_chunks_pack_needs_prefix \
+  --file numbers.txt --chunk-size 100 --out-format pack
+printf 'not an index' > bad.idx
+run_test_expect_error test_chunks_pack_bad_index \
+  --file numbers.txt --chunk-size 100 --out-format pack --pack-prefix bad
+
+# Arrow output is checked with pyarrow when it is installed
+if python3 -c 'import pyarrow' 2> /dev/null; then
+  echo "=== RUN   test_chunks_arrow"
+  "$SLICE_BIN" --file numbers.txt --chunk-size 3000 --overlap 1000 --full-lines-only \
+    --out-format arrow > chunks.arrow
+  expected_chunks 3000 1000 --full-lines-only > "$EXPECT_FILE"
+  python3 - chunks.arrow numbers.txt > "$OUT_FILE" <<'PY'
+import sys
+import pyarrow.ipc as ipc
+stream, source = sys.argv[1:]
+table = ipc.open_stream(open(stream, "rb").read()).read_all()
+table.validate(full=True)
+assert table.column_names == ["source", "start", "end", "text"]
+data = open(source, "rb").read()
+for src, start, end, text in zip(*(c.to_pylist() for c in table.columns)):
+    assert src == source and data[start:end].decode() == text
+    sys.stdout.write(text)
+PY
+  check_output test_chunks_arrow
+
+  echo "=== RUN   test_chunks_arrow_many_batches"
+  "$SLICE_BIN" --file large.txt --chunk-size 100 --out-format arrow > chunks.arrow
+  python3 - chunks.arrow > "$OUT_FILE" <<'PY'
+import sys
+import pyarrow.ipc as ipc
+table = ipc.open_stream(open(sys.argv[1], "rb").read()).read_all()
+assert len(table.to_batches()) > 1
+sys.stdout.write("".join(table.column("text").to_pylist()))
+PY
+  cp large.txt "$EXPECT_FILE"
+  check_output test_chunks_arrow_many_batches
+else
+  echo "SKIP: pyarrow not installed, Arrow output not checked"
+fi
+
+echo "=== RUN   test_chunks_binary_framing"
+"$SLICE_BIN" --file numbers.txt --chunk-size 3000 --overlap 1000 --full-lines-only \
+  --framing binary > chunks.bin
+expected_chunks 3000 1000 --full-lines-only > "$EXPECT_FILE"
+python3 - chunks.bin numbers.txt > "$OUT_FILE" <<'PY'
+import struct, sys
+stream, source = open(sys.argv[1], "rb").read(), open(sys.argv[2], "rb").read()
+header = struct.Struct("=IIQQQ")
+pos = expected_id = 0
+while pos < len(stream):
+    magic, flags, rid, offset, length = header.unpack_from(stream, pos)
+    assert magic == 0x31524C53 and flags == 1 and rid == expected_id
+    payload = stream[pos + header.size:pos + header.size + length]
+    assert payload == source[offset:offset + length]
+    sys.stdout.buffer.write(payload)
+    pos += header.size + length
+    expected_id += 1
+PY
+check_output test_chunks_binary_framing
+
+run_test_expect_error test_chunks_framing_with_tar \
+  --file numbers.txt --chunk-size 100 --framing binary --out-format tar
+
+echo "=== RUN   test_chunks_jsonl"
+"$SLICE_BIN" --file numbers.txt --chunk-size 3000 --overlap 1000 --full-lines-only \
+  --out-format jsonl > chunks.jsonl
+expected_chunks 3000 1000 --full-lines-only > "$EXPECT_FILE"
+python3 - chunks.jsonl numbers.txt > "$OUT_FILE" <<'PY'
+import json, sys
+source = open(sys.argv[2], "rb").read()
+for line in open(sys.argv[1], "rb"):
+    record = json.loads(line)
+    assert record["file"] == sys.argv[2]
+    assert record["text"].encode() == source[record["start"]:record["end"]]
+    sys.stdout.write(record["text"])
+PY
+check_output test_chunks_jsonl
+
+# Every byte JSON must escape, in and around the 32-byte SIMD blocks
+echo "=== RUN   test_chunks_jsonl_escaping"
+python3 -c '
+import sys
+special = "\"\\\x00\x01\x08\x09\x0a\x0c\x0d\x1b\x1f\x7f"
+body = "".join(special[i % len(special)] + "x" * (i % 37) for i in range(2000))
+sys.stdout.write(body + "caf\u00e9 \u20ac\n")' > escape.txt
+"$SLICE_BIN" --file escape.txt --chunk-size 997 --out-format jsonl > escape.jsonl
+cp escape.txt "$EXPECT_FILE"
+python3 -c '
+import json, sys
+sys.stdout.write("".join(json.loads(l)["text"] for l in open(sys.argv[1], "rb")))' escape.jsonl \
+  > "$OUT_FILE"
+check_output test_chunks_jsonl_escaping
+
+# Chunks of --files-from are the chunks of the concatenation, whichever
+# files they span
+split -b 1234 numbers.txt numbers_part_
+ls numbers_part_* > numbers_parts.list
+echo "=== RUN   test_chunks_files_from"
+expected_chunks 3000 1000 --full-lines-only > "$EXPECT_FILE"
+"$SLICE_BIN" --files-from numbers_parts.list --chunk-size 3000 --overlap 1000 --full-lines-only \
+  > "$OUT_FILE"
+check_output test_chunks_files_from
+
+echo "=== RUN   test_chunks_files_from_jsonl"
+"$SLICE_BIN" --file numbers.txt --chunk-size 997 --overlap 100 --out-format jsonl |
+  python3 -c 'import json, sys; [print(l["start"], l["end"], json.dumps(l["text"])) for l in map(json.loads, sys.stdin)]' \
+  > "$EXPECT_FILE"
+"$SLICE_BIN" --files-from numbers_parts.list --chunk-size 997 --overlap 100 --out-format jsonl |
+  python3 -c 'import json, sys; [print(l["start"], l["end"], json.dumps(l["text"])) for l in map(json.loads, sys.stdin)]' \
+  > "$OUT_FILE"
+check_output test_chunks_files_from_jsonl
+
+# With --break-at-files a chunk ends at the end of its file, and the next
+# file starts a chunk
+echo "=== RUN   test_chunks_break_at_files"
+cat > "$EXPECT_FILE" <<'EOF_CHUNKS'
+{"file":"seg1.txt","start":0,"end":10,"text":"seg1 a\nseg"}
+{"file":"seg1.txt","start":6,"end":14,"text":"\nseg1 b\n"}
+{"file":"seg2.txt","start":14,"end":24,"text":"seg2 a\nseg"}
+{"file":"seg2.txt","start":20,"end":28,"text":"\nseg2 b\n"}
+EOF_CHUNKS
+"$SLICE_BIN" --files-from segments.list --chunk-size 10 --overlap 4 --break-at-files \
+  --out-format jsonl > "$OUT_FILE"
+check_output test_chunks_break_at_files
+
+echo "=== RUN   test_chunks_break_at_files_full_lines"
+printf 'seg1 b\nseg2 a\nseg2 b\n' > "$EXPECT_FILE"
+"$SLICE_BIN" --files-from segments.list --start 3 --chunk-size 100 --break-at-files \
+  --full-lines-only > "$OUT_FILE"
+check_output test_chunks_break_at_files_full_lines
+
+run_test_expect_error test_chunks_overlap_too_large \
+  --file numbers.txt --chunk-size 100 --overlap 100
+run_test_expect_error test_chunks_unknown_format \
+  --file numbers.txt --chunk-size 100 --out-format zip
+
+# === Range queries (--since / --until)
+python3 -c '
+import datetime
+t = datetime.datetime(2024, 1, 1)
+with open("events.log", "w") as f:
+    for i in range(50000):
+        f.write((t + datetime.timedelta(seconds=7 * i)).strftime("%Y-%m-%dT%H:%M:%S") + " event %d\n" % i)
+        if i % 100 == 0:
+            f.write("  continuation\n")
+'
+
+# expected_window <since> <until>: lines from since up to until, continuation
+# lines going with the event before them
+expected_window() {
+  awk -v since="$1" -v until="$2" \
+    '/^2/ { keep = ($1 >= since && (until == "" || $1 < until)) } keep' events.log
+}
+
+echo "=== RUN   test_since_until"
+expected_window 2024-01-02T00:00:00 2024-01-02T01:00:00 > "$EXPECT_FILE"
+"$SLICE_BIN" --file events.log --since 2024-01-02T00:00:00 --until 2024-01-02T01:00:00 \
+  > "$OUT_FILE"
+check_output test_since_until
+
+echo "=== RUN   test_since_only"
+expected_window 2024-01-04T12:00:00 "" > "$EXPECT_FILE"
+"$SLICE_BIN" --file events.log --since 2024-01-04T12:00:00 > "$OUT_FILE"
+check_output test_since_only
+
+echo "=== RUN   test_until_only"
+expected_window 0 2024-01-01T00:10:00 > "$EXPECT_FILE"
+"$SLICE_BIN" --file events.log --until 2024-01-01T00:10:00 > "$OUT_FILE"
+check_output test_until_only
+
+echo "=== RUN   test_since_ts_format"
+expected_window 2024-01-03T00:00:00 2024-01-03T00:30:00 > "$EXPECT_FILE"
+"$SLICE_BIN" --file events.log --since "2024-01-03T00:00" --until "2024-01-03T00:30" \
+  --ts-format "%Y-%m-%dT%H:%M" > "$OUT_FILE"
+check_output test_since_ts_format
+
+run_test test_since_after_end "" --file events.log --since 2030-01-01T00:00:00
+run_test test_since_equals_until "" \
+  --file events.log --since 2024-01-02T00:00:00 --until 2024-01-02T00:00:00
+
+echo "=== RUN   test_since_chunks"
+expected_window 2024-01-02T00:00:00 2024-01-02T02:00:00 > "$EXPECT_FILE"
+"$SLICE_BIN" --file events.log --since 2024-01-02T00:00:00 --until 2024-01-02T02:00:00 \
+  --chunk-size 1000 --out-format jsonl \
+  | python3 -c 'import json, sys; sys.stdout.write("".join(json.loads(l)["text"] for l in sys.stdin))' \
+  > "$OUT_FILE"
+check_output test_since_chunks
+
+run_test_expect_error test_since_invalid --file events.log --since yesterday
+run_test_expect_error test_since_with_start --file events.log --start 0 --since 2024-01-02T00:00:00
+run_test_expect_error test_since_stdin --file - --since 2024-01-02T00:00:00
+
+# === Sorted-key lookup (--key-prefix)
+python3 -c '
+import random
+rng = random.Random(7)
+keys = {"".join(rng.choice("abcdef") for _ in range(rng.randint(1, 8))) for _ in range(30000)}
+with open("dict.tsv", "w") as f:
+    for k in sorted(keys):
+        f.write("%s\t%d\n" % (k, rng.randint(0, 999)))
+with open("ids.csv", "w") as f:
+    for i, k in enumerate(sorted(keys)):
+        f.write("%d,%s,x\n" % (i % 10, k))
+'
+
+# key_lookup_test <name> <prefix> <file> <awk field> <slice4 args...>
+key_lookup_test() {
+  local name=$1 prefix=$2 file=$3 field=$4
+  shift 4
+  echo "=== RUN   $name"
+  LC_ALL=C awk -F'[\t,]' -v p="$prefix" -v k="$field" \
+    '{ key = (k == 0 ? $0 : $k) } index(key, p) == 1' "$file" > "$EXPECT_FILE"
+  "$SLICE_BIN" --file "$file" --key-prefix "$prefix" "$@" > "$OUT_FILE"
+  check_output "$name"
+}
+
+key_lookup_test test_key_prefix cab dict.tsv 0
+key_lookup_test test_key_prefix_single_letter a dict.tsv 0
+key_lookup_test test_key_prefix_last f dict.tsv 0
+key_lookup_test test_key_prefix_missing zz dict.tsv 0
+key_lookup_test test_key_field ab ids.csv 2 --key-field 2 --field-sep ,
+
+echo "=== RUN   test_key_prefix_exact"
+grep "^bead	" dict.tsv > "$EXPECT_FILE" || true
+"$SLICE_BIN" --file dict.tsv --key-prefix "$(printf 'bead\t')" --key-field 0 > "$OUT_FILE"
+check_output test_key_prefix_exact
+
+run_test_expect_error test_key_field_sep_invalid --file dict.tsv --key-prefix a --field-sep ab
+
+# === Line sampling (--sample-lines)
+echo "=== RUN   test_sample_lines"
+"$SLICE_BIN" --file numbers.txt --sample-lines 50 --seed 42 > "$OUT_FILE"
+# 50 distinct lines of the file, in file order
+if [[ $(wc -l < "$OUT_FILE") -ne 50 ]] || ! sort -n -c -u "$OUT_FILE" ||
+   [[ -n "$(grep -vxE '[0-9]+' "$OUT_FILE")" ]]; then
+  echo "--- FAIL: test_sample_lines"
+  exit 1
+fi
+echo "--- PASS: test_sample_lines"
+
+echo "=== RUN   test_sample_lines_seeded"
+"$SLICE_BIN" --file numbers.txt --sample-lines 50 --seed 42 > "$EXPECT_FILE"
+check_output test_sample_lines_seeded
+
+echo "=== RUN   test_sample_lines_more_than_file"
+cp input.txt "$EXPECT_FILE"
+"$SLICE_BIN" --file input.txt --sample-lines 10 --seed 1 > "$OUT_FILE"
+check_output test_sample_lines_more_than_file
+
+echo "=== RUN   test_sample_lines_range"
+"$SLICE_BIN" --file numbers.txt --start 1000 --size 100 --sample-lines 1000 --seed 1 > "$OUT_FILE"
+seq 278 302 > "$EXPECT_FILE"
+check_output test_sample_lines_range
+
+# k equal to the number of lines: random probes alone tend to miss a few
+echo "=== RUN   test_sample_lines_all"
+seq 1 200 > "$EXPECT_FILE"
+for seed in 1 2 3 4 5 6 7 8 9 10; do
+  "$SLICE_BIN" --file numbers.txt --start 0 --size 692 --sample-lines 200 --seed "$seed" > "$OUT_FILE"
+  cmp -s "$OUT_FILE" "$EXPECT_FILE" || { echo "--- FAIL: test_sample_lines_all (seed $seed)"; exit 1; }
+done
+"$SLICE_BIN" --file numbers.txt --start 0 --size 692 --sample-lines 199 --seed 3 --sample-uniform \
+  > "$OUT_FILE"
+if [[ $(sort -u "$OUT_FILE" | wc -l) -ne 199 ]]; then
+  echo "--- FAIL: test_sample_lines_all (199 of 200)"
+  exit 1
+fi
+echo "--- PASS: test_sample_lines_all"
+rm -f "$OUT_FILE" "$EXPECT_FILE"
+
+# Only lines starting in [start, start + size), with --start inside a line
+echo "=== RUN   test_sample_lines_unaligned_start"
+"$SLICE_BIN" --file numbers.txt --start 1002 --size 98 --sample-lines 1000 --seed 1 > "$OUT_FILE"
+seq 279 302 > "$EXPECT_FILE"
+check_output test_sample_lines_unaligned_start
+
+echo "=== RUN   test_sample_lines_uniform"
+# Alternate one short line with one 200-byte line: sampling by byte offset
+# almost always lands on long lines, the corrected sample takes both evenly
+python3 -c '
+import sys
+with open("bias.txt", "w") as f:
+    for i in range(2000):
+        f.write("s\n" if i % 2 else "L" * 199 + "\n")'
+short=$("$SLICE_BIN" --file bias.txt --sample-lines 400 --seed 5 --sample-uniform | grep -c '^s$')
+if (( short < 150 || short > 250 )); then
+  echo "--- FAIL: test_sample_lines_uniform ($short short lines of 400)"
+  exit 1
+fi
+echo "--- PASS: test_sample_lines_uniform"
+
+run_test_expect_error test_sample_lines_stdin --file - --sample-lines 5
+
+# === Line-aligned split (--split)
+echo "=== RUN   test_split"
+mkdir -p parts
+"$SLICE_BIN" --file large.txt --split 7 --out-prefix parts/large
+cp large.txt "$EXPECT_FILE"
+cat parts/large0* > "$OUT_FILE"
+check_output test_split
+echo "=== RUN   test_split_line_aligned"
+size=$(wc -c < large.txt)
+for part in parts/large0*; do
+  bytes=$(wc -c < "$part")
+  if [[ "$(tail -c 1 "$part" | xxd -p)" != "0a" ]] || (( bytes < size / 7 - 16 || bytes > size / 7 + 16 )); then
+    echo "--- FAIL: test_split_line_aligned ($part, $bytes bytes)"
+    exit 1
+  fi
+done
+echo "--- PASS: test_split_line_aligned"
+
+echo "=== RUN   test_split_more_parts_than_lines"
+"$SLICE_BIN" --file input.txt --split 5 --out-prefix parts/small
+cp input.txt "$EXPECT_FILE"
+cat parts/small0* > "$OUT_FILE"
+if [[ $(ls parts/small* | wc -l) -ne 5 ]]; then
+  echo "--- FAIL: test_split_more_parts_than_lines (expected 5 files)"
+  exit 1
+fi
+check_output test_split_more_parts_than_lines
+
+echo "=== RUN   test_split_range"
+"$SLICE_BIN" --file events.log --since 2024-01-02T00:00:00 --until 2024-01-03T00:00:00 \
+  --split 4 --out-prefix parts/window
+expected_window 2024-01-02T00:00:00 2024-01-03T00:00:00 > "$EXPECT_FILE"
+cat parts/window0* > "$OUT_FILE"
+check_output test_split_range
+
+# The parts cover the lines starting in [start, start + size), however far
+# the first line start is from --start
+echo "=== RUN   test_split_unaligned_start"
+seq -f 'l%g' 0 9 > ten_lines.txt
+"$SLICE_BIN" --file ten_lines.txt --start 4 --size 11 --split 2 --out-prefix parts/ten
+printf 'l2\nl3\nl4\n' > "$EXPECT_FILE"
+cat parts/ten0* > "$OUT_FILE"
+check_output test_split_unaligned_start
+
+run_test_expect_error test_split_no_prefix --file input.txt --split 2
+
+# === Shards (--shard)
+echo "=== RUN   test_shards_cover_file"
+cp large.txt "$EXPECT_FILE"
+for i in $(seq 0 6); do
+  "$SLICE_BIN" --file large.txt --shard "$i/7"
+done > "$OUT_FILE"
+check_output test_shards_cover_file
+
+echo "=== RUN   test_shard_matches_split"
+cp parts/large03 "$EXPECT_FILE"
+"$SLICE_BIN" --file large.txt --shard 3/7 > "$OUT_FILE"
+check_output test_shard_matches_split
+
+echo "=== RUN   test_shards_chunked"
+cp numbers.txt "$EXPECT_FILE"
+for i in 0 1 2; do
+  "$SLICE_BIN" --file numbers.txt --shard "$i/3" --chunk-size 1000 --out-format jsonl
+done | python3 -c 'import json, sys; sys.stdout.write("".join(json.loads(l)["text"] for l in sys.stdin))' \
+  > "$OUT_FILE"
+check_output test_shards_chunked
+
+echo "=== RUN   test_shards_of_time_range"
+expected_window 2024-01-02T00:00:00 2024-01-03T00:00:00 > "$EXPECT_FILE"
+for i in 0 1 2 3; do
+  "$SLICE_BIN" --file events.log --since 2024-01-02T00:00:00 --until 2024-01-03T00:00:00 \
+    --shard "$i/4"
+done > "$OUT_FILE"
+check_output test_shards_of_time_range
+
+run_test test_shard_empty "" --file input.txt --shard 2/5
+run_test_expect_error test_shard_out_of_range --file input.txt --shard 5/5
+run_test_expect_error test_shard_malformed --file input.txt --shard 3
+
+# === Line filters (--match, --match-any)
+large_size=$(wc -c < large.txt)
+
+echo "=== RUN   test_match"
+grep -F 12345 large.txt > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size "$large_size" --file large.txt --match 12345 > "$OUT_FILE"
+check_output test_match
+
+echo "=== RUN   test_match_partial_lines"
+"$SLICE_BIN" --start 1001 --size 300000 --file events.log | grep -F "event 1" > "$EXPECT_FILE"
+"$SLICE_BIN" --start 1001 --size 300000 --file events.log --match "event 1" > "$OUT_FILE"
+check_output test_match_partial_lines
+
+echo "=== RUN   test_match_full_lines"
+"$SLICE_BIN" --start 1001 --size 300000 --file events.log --full-lines-only \
+  | grep -F continuation > "$EXPECT_FILE"
+"$SLICE_BIN" --start 1001 --size 300000 --file events.log --full-lines-only \
+  --match continuation > "$OUT_FILE"
+check_output test_match_full_lines
+
+echo "=== RUN   test_match_any"
+printf '99999\n424242\n\n1000000\n' > patterns.txt
+# Unlike grep -F -f, blank lines in the pattern file are skipped
+grep -v '^$' patterns.txt | grep -F -f - large.txt > "$EXPECT_FILE"
+# Small reads make lines straddle buffers
+SLICE_CHUNK_SIZE=1000 "$SLICE_BIN" --start 0 --size "$large_size" --file large.txt \
+  --match-any patterns.txt > "$OUT_FILE"
+check_output test_match_any
+
+echo "=== RUN   test_match_any_crlf"
+grep -v '^$' patterns.txt | grep -F -f - large.txt > "$EXPECT_FILE"
+printf '99999\r\n424242\r\n\r\n1000000\r\n' > patterns_crlf.txt
+"$SLICE_BIN" --start 0 --size "$large_size" --file large.txt --match-any patterns_crlf.txt \
+  > "$OUT_FILE"
+check_output test_match_any_crlf
+
+echo "=== RUN   test_match_stdin_last_line"
+printf 'abc\nxyz' > "$EXPECT_FILE.in"
+printf 'xyz' > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size 100 --file - --match xy < "$EXPECT_FILE.in" > "$OUT_FILE"
+check_output test_match_stdin_last_line
+
+run_test test_match_none "" --start 0 --size 100 --file input.txt --match "Line 4"
+run_test_expect_error test_match_empty --start 0 --size 100 --file input.txt --match ""
+run_test_expect_error test_match_with_chunks --file input.txt --chunk-size 10 --match Line
+
+# === Column projection (--fields)
+python3 -c '
+import csv, random
+rng = random.Random(11)
+with open("wide.tsv", "w") as f:
+    for i in range(20000):
+        f.write("\t".join(str(rng.randint(0, 10 ** 6)) for _ in range(40)) + "\n")
+# Quoted fields holding separators and doubled quotes
+rows = [["".join(rng.choice("ab,\" x") for _ in range(rng.randint(0, 12)))
+         for _ in range(rng.randint(1, 12))] for _ in range(20000)]
+with open("quoted.csv", "w", newline="") as f:
+    csv.writer(f, lineterminator="\n").writerows(rows)
+with open("quoted_2_3_5_9.csv", "w", newline="") as f:
+    w = csv.writer(f, lineterminator="\n")
+    for r in rows:
+        kept = [r[i - 1] for i in (2, 3, 5, 9) if i <= len(r)]
+        # csv writes a lone empty field as "", --fields copies it verbatim
+        if kept == [""]:
+            f.write("\n")
+        else:
+            w.writerow(kept)
+'
+wide_size=$(wc -c < wide.tsv)
+
+echo "=== RUN   test_fields_tsv"
+cut -f 1,4,7 wide.tsv > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size "$wide_size" --file wide.tsv --fields 7,1,4 > "$OUT_FILE"
+check_output test_fields_tsv
+
+echo "=== RUN   test_fields_range_list"
+cut -f 2-5,40 wide.tsv > "$EXPECT_FILE"
+SLICE_CHUNK_SIZE=1000 "$SLICE_BIN" --start 0 --size "$wide_size" --file wide.tsv --fields 2-5,40 \
+  > "$OUT_FILE"
+check_output test_fields_range_list
+
+echo "=== RUN   test_fields_quoted_csv"
+cp quoted_2_3_5_9.csv "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size "$(wc -c < quoted.csv)" --file quoted.csv --fields 2,3,5,9 \
+  --field-sep , > "$OUT_FILE"
+check_output test_fields_quoted_csv
+
+echo "=== RUN   test_fields_with_match"
+grep -F 12345 wide.tsv | cut -f 3 > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size "$wide_size" --file wide.tsv --match 12345 --fields 3 > "$OUT_FILE"
+check_output test_fields_with_match
+
+run_test test_fields_last_line "$(printf 'b\nd')" --start 0 --size 100 --file - --fields 2 --field-sep , \
+  < <(printf 'a,b,c\nc,d')
+# A quote inside a field is an ordinary byte and never spans lines
+run_test test_fields_mid_field_quote "$(printf 'x\nd\ng')" --start 0 --size 1000 --file - \
+  --fields 3 < <(printf 'a\t12" pipe\tx\nb\tc\td\ne\tf\tg')
+
+echo "=== RUN   test_fields_stray_quotes"
+python3 -c '
+import random
+rng = random.Random(5)
+with open("stray.tsv", "w") as f:
+    for i in range(20000):
+        f.write("\t".join("".join(rng.choice("ab\" 7") for _ in range(rng.randint(1, 9))).lstrip("\"")
+                          or "z" for _ in range(rng.randint(5, 8))) + "\n")
+'
+cut -f 2,5 stray.tsv > "$EXPECT_FILE"
+SLICE_CHUNK_SIZE=777 "$SLICE_BIN" --start 0 --size "$(wc -c < stray.tsv)" --file stray.tsv \
+  --fields 2,5 > "$OUT_FILE"
+check_output test_fields_stray_quotes
+
+run_test_expect_error test_fields_zero --start 0 --size 100 --file input.txt --fields 0
+run_test_expect_error test_fields_bad_list --start 0 --size 100 --file input.txt --fields 1,,2
+
+# === CSV records (--record-format csv)
+python3 -c '
+import csv, random
+rng = random.Random(9)
+values = ["plain", "multi\nline", "has, comma", "q\"uote", "", "x"]
+with open("records.csv", "w", newline="") as f:
+    w = csv.writer(f, lineterminator="\n")
+    for i in range(20000):
+        w.writerow([rng.choice(values) + str(i) for _ in range(5)])
+'
+
+# expected_records <start> <size>: the whole records of the slice, computed
+# with the quote state tracked from the start of the file
+expected_records() {
+  python3 -c '
+import sys
+data = open("records.csv", "rb").read()
+start, size = int(sys.argv[1]), int(sys.argv[2])
+ends, quoted = [], False
+for i, c in enumerate(data):
+    if c == 0x22:
+        quoted = not quoted
+    elif c == 0x0a and not quoted:
+        ends.append(i + 1)
+first = 0 if start == 0 else next((e for e in ends if e > start), None)
+last = max([e for e in ends if e <= start + size], default=None)
+if first is not None and last is not None and last > first:
+    sys.stdout.buffer.write(data[first:last])
+' "$1" "$2"
+}
+
+for range in "0 5000" "12345 30000" "400000 7777"; do
+  read -r record_start record_size <<< "$range"
+  echo "=== RUN   test_csv_records_$record_start"
+  expected_records "$record_start" "$record_size" > "$EXPECT_FILE"
+  "$SLICE_BIN" --start "$record_start" --size "$record_size" --file records.csv --full-lines-only \
+    --record-format csv > "$OUT_FILE"
+  check_output "test_csv_records_$record_start"
+done
+
+echo "=== RUN   test_csv_records_stream"
+expected_records 12345 30000 > "$EXPECT_FILE"
+SLICE_CHUNK_SIZE=100 "$SLICE_BIN" --start 12345 --size 30000 --file - --full-lines-only \
+  --record-format csv < records.csv > "$OUT_FILE"
+check_output test_csv_records_stream
+
+echo "=== RUN   test_csv_records_chunks"
+"$SLICE_BIN" --file records.csv --chunk-size 5000 --overlap 1000 --full-lines-only \
+  --record-format csv --out-format jsonl > records.jsonl
+python3 -c '
+import csv, io, json, sys
+for line in open("records.jsonl"):
+    rows = list(csv.reader(io.StringIO(json.loads(line)["text"])))
+    if any(len(r) != 5 for r in rows):
+        sys.exit("chunk at %d splits a record" % json.loads(line)["start"])
+'
+expected_records 8000 5000 > "$EXPECT_FILE"
+python3 -c '
+import json, sys
+sys.stdout.write(json.loads(open("records.jsonl").readlines()[2])["text"])' > "$OUT_FILE"
+check_output test_csv_records_chunks
+
+echo "=== RUN   test_csv_records_fields"
+python3 -c '
+import csv, sys
+w = csv.writer(sys.stdout, lineterminator="\n")
+for r in csv.reader(open("records.csv", newline="")):
+    w.writerow([r[1], r[3]])' > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size "$(wc -c < records.csv)" --file records.csv --record-format csv \
+  --fields 2,4 > "$OUT_FILE"
+check_output test_csv_records_fields
+
+run_test_expect_error test_csv_records_unknown --start 0 --size 10 --file input.txt --record-format xml
+
+# === JSON Lines records (--record-format jsonl, --validate)
+python3 -c '
+import json, random
+rng = random.Random(4)
+texts = ["plain", "close } brace", "quote \" and \\ slash", "[open", "\\"]
+with open("events.jsonl", "w") as f:
+    for i in range(5000):
+        o = {"id": i, "msg": rng.choice(texts), "sub": {"tags": [i % 7, {"k": "}"}]}}
+        f.write(json.dumps(o, indent=2 if i % 3 == 0 else None) + "\n")
+'
+
+# expected_json_records <start> <size>: the whole records of the slice; every
+# record starts with { at column 0
+expected_json_records() {
+  python3 -c '
+import sys
+data = open("events.jsonl", "rb").read()
+start, size = int(sys.argv[1]), int(sys.argv[2])
+starts = [i for i in range(len(data)) if data[i:i + 1] == b"{" and (i == 0 or data[i - 1] == 0x0a)]
+ends = starts[1:] + [len(data)]
+sys.stdout.buffer.write(b"".join(data[s:e] for s, e in zip(starts, ends)
+                                 if (s > start or start == 0) and e <= start + size))
+' "$1" "$2"
+}
+
+for range in "0 4000" "777 20000" "150000 9999"; do
+  read -r record_start record_size <<< "$range"
+  echo "=== RUN   test_json_records_$record_start"
+  expected_json_records "$record_start" "$record_size" > "$EXPECT_FILE"
+  SLICE_CHUNK_SIZE=61 "$SLICE_BIN" --start "$record_start" --size "$record_size" --file events.jsonl \
+    --full-lines-only --record-format jsonl > "$OUT_FILE"
+  check_output "test_json_records_$record_start"
+done
+
+echo "=== RUN   test_json_records_chunks"
+"$SLICE_BIN" --file events.jsonl --chunk-size 5000 --overlap 500 --full-lines-only \
+  --record-format jsonl --out-format jsonl > json_chunks.jsonl
+python3 -c '
+import json, sys
+for line in open("json_chunks.jsonl"):
+    text = json.loads(line)["text"]
+    decoder, pos = json.JSONDecoder(), 0
+    while text[pos:].strip():
+        value, pos = decoder.raw_decode(text, pos)
+        pos += 1
+' || { echo "--- FAIL: test_json_records_chunks (chunk splits a record)"; exit 1; }
+expected_json_records 9000 5000 > "$EXPECT_FILE"
+python3 -c '
+import json, sys
+sys.stdout.write(json.loads(open("json_chunks.jsonl").readlines()[2])["text"])' > "$OUT_FILE"
+check_output test_json_records_chunks
+
+echo "=== RUN   test_json_records_match"
+python3 -c '
+import re, sys
+records = re.split(r"(?<=\n)(?=\{)", open("events.jsonl").read())
+sys.stdout.write("".join(r for r in records if "close } brace" in r))
+' > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size "$(wc -c < events.jsonl)" --file events.jsonl --record-format jsonl \
+  --match 'close } brace' > "$OUT_FILE"
+check_output test_json_records_match
+
+echo "=== RUN   test_json_records_validate"
+printf '{"a":1}\n{"b":"raw\nnewline"}\n{"c":[1,2}\n{"d":\n  {"e":2}\n}\n{"f":2\n{"g":"ok"}\n]\n{"h":3}\n' > broken.jsonl
+cat > broken_expected.txt << 'EXPECTED'
+Invalid JSON record at bytes 8-28: newline inside a string
+Invalid JSON record at bytes 28-39: mismatched bracket
+Invalid JSON record at bytes 57-64: unterminated value
+Invalid JSON record at bytes 75-77: unbalanced bracket
+EXPECTED
+cp broken_expected.txt "$EXPECT_FILE"
+SLICE_CHUNK_SIZE=3 "$SLICE_BIN" --start 0 --size 100 --file broken.jsonl --record-format jsonl \
+  --validate 2> "$OUT_FILE" > broken_out.jsonl
+check_output test_json_records_validate
+if ! cmp -s broken.jsonl broken_out.jsonl; then
+  echo "--- FAIL: test_json_records_validate_passthrough"
+  exit 1
+fi
+echo "--- PASS: test_json_records_validate_passthrough"
+
+echo "=== RUN   test_json_records_validate_chunks"
+cp broken_expected.txt "$EXPECT_FILE"
+"$SLICE_BIN" --file broken.jsonl --chunk-size 30 --overlap 10 --record-format jsonl --validate \
+  2> "$OUT_FILE" > /dev/null
+check_output test_json_records_validate_chunks
+
+run_test_expect_error test_json_records_validate_lines --start 0 --size 10 --file input.txt --validate
+run_test_expect_error test_json_records_fields --start 0 --size 10 --file events.jsonl \
+  --record-format jsonl --fields 1
+
+# === Multi-line records (--record-start)
+python3 -c '
+import random
+rng = random.Random(6)
+with open("app.log", "w") as f:
+    for i in range(4000):
+        f.write("2024-03-%02d 12:00:%02d INFO req %d\n" % (rng.randint(1, 28), rng.randint(0, 59), i))
+        if rng.random() < 0.25:
+            f.write("java.lang.IllegalStateException: boom %d\n" % i)
+            for k in range(rng.randint(1, 6)):
+                f.write("\tat com.example.C%d.run(C.java:%d)\n" % (k, i))
+'
+
+# expected_log_records <start> <size> <regex> [<match>]: the whole records of
+# the slice, where a record ends before a line matching <regex>
+expected_log_records() {
+  python3 -c '
+import re, sys
+data = open("app.log", "rb").read()
+start, size, pattern = int(sys.argv[1]), int(sys.argv[2]), re.compile(sys.argv[3].encode())
+match = sys.argv[4].encode() if len(sys.argv) > 4 else b""
+ends = [m.end() for m in re.finditer(b"\n", data)
+        if m.end() == len(data) or pattern.match(data, m.end())]
+records = [data[a:b] for a, b in zip([0] + ends, ends)
+           if (a > start or start == 0) and b <= start + size]
+sys.stdout.buffer.write(b"".join(r for r in records if match in r))
+' "$@"
+}
+
+for range in "0 3000" "5000 20000" "100000 9999"; do
+  read -r record_start record_size <<< "$range"
+  echo "=== RUN   test_record_start_$record_start"
+  expected_log_records "$record_start" "$record_size" '2024-' > "$EXPECT_FILE"
+  SLICE_CHUNK_SIZE=50 "$SLICE_BIN" --start "$record_start" --size "$record_size" --file app.log \
+    --full-lines-only --record-start '2024-' > "$OUT_FILE"
+  check_output "test_record_start_$record_start"
+done
+
+echo "=== RUN   test_record_start_regex"
+expected_log_records 7777 30000 '[0-9]{4}-[0-9]{2}-' > "$EXPECT_FILE"
+"$SLICE_BIN" --start 7777 --size 30000 --file - --full-lines-only \
+  --record-start '^[0-9]{4}-[0-9]{2}-' < app.log > "$OUT_FILE"
+check_output test_record_start_regex
+
+echo "=== RUN   test_record_start_chunks"
+"$SLICE_BIN" --file app.log --chunk-size 4000 --overlap 400 --full-lines-only \
+  --record-start '2024-' --out-format jsonl > log_chunks.jsonl
+python3 -c '
+import json, sys
+data = open("app.log").read()
+for line in open("log_chunks.jsonl"):
+    chunk = json.loads(line)
+    if chunk["text"] and not (data.startswith("2024-", chunk["start"]) and
+                              data.startswith("2024-", chunk["end"]) or chunk["end"] == len(data)):
+        sys.exit("chunk at %d splits a record" % chunk["start"])
+'
+expected_log_records 7200 4000 '2024-' > "$EXPECT_FILE"
+python3 -c '
+import json, sys
+sys.stdout.write(json.loads(open("log_chunks.jsonl").readlines()[2])["text"])' > "$OUT_FILE"
+check_output test_record_start_chunks
+
+echo "=== RUN   test_record_start_match"
+expected_log_records 0 "$(wc -c < app.log)" '2024-' 'C5.run' > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size "$(wc -c < app.log)" --file app.log --record-start '2024-' \
+  --match 'C5.run' > "$OUT_FILE"
+check_output test_record_start_match
+
+# A pattern without metacharacters is matched whole: a near miss continues
+# the record before it
+printf 'ERROR one\nERRO two\nERROR three\n2024-01 a\n2024x b\n' > near_miss.log
+echo "=== RUN   test_record_start_near_miss"
+printf 'ERROR one\nERRO two\n' > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size 100 --file near_miss.log --record-start ERROR --match two \
+  > "$OUT_FILE"
+check_output test_record_start_near_miss
+echo "=== RUN   test_record_start_near_miss_dash"
+printf '2024-01 a\n2024x b\n' > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size 100 --file near_miss.log --record-start '2024-' --match b \
+  > "$OUT_FILE"
+check_output test_record_start_near_miss_dash
+
+# Bracketed log levels: a literal prefix, not a bracket expression
+printf '[ERROR] a\n  trace\n[INFO] b\nE x\n[ERROR] c\n' > levels.log
+echo "=== RUN   test_record_start_prefix"
+printf '[ERROR] a\n  trace\n[INFO] b\nE x\n' > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size 100 --file levels.log --record-start-prefix '[ERROR]' --match b \
+  > "$OUT_FILE"
+check_output test_record_start_prefix
+
+echo "=== RUN   test_record_start_bracket_regex"
+printf '[INFO] b\nE x\n' > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size 100 --file levels.log --record-start '\[(ERROR|INFO)\]' --match b \
+  > "$OUT_FILE"
+check_output test_record_start_bracket_regex
+
+run_test_expect_error test_record_start_bad_regex --start 0 --size 10 --file app.log \
+  --record-start '('
+run_test_expect_error test_record_start_csv --start 0 --size 10 --file app.log \
+  --record-start '2024-' --record-format csv
+
+# === I/O pacing (--max-bandwidth, --max-iops, --idle-io)
+yes 'paced line of text' | head -c 3145728 > paced.txt
+
+echo "=== RUN   test_max_bandwidth"
+cp paced.txt "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size 3145728 --file paced.txt --max-bandwidth 8 --idle-io --debug \
+  > "$OUT_FILE" 2> paced.err
+grep -q 'Waited' paced.err || { echo "--- FAIL: test_max_bandwidth (reads not paced)"; exit 1; }
+check_output test_max_bandwidth
+
+echo "=== RUN   test_max_iops_chunks"
+"$SLICE_BIN" --start 0 --size 3145728 --file paced.txt > "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size 3145728 --file paced.txt --chunk-size 131072 --max-iops 100 --debug \
+  > "$OUT_FILE" 2> paced.err
+grep -q 'Waited' paced.err || { echo "--- FAIL: test_max_iops_chunks (chunks not paced)"; exit 1; }
+check_output test_max_iops_chunks
+
+run_test_expect_error test_max_bandwidth_zero --start 0 --size 10 --file input.txt --max-bandwidth 0
+run_test_expect_error test_max_iops_split --start 0 --size 10 --file input.txt --max-iops 5 \
+  --split 2 --out-prefix paced_part
+
+# === Page cache (--cache-policy, --cache-report)
+for policy in default sequential noreuse drop-after; do
+  echo "=== RUN   test_cache_policy_$policy"
+  cp paced.txt "$EXPECT_FILE"
+  "$SLICE_BIN" --start 0 --size 3145728 --file paced.txt --cache-policy "$policy" > "$OUT_FILE"
+  check_output "test_cache_policy_$policy"
+done
+
+echo "=== RUN   test_cache_policy_chunks"
+"$SLICE_BIN" --start 1000 --size 2000000 --file paced.txt --chunk-size 300000 --full-lines-only \
+  > "$EXPECT_FILE"
+"$SLICE_BIN" --start 1000 --size 2000000 --file paced.txt --chunk-size 300000 --full-lines-only \
+  --cache-policy noreuse > "$OUT_FILE"
+check_output test_cache_policy_chunks
+
+echo "=== RUN   test_cache_report"
+"$SLICE_BIN" --start 0 --size 3145728 --file paced.txt > /dev/null
+"$SLICE_BIN" --start 0 --size 3145728 --file paced.txt --cache-report 2> cache.err > /dev/null
+# Just read, so every page is resident (768 pages of 4 KiB, fewer if larger)
+if ! grep -Eq '^Cache: ([0-9]+) of \1 pages \(100\.0%\) resident before reading 3\.0 MB$' cache.err; then
+  echo "--- FAIL: test_cache_report (got: $(cat cache.err))"
+  exit 1
+fi
+"$SLICE_BIN" --start 0 --size 3145728 --file paced.txt --chunk-size 1048576 --cache-report \
+  2> cache.err > /dev/null
+grep -q '^Cache: .* resident before reading 3\.0 MB$' cache.err ||
+  { echo "--- FAIL: test_cache_report (no report in chunking mode)"; exit 1; }
+echo "--- PASS: test_cache_report"
+
+run_test_expect_error test_cache_policy_unknown --start 0 --size 10 --file input.txt --cache-policy lru
+run_test_expect_error test_cache_report_url --start 0 --size 10 --url http://127.0.0.1:1/x --cache-report
+
+# === Compression (--compress)
+echo "=== RUN   test_compress_gzip"
+cp large.txt "$EXPECT_FILE"
+"$SLICE_BIN" --start 0 --size 100000000 --file large.txt --compress gzip --compress-threads 3 \
+  | gzip -dc > "$OUT_FILE"
+check_output test_compress_gzip
+
+echo "=== RUN   test_compress_gzip_full_lines"
+"$SLICE_BIN" --start 5000 --size 40000 --file numbers.txt --full-lines-only > "$EXPECT_FILE"
+"$SLICE_BIN" --start 5000 --size 40000 --file numbers.txt --full-lines-only --compress gzip \
+  | gzip -dc > "$OUT_FILE"
+check_output test_compress_gzip_full_lines
+
+echo "=== RUN   test_compress_gzip_tar"
+"$SLICE_BIN" --file large.txt --chunk-size 100000 --out-format tar > "$EXPECT_FILE"
+"$SLICE_BIN" --file large.txt --chunk-size 100000 --out-format tar --compress gzip \
+  | gzip -dc > "$OUT_FILE"
+check_output test_compress_gzip_tar
+
+run_test_expect_error test_compress_unknown --start 0 --size 10 --file input.txt --compress lz4
+
+# zstd is optional at build time (make slice4 ZSTD=1)
+if "$SLICE_BIN" --start 0 --size 1 --file input.txt --compress zstd > /dev/null 2>&1 &&
+   command -v zstd > /dev/null; then
+  echo "=== RUN   test_compress_zstd_seekable"
+  "$SLICE_BIN" --file large.txt --chunk-size 100000 --out-format tar > "$EXPECT_FILE"
+  "$SLICE_BIN" --file large.txt --chunk-size 100000 --out-format tar --compress zstd > chunks.tar.zst
+  zstd -qdc chunks.tar.zst > "$OUT_FILE"
+  check_output test_compress_zstd_seekable
+  # Seek table footer: frame count, descriptor, seekable magic
+  magic=$(tail -c 4 chunks.tar.zst | xxd -p)
+  if [[ "$magic" != "b1ea928f" ]]; then
+    echo "--- FAIL: test_compress_zstd_seekable (no seek table, footer $magic)"
+    exit 1
+  fi
+else
+  echo "SKIP: slice4 built without zstd, --compress zstd not checked"
+fi
+
+# === Sealed memfd handoff (--output-memfd)
+if [[ "$(uname -s)" == "Linux" ]]; then
+  MEMFD_SOCKET="$WORK_DIR/memfd.sock"
+  RECEIVER="$SCRIPT_DIR/memfd_receiver.py"
+
+  # memfd_test <name> <slice4 args...>: compare the memfd contents with stdout
+  memfd_test() {
+    local name=$1
+    shift
+    echo "=== RUN   $name"
+    "$SLICE_BIN" "$@" > "$EXPECT_FILE"
+    python3 "$RECEIVER" "$MEMFD_SOCKET" > "$OUT_FILE" &
+    local receiver_pid=$!
+    for _ in $(seq 1 50); do
+      [[ -S "$MEMFD_SOCKET" ]] && break
+      sleep 0.1
+    done
+    "$SLICE_BIN" "$@" --output-memfd "$MEMFD_SOCKET"
+    wait "$receiver_pid"
+    check_output "$name"
+  }
+
+  memfd_test test_memfd_basic --start 7 --size 7 --file input.txt
+  memfd_test test_memfd_full_lines --start 5000 --size 40000 --file numbers.txt --full-lines-only
+  memfd_test test_memfd_large --start 1234 --size 25000000 --file large.txt
+  memfd_test test_memfd_empty --start 100000 --size 10 --file input.txt
+
+  echo "=== RUN   test_memfd_no_listener"
+  if "$SLICE_BIN" --start 0 --size 10 --file input.txt --output-memfd "$MEMFD_SOCKET" 2> /dev/null; then
+    echo "--- FAIL: test_memfd_no_listener (expected error, got success)"
+    exit 1
+  fi
+  echo "--- PASS: test_memfd_no_listener"
+fi
+
+# === Cleanup
+cd "$SCRIPT_DIR"
+rm -rf "$WORK_DIR"
+echo "PASS"
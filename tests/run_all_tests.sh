@@ -31,6 +31,7 @@ bash test_slice.sh "$ROOT_DIR/slice"
 echo "==> C tests"
 cd "$SCRIPT_DIR/c"
 bash test_slice.sh
+bash test_slice4.sh
 cd ..
 
 echo "All tests passed."